@@ -1,12 +1,16 @@
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cmath>
 #include <cstdint>
+#include <cstdlib>
 #include <deque>
-#include <fstream>
 #include <ios>
 #include <iostream>
+#include <new>
 #include <numeric>
 #include <perfcpp/event_counter.h>
+#include <string>
 #include <thread>
 #include <utility>
 #include <vector>
@@ -14,6 +18,7 @@
 import utils.tqstream;
 import utils.stupid_type_traits;
 import utils.generic_stream;
+import utils.source;
 import parser.rd;
 import lexer;
 import ast;
@@ -22,6 +27,12 @@ import ast.rc_node_builder;
 import ast.offset_builder;
 import ast.offset_dedupl_builder;
 import ast.hash_payload_builder;
+import ast.folder;
+import ast.resolver;
+import ast.interpreter;
+import ast.bytecode;
+import ast.compiler;
+import vm;
 
 using namespace loxxy;
 using namespace utils;
@@ -48,6 +59,32 @@ std::string demangle(const char* name) { return name; }
 
 #endif
 
+// every heap allocation of the program is counted, so the benchmarks can tell which phases allocate
+static std::atomic<size_t> allocations = 0;
+
+auto operator new(size_t size) -> void* {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+
+// the ones of over-aligned types, like the strings concatenation allocates
+auto operator new(size_t size, std::align_val_t alignment) -> void* {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    // aligned_alloc takes sizes that are a multiple of the alignment only
+    auto align = static_cast<size_t>(alignment);
+    if (void* ptr = std::aligned_alloc(align, (std::max<size_t>(size, 1) + align - 1) / align * align))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept { std::free(ptr); }
+
 template <typename... Ts>
 void for_types(auto&& f) {
     (f.template operator()<Ts>(), ...);
@@ -59,41 +96,38 @@ using std::chrono::high_resolution_clock;
 using std::chrono::milliseconds;
 
 auto main(int argc, const char** argv) -> int {
-    std::ifstream file;
     if (argc < 2) {
         std::cerr << "Need a file to read: benchmark <file>" << std::endl;
         return 1;
-    } else {
-        file.open(argv[1]);
-        if (file.fail()) {
-            std::cout << "File not found:\n" << argv[1] << std::endl;
-            return 1;
-        }
+    }
+    mapped_source file(argv[1]);
+    if (file.fail()) {
+        std::cout << "File not found:\n" << argv[1] << std::endl;
+        return 1;
     }
 
     generic_stream<std::vector, Token> token_stream;
-    generic_stream<std::vector, char> char_stream;
 
     int mult = 1;
     if (argc > 2)
         mult = std::stoi(argv[2]);
 
-    size_t n_chars = 0;
+    // the file repeated mult times, so that lexing is timed on inputs larger than the caches
+    std::string contents;
     while (!file.eof()) {
-        char_stream.putback(file.get());
-        n_chars++;
-    }
-    char_stream.v.reserve((mult - 1) * n_chars);
-    for (int i = 0; i < mult; i++) {
-        for (size_t j = 0; j < n_chars; j++) {
-            char_stream.putback(char_stream.v[j]);
-        }
+        contents.append(file.cursor(), file.limit());
+        file.advance(file.limit());
     }
-    file.close();
+    size_t n_chars = contents.size();
+    contents.reserve(mult * n_chars);
+    for (int i = 1; i < mult; i++)
+        contents.append(contents.data(), n_chars);
+    mapped_source char_stream = mapped_source::from_string(contents);
     n_chars *= mult;
     std::cout << "num of chars: " << n_chars << "\n";
 
     Loxxer lexer(char_stream, token_stream);
+    const persistent_string<>* clock_id = lexer.addBuiltin("clock");
     std::vector<double> times;
     for (int i = 0; i < 5; i++) {
         token_stream.v.clear();
@@ -168,6 +202,120 @@ auto main(int argc, const char** argv) -> int {
         std::cout << "stddev: " << stddev << "\n";
     });
 
+    // the same tokens with one array per field
+    TokenBuffer token_buffer;
+    for (const Token& token : token_stream.v)
+        token_buffer.emplace(token);
+    std::cout << "Parser from a token buffer:\n";
+    for (int i = 0; i < 5; i++) {
+        Parser<TokenBuffer, BoxParse> parser(token_buffer);
+        auto t1 = high_resolution_clock::now();
+        parser.parse();
+        auto t2 = high_resolution_clock::now();
+        std::cout << "  " << duration<double, std::milli>(t2 - t1).count() << std::endl;
+        token_buffer.reset();
+    }
+
+    // the program's own output would drown out the measurements
+    auto time_muted = [](auto&& run) {
+        std::cout.setstate(std::ios_base::badbit);
+        size_t allocations_before = allocations.load(std::memory_order_relaxed);
+        auto t1 = high_resolution_clock::now();
+        run();
+        auto t2 = high_resolution_clock::now();
+        size_t n_allocations = allocations.load(std::memory_order_relaxed) - allocations_before;
+        std::cout.clear();
+        return std::pair{duration<double, std::milli>(t2 - t1).count(), n_allocations};
+    };
+
+    {
+        Parser<generic_stream<std::vector, Token>, BoxedNodeBuilder<>> parser(token_stream);
+        auto root = parser.parse();
+        token_stream.reset();
+
+        ConstantFolder<empty, UniquePtrIndirection, true, BoxedNodeBuilder<>> folder{BoxedNodeBuilder<>{}};
+        auto t1 = high_resolution_clock::now();
+        auto statements = folder.copy(root.statements);
+        auto t2 = high_resolution_clock::now();
+
+        NodeCounter<empty, UniquePtrIndirection, true> counter;
+        size_t n_parsed = counter.count(root.statements);
+        size_t n_folded = counter.count(statements);
+        std::cout << "Constant folding:\n";
+        std::cout << "  time:  " << duration<double, std::milli>(t2 - t1).count() << "\n";
+        std::cout << "  nodes: " << n_parsed << " -> " << n_folded << " (-"
+                  << 100.0 * static_cast<double>(n_parsed - n_folded) / static_cast<double>(n_parsed) << "%)"
+                  << std::endl;
+    }
+
+    // the backends run the folded trees, like lox does
+    std::cout << "Backends (" << (nan_boxed_values ? "NaN-boxed" : "variant") << " values, " << sizeof(Value)
+              << " bytes each):\n";
+    for_types<empty, SlotPayload>([&token_stream, &time_muted, clock_id]<typename Payload>() {
+        Parser<generic_stream<std::vector, Token>, BoxedNodeBuilder<Payload>> parser(token_stream);
+        auto root = parser.parse();
+        token_stream.reset();
+
+        ConstantFolder<Payload, UniquePtrIndirection, true, BoxedNodeBuilder<Payload>> folder{
+            BoxedNodeBuilder<Payload>{}
+        };
+        auto statements = folder.copy(root.statements);
+
+        if constexpr (SlotResolved<Payload>) {
+            SlotResolver<Payload, UniquePtrIndirection, true> resolver;
+            for (auto& stmt : statements)
+                utils::visit(resolver, stmt);
+        }
+
+        Interpreter<Payload, UniquePtrIndirection, true> interpreter{clock_id};
+        auto [run_ms, n_allocations] = time_muted([&] {
+            for (auto& stmt : statements)
+                utils::visit(interpreter, stmt);
+        });
+        std::cout << "tree<" << demangle(typeid(Payload).name()) << ">\n";
+        std::cout << "  run:         " << run_ms << "\n";
+        std::cout << "  allocations: " << n_allocations << std::endl;
+
+        if constexpr (SlotResolved<Payload>) {
+            Interpreter<Payload, UniquePtrIndirection, true> quickened{clock_id};
+            quickened.enableQuickening();
+            auto [quickened_ms, quickened_allocations] = time_muted([&] {
+                for (auto& stmt : statements)
+                    utils::visit(quickened, stmt);
+            });
+            std::cout << "tree<" << demangle(typeid(Payload).name()) << "> quickened\n";
+            std::cout << "  run:         " << quickened_ms << "\n";
+            std::cout << "  allocations: " << quickened_allocations << std::endl;
+        }
+    });
+
+    {
+        Parser<generic_stream<std::vector, Token>, BoxedNodeBuilder<SlotPayload>> parser(token_stream);
+        auto root = parser.parse();
+        token_stream.reset();
+
+        ConstantFolder<SlotPayload, UniquePtrIndirection, true, BoxedNodeBuilder<SlotPayload>> folder{
+            BoxedNodeBuilder<SlotPayload>{}
+        };
+        auto statements = folder.copy(root.statements);
+
+        SlotResolver<SlotPayload, UniquePtrIndirection, true> resolver;
+        for (auto& stmt : statements)
+            utils::visit(resolver, stmt);
+
+        Compiler<SlotPayload, UniquePtrIndirection, true> compiler;
+        auto t1 = high_resolution_clock::now();
+        const Chunk& script = compiler.compile(statements);
+        auto t2 = high_resolution_clock::now();
+
+        VM vm{clock_id};
+        auto [run_ms, n_allocations] = time_muted([&] { vm.run(script); });
+        std::cout << "vm\n";
+        std::cout << "  compile:     " << duration<double, std::milli>(t2 - t1).count() << "\n";
+        std::cout << "  run:         " << run_ms << "\n";
+        std::cout << "  allocations: " << n_allocations << std::endl;
+    }
+
     size_t buf_size = 1;
     if (argc > 3)
         buf_size = std::stoull(argv[3]);
@@ -1,6 +1,6 @@
 import lexer;
 import ast;
-#include <fstream>
+import utils.source;
 #include <iostream>
 
 using namespace loxxy;
@@ -13,15 +13,11 @@ struct printing_stream {
 };
 
 auto main(int argc, const char** argv) -> int {
-    std::ifstream file;
-    if (argc < 2) {
-        file.open("/dev/stdin");
-    } else {
-        file.open(argv[1]);
-        if (file.fail()) {
-            std::cout << "File not found:\n" << argv[1] << std::endl;
-            return 1;
-        }
+    const char* path = argc < 2 ? "/dev/stdin" : argv[1];
+    utils::mapped_source file(path);
+    if (file.fail()) {
+        std::cout << "File not found:\n" << path << std::endl;
+        return 1;
     }
 
     Loxxer lexer(std::move(file), printing_stream{});
@@ -1,10 +1,14 @@
 #include <chrono>
+#include <concepts>
 #include <fstream>
 #include <iostream>
 #include <span>
+#include <stdexcept>
+#include <string_view>
 #include <thread>
 
 import utils.tqstream;
+import utils.source;
 import utils.stupid_type_traits;
 import utils.string_store;
 import utils.variant;
@@ -12,23 +16,140 @@ import parser.rd;
 import lexer;
 import ast;
 import ast.boxed_node_builder;
+import ast.folder;
 import ast.printer;
+import ast.profiler;
+import ast.resolver;
 import ast.interpreter;
+import ast.llvm;
+import ast.tiering;
+import ast.compiler;
+import vm;
 
 using namespace loxxy;
 using namespace utils;
 
+enum class Backend { tree, vm };
+
+using Folder = ConstantFolder<SlotPayload, UniquePtrIndirection, true, BoxedNodeBuilder<SlotPayload>>;
+using Jit = TieredJit<SlotPayload, UniquePtrIndirection, true>;
+
+template <typename Profiler>
+void writeProfile(Profiler& profiler, const char* profile_path) {
+    if constexpr (!std::same_as<Profiler, NoProfiler>) {
+        profiler.finish();
+        profiler.report(std::cerr);
+
+        std::ofstream folded(profile_path);
+        profiler.writeFoldedStacks(folded);
+    }
+}
+
+template <typename Profiler = NoProfiler, typename Tier = NoTier, typename Parser>
+void interpret(
+    Parser& parser, bool repl, bool quicken, const persistent_string<>* clock_id, const char* profile_path,
+    PerfSupport perf = {}
+) {
+    Folder folder{BoxedNodeBuilder<SlotPayload>{}};
+    SlotResolver<SlotPayload, UniquePtrIndirection, true> resolver;
+    // outlives the interpreter, whose tier may still be compiling a function of it
+    std::vector<StmtPointer<SlotPayload, UniquePtrIndirection, true>> stmts;
+    Interpreter<SlotPayload, UniquePtrIndirection, true, void, Profiler, Tier> interpreter{clock_id};
+    if (quicken)
+        interpreter.enableQuickening();
+    if constexpr (!std::same_as<Tier, NoTier>) {
+        try {
+            interpreter.getTier().setPerfSupport(perf);
+        } catch (const std::runtime_error& e) {
+            std::cerr << e.what() << std::endl;
+            return;
+        }
+    }
+
+    try {
+        while (true) {
+            auto root = repl ? parser.parseRepl() : parser.parse();
+            if (root.statements.size() == 0)
+                break;
+            for (const auto& parsed : root.statements) {
+                auto stmt = folder.copy(parsed);
+                utils::visit(resolver, stmt);
+                utils::visit(interpreter, stmt);
+                stmts.push_back(std::move(stmt));
+            }
+        }
+    } catch (...) {
+        // the profile up to a runtime error is written all the same
+        writeProfile(interpreter.getProfiler(), profile_path);
+        throw;
+    }
+
+    writeProfile(interpreter.getProfiler(), profile_path);
+}
+
+template <typename Parser>
+void execute(Parser& parser, bool repl, const persistent_string<>* clock_id) {
+    Folder folder{BoxedNodeBuilder<SlotPayload>{}};
+    SlotResolver<SlotPayload, UniquePtrIndirection, true> resolver;
+    Compiler<SlotPayload, UniquePtrIndirection, true> compiler;
+    VM vm{clock_id};
+
+    while (true) {
+        auto root = repl ? parser.parseRepl() : parser.parse();
+        if (root.statements.size() == 0)
+            break;
+        auto statements = folder.copy(root.statements);
+        for (auto& stmt : statements)
+            utils::visit(resolver, stmt);
+
+        vm.run(compiler.compile(statements));
+    }
+}
+
 auto main(int argc, const char** argv) -> int {
-    std::ifstream file;
     bool (*flushCondition)(const Token& t);
 
-    if (argc < 2) {
-        file.open("/dev/stdin");
+    Backend backend = Backend::tree;
+    bool quicken = false;
+    bool jit = false;
+    // tells perf the names of the functions the JIT compiles
+    PerfSupport perf;
+    const char* profile_path = nullptr;
+    const char* path = nullptr;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if (arg == "--backend=tree")
+            backend = Backend::tree;
+        else if (arg == "--backend=vm")
+            backend = Backend::vm;
+        else if (arg == "--quicken")
+            quicken = true;
+        else if (arg == "--jit")
+            jit = true;
+        else if (arg == "--perf-map")
+            perf.map = true;
+        else if (arg == "--jitdump")
+            perf.jitdump = true;
+        else if (arg.starts_with("--profile="))
+            profile_path = argv[i] + std::string_view("--profile=").size();
+        else if (arg.starts_with("--")) {
+            std::cout << "Unknown option:\n"
+                      << arg
+                      << "\nusage: lox [--backend=vm|tree] [--quicken] [--jit [--perf-map] [--jitdump]] "
+                         "[--profile=folded_stacks_file] [file]"
+                      << std::endl;
+            return 1;
+        } else
+            path = argv[i];
+    }
+    bool repl = path == nullptr;
+
+    mapped_source file(repl ? "/dev/stdin" : path);
+    if (repl)
         flushCondition = [](const Token& t) { return t.getType() == NEW_LINE; };
-    } else {
-        file.open(argv[1]);
+    else {
         if (file.fail()) {
-            std::cout << "File not found:\n" << argv[1] << std::endl;
+            std::cout << "File not found:\n" << path << std::endl;
             return 1;
         }
         flushCondition = [](const Token& t) { return false; };
@@ -39,10 +160,10 @@ auto main(int argc, const char** argv) -> int {
     Loxxer lexer(std::move(file), token_stream);
     const persistent_string<>* clock_id = lexer.addBuiltin("clock");
 
-    Parser parser(token_stream, BoxedNodeBuilder<>{});
+    Parser parser(token_stream, BoxedNodeBuilder<SlotPayload>{});
 
-    std::thread lex_thread([&lexer, &token_stream, argc]() {
-        if (argc < 2)
+    std::thread lex_thread([&lexer, &token_stream, repl]() {
+        if (repl)
             lexer.scanTokensLine();
         else
             lexer.scanTokens();
@@ -50,19 +171,17 @@ auto main(int argc, const char** argv) -> int {
         token_stream.flush();
     });
 
-    std::thread parse_thread([&parser, argc, clock_id]() {
-        Interpreter<empty, UniquePtrIndirection, true> interpreter{clock_id};
-
-        std::vector<StmtPointer<empty, UniquePtrIndirection, true>> stmts;
-        while (true) {
-            auto root = argc < 2 ? parser.parseRepl() : parser.parse();
-            if (root.statements.size() == 0)
-                break;
-            for (auto& stmt : root.statements) {
-                utils::visit(interpreter, stmt);
-                stmts.push_back(std::move(stmt));
-            }
-        }
+    std::thread parse_thread([&parser, repl, backend, quicken, jit, profile_path, clock_id, perf]() {
+        if (backend == Backend::vm)
+            execute(parser, repl, clock_id);
+        else if (profile_path != nullptr && jit)
+            interpret<CallProfiler, Jit>(parser, repl, quicken, clock_id, profile_path, perf);
+        else if (profile_path != nullptr)
+            interpret<CallProfiler>(parser, repl, quicken, clock_id, profile_path);
+        else if (jit)
+            interpret<NoProfiler, Jit>(parser, repl, quicken, clock_id, profile_path, perf);
+        else
+            interpret(parser, repl, quicken, clock_id, profile_path);
     });
     lex_thread.join();
     parse_thread.join();
@@ -1,10 +1,24 @@
+#include "llvm/Passes/OptimizationLevel.h"
+
 #include <chrono>
-#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
 #include <iostream>
+#include <optional>
 #include <span>
+#include <spawn.h>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/wait.h>
 #include <thread>
+#include <vector>
 
 import utils.tqstream;
+import utils.source;
 import utils.stupid_type_traits;
 import utils.string_store;
 import utils.variant;
@@ -13,23 +27,141 @@ import parser.rd;
 import lexer;
 import ast;
 import ast.boxed_node_builder;
+import ast.folder;
 import ast.printer;
 import ast.llvm;
 
 using namespace loxxy;
 using namespace utils;
 
+extern char** environ;
+
+enum class Output { ir, jit, object, executable };
+
+using Clock = std::chrono::steady_clock;
+
+auto milliseconds(Clock::duration duration) -> double {
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+auto optimizationLevel(std::string_view flag) -> std::optional<llvm::OptimizationLevel> {
+    if (flag == "-O0")
+        return llvm::OptimizationLevel::O0;
+    if (flag == "-O1")
+        return llvm::OptimizationLevel::O1;
+    if (flag == "-O2")
+        return llvm::OptimizationLevel::O2;
+    if (flag == "-O3")
+        return llvm::OptimizationLevel::O3;
+    return std::nullopt;
+}
+
+// links an object file with the runtime library into a static executable, through the C++ compiler driver in $CXX.
+// Like make, $CXX is split into words on whitespace, so it can hold a launcher or flags, as in `ccache c++`, but no
+// quoted words.
+void link(const std::string& object, const std::string& executable) {
+    const char* driver = std::getenv("CXX");
+    std::vector<std::string> args;
+    std::istringstream words(driver != nullptr ? driver : "");
+    for (std::string word; words >> word;)
+        args.push_back(word);
+    if (args.empty())
+        args.emplace_back("c++");
+    std::string linker = args.front();
+    args.insert(args.end(), {"-static", object, LOXXY_RUNTIME_LIBRARY, "-o", executable});
+
+    std::vector<char*> argv;
+    for (std::string& arg : args)
+        argv.push_back(arg.data());
+    argv.push_back(nullptr);
+
+    pid_t pid;
+    int status;
+    if (posix_spawnp(&pid, linker.c_str(), nullptr, nullptr, argv.data(), environ) != 0)
+        throw std::runtime_error("could not run " + linker);
+    if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        throw std::runtime_error("linking " + executable + " failed");
+}
+
+// where compiled functions are kept between runs, by default in the cache directory of the user
+auto defaultCacheDirectory() -> std::optional<std::filesystem::path> {
+    if (const char* cache = std::getenv("XDG_CACHE_HOME"); cache != nullptr && *cache != '\0')
+        return std::filesystem::path(cache) / "loxxy";
+    if (const char* home = std::getenv("HOME"); home != nullptr && *home != '\0')
+        return std::filesystem::path(home) / ".cache" / "loxxy";
+    return std::nullopt;
+}
+
 auto main(int argc, const char** argv) -> int {
-    std::ifstream file;
     bool (*flushCondition)(const Token& t);
 
-    if (argc < 2) {
-        file.open("/dev/stdin");
+    Output output = Output::ir;
+    std::string output_path;
+    llvm::OptimizationLevel level = llvm::OptimizationLevel::O2;
+    // prints how long optimizing and generating native code took, to weigh the levels against each other
+    bool time = false;
+    // threads generating the functions of the program, with none the parse thread generates them
+    unsigned jobs = std::thread::hardware_concurrency();
+    // threads lexing a file, a chunk of it each
+    unsigned lex_jobs = 1;
+    std::optional<std::filesystem::path> cache_directory = defaultCacheDirectory();
+    // tells perf the names of the functions the JIT compiles
+    PerfSupport perf;
+    const char* path = nullptr;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if (std::optional<llvm::OptimizationLevel> flag = optimizationLevel(arg); flag.has_value())
+            level = flag.value();
+        else if (arg == "--time")
+            time = true;
+        else if (arg.starts_with("--jobs="))
+            jobs = std::stoul(std::string(arg.substr(std::string_view("--jobs=").size())));
+        else if (arg.starts_with("--lex-jobs="))
+            lex_jobs = std::stoul(std::string(arg.substr(std::string_view("--lex-jobs=").size())));
+        else if (arg.starts_with("--cache-dir="))
+            cache_directory = arg.substr(std::string_view("--cache-dir=").size());
+        else if (arg == "--no-cache")
+            cache_directory = std::nullopt;
+        else if (arg == "--jit")
+            output = Output::jit;
+        else if (arg == "--perf-map")
+            perf.map = true;
+        else if (arg == "--jitdump")
+            perf.jitdump = true;
+        else if (arg.starts_with("--emit-obj=")) {
+            output = Output::object;
+            output_path = arg.substr(std::string_view("--emit-obj=").size());
+        } else if (arg.starts_with("--emit-exe=")) {
+            output = Output::executable;
+            output_path = arg.substr(std::string_view("--emit-exe=").size());
+        } else if (arg.starts_with("-")) {
+            std::cout << "Unknown option:\n"
+                      << arg
+                      << "\nusage: loxc [-O0 | -O1 | -O2 | -O3] [--jobs=threads] [--lex-jobs=threads] "
+                         "[--cache-dir=directory | --no-cache] [--time] "
+                         "[--jit [--perf-map] [--jitdump] | --emit-obj=object_file | --emit-exe=executable] [file]"
+                      << std::endl;
+            return 1;
+        } else
+            path = argv[i];
+    }
+    bool repl = path == nullptr;
+
+    std::unique_ptr<CodeCache> cache;
+    if (cache_directory.has_value()) {
+        try {
+            cache = std::make_unique<CodeCache>(cache_directory.value());
+        } catch (const std::filesystem::filesystem_error& e) {
+            std::cerr << "not caching compiled functions: " << e.what() << std::endl;
+        }
+    }
+
+    mapped_source file(repl ? "/dev/stdin" : path);
+    if (repl)
         flushCondition = [](const Token& t) { return t.getType() == NEW_LINE; };
-    } else {
-        file.open(argv[1]);
+    else {
         if (file.fail()) {
-            std::cout << "File not found:\n" << argv[1] << std::endl;
+            std::cout << "File not found:\n" << path << std::endl;
             return 1;
         }
         flushCondition = [](const Token& t) { return false; };
@@ -37,12 +169,19 @@ auto main(int argc, const char** argv) -> int {
 
     tqstream<Token> token_stream(512, 64, flushCondition);
 
+    // the REPL and pipes are lexed as they come
+    std::optional<ParallelLoxxer<tqstream<Token>&>> parallel_lexer;
+    if (!repl && lex_jobs > 1 && file.in_memory())
+        parallel_lexer.emplace(file.contents(), token_stream, lex_jobs);
+
     Loxxer lexer(std::move(file), token_stream);
 
     Parser parser(token_stream, BoxedNodeBuilder<>{});
 
-    std::thread lex_thread([&lexer, &token_stream, argc]() {
-        if (argc < 2)
+    std::thread lex_thread([&lexer, &parallel_lexer, &token_stream, repl]() {
+        if (parallel_lexer.has_value())
+            parallel_lexer->scanTokens();
+        else if (repl)
             lexer.scanTokensLine();
         else
             lexer.scanTokens();
@@ -50,19 +189,71 @@ auto main(int argc, const char** argv) -> int {
         token_stream.flush();
     });
 
-    std::thread parse_thread([&parser, argc]() {
+    // the JIT runs the program once all of it is parsed, in the REPL too
+    std::thread parse_thread([&parser, repl, output, &output_path, level, time, jobs, &cache, perf, path]() {
+        ConstantFolder<empty, UniquePtrIndirection, true, BoxedNodeBuilder<>> folder{BoxedNodeBuilder<>{}};
+        // outlives the generator, whose threads read the functions
+        std::vector<StmtPointer<empty, UniquePtrIndirection, true>> stmts;
         IRGenerator<empty, UniquePtrIndirection, true> ir_gen;
+        // object files may run on other machines than this one, the units are generated for the same target
+        if (output == Output::object || output == Output::executable)
+            ir_gen.setTarget(CodeTarget::generic);
+        ir_gen.setSourcePath(repl ? "<stdin>" : path);
+        ir_gen.parallelize(jobs, level, cache.get());
+
+        Clock::time_point start = Clock::now();
+        try {
+            while (true) {
+                auto root = repl ? parser.parseRepl() : parser.parse();
+                if (root.statements.size() == 0)
+                    break;
+                for (const auto& parsed : root.statements) {
+                    auto stmt = folder.copy(parsed);
+                    utils::visit(ir_gen, stmt);
+                    stmts.push_back(std::move(stmt));
+                }
+            }
+
+            ir_gen.finish();
+            if (output == Output::executable)
+                ir_gen.addMain();
 
-        while (true) {
-            auto root = argc < 2 ? parser.parseRepl() : parser.parse();
-            if (root.statements.size() == 0)
+            Clock::time_point t0 = Clock::now();
+            ir_gen.optimize(level);
+            Clock::time_point t1 = Clock::now();
+
+            switch (output) {
+            case Output::ir:
+                ir_gen.printIR();
+                break;
+            case Output::jit:
+                ir_gen.run(perf);
+                break;
+            case Output::object:
+                ir_gen.emitObject(output_path);
+                break;
+            case Output::executable: {
+                std::string object = output_path + ".o";
+                ir_gen.emitObject(object);
+                link(object, output_path);
+                std::remove(object.c_str());
                 break;
-            for (auto& stmt : root.statements) {
-                utils::visit(ir_gen, stmt);
             }
-        }
+            }
+            Clock::time_point t2 = Clock::now();
 
-        ir_gen.printIR();
+            if (time) {
+                std::cerr << "parse and generate: " << milliseconds(t0 - start) << " ms\n";
+                if (cache != nullptr)
+                    std::cerr << "cache: " << cache->getHits() << " hits, " << cache->getMisses() << " misses\n";
+                std::cerr << "optimize -O" << level.getSpeedupLevel() << ": " << milliseconds(t1 - t0) << " ms\n";
+                if (output == Output::object || output == Output::executable)
+                    std::cerr << "codegen: " << milliseconds(t2 - t1) << " ms\n";
+                std::cerr << std::flush;
+            }
+        } catch (const std::runtime_error& e) {
+            std::cerr << e.what() << std::endl;
+        }
     });
     lex_thread.join();
     parse_thread.join();
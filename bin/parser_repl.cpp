@@ -1,11 +1,11 @@
 #include <cstring>
-#include <fstream>
 #include <iostream>
 #include <thread>
 #include <utility>
 #include <vector>
 
 import utils.tqstream;
+import utils.source;
 import utils.stupid_type_traits;
 import parser.rd;
 import lexer;
@@ -35,16 +35,13 @@ auto main(int argc, const char** argv) -> int {
         filename = argv[i];
     }
 
-    std::ifstream file;
+    if (filename == nullptr)
+        filename = "/dev/stdin";
 
-    if (filename == nullptr) {
-        file.open("/dev/stdin");
-    } else {
-        file.open(filename);
-        if (file.fail()) {
-            std::cout << "File not found:\n" << filename << std::endl;
-            return 1;
-        }
+    mapped_source file(filename);
+    if (file.fail()) {
+        std::cout << "File not found:\n" << filename << std::endl;
+        return 1;
     }
 
     tqstream<Token> token_stream(512, 64, [](const Token& t) { return t.getType() == NEW_LINE; });
@@ -29,7 +29,8 @@ struct OffsetBuilder {
 
     using Resolver = multi_vector<
         BinaryExpr, UnaryExpr, GroupingExpr, StringExpr, NumberExpr, BoolExpr, NilExpr, VarExpr, AssignExpr, CallExpr,
-        PrintStmt, ExpressionStmt, VarDecl, FunDecl, BlockStmt, IfStmt, WhileStmt, ReturnStmt>;
+        GetExpr, SetExpr, ThisExpr, SuperExpr, PrintStmt, ExpressionStmt, VarDecl, FunDecl, BlockStmt, IfStmt, WhileStmt,
+        ReturnStmt, ClassDecl>;
 
     template <typename... Args>
     OffsetBuilder(Args&&... args) : payload_builder(std::forward<Args>(args)...) {}
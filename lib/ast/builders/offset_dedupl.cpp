@@ -46,7 +46,8 @@ struct OffsetDeduplBuilder {
 
     using Resolver = multi_vector<
         BinaryExpr, UnaryExpr, GroupingExpr, StringExpr, NumberExpr, BoolExpr, NilExpr, VarExpr, AssignExpr, CallExpr,
-        PrintStmt, ExpressionStmt, VarDecl, FunDecl, BlockStmt, IfStmt, WhileStmt, ReturnStmt>;
+        GetExpr, SetExpr, ThisExpr, SuperExpr, PrintStmt, ExpressionStmt, VarDecl, FunDecl, BlockStmt, IfStmt, WhileStmt,
+        ReturnStmt, ClassDecl>;
 
     using Builder = HashPayloadBuilder<Indirection, ptr_variant, Resolver>;
 
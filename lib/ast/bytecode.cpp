@@ -0,0 +1,91 @@
+module;
+#include "loxxy/opcodes.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+export module ast.bytecode;
+import ast;
+import utils.string_store;
+
+using utils::persistent_string;
+
+export namespace loxxy {
+
+enum class OpCode : uint8_t {
+#define X(name, operands, effect) name,
+    LOXXY_OPCODES(X)
+#undef X
+};
+
+constexpr std::array opcode_names{
+#define X(name, operands, effect) std::string_view(#name),
+    LOXXY_OPCODES(X)
+#undef X
+};
+
+constexpr std::array<uint8_t, opcode_names.size()> opcode_operands{
+#define X(name, operands, effect) operands,
+    LOXXY_OPCODES(X)
+#undef X
+};
+
+constexpr std::array<int8_t, opcode_names.size()> opcode_stack_effects{
+#define X(name, operands, effect) effect,
+    LOXXY_OPCODES(X)
+#undef X
+};
+
+using Operand = uint32_t;
+
+// A compiled function body. Instructions are a one byte opcode followed by its operands, which are stored unaligned.
+struct Chunk {
+    const persistent_string<>* name = nullptr;
+    std::vector<const persistent_string<>*> arg_names;
+    // number of slots of the frame, including the arguments
+    uint32_t frame_size = 0;
+    // maximum number of temporaries the function keeps on top of its frame
+    uint32_t max_stack = 0;
+
+    std::vector<uint8_t> code;
+    std::vector<Value> constants;
+    // identifiers of the globals the chunk refers to, by their id
+    std::vector<const persistent_string<>*> names;
+    std::vector<const Chunk*> functions;
+
+    // what function values created from this chunk refer to, its body points back to the chunk
+    FunctionDescriptor descriptor;
+};
+
+inline auto read_operand(const uint8_t* at) -> Operand {
+    Operand operand;
+    std::memcpy(&operand, at, sizeof(Operand));
+    return operand;
+}
+
+inline void write_operand(uint8_t* at, Operand operand) { std::memcpy(at, &operand, sizeof(Operand)); }
+
+void disassemble(std::ostream& ostream, const Chunk& chunk) {
+    ostream << "== " << (chunk.name == nullptr ? std::string_view("<script>") : std::string_view(*chunk.name))
+            << " ==\n";
+    for (size_t offset = 0; offset < chunk.code.size();) {
+        auto op = chunk.code[offset];
+        ostream << std::setw(6) << offset << ' ' << opcode_names[op];
+        offset++;
+        for (uint8_t i = 0; i < opcode_operands[op]; i++, offset += sizeof(Operand))
+            ostream << ' ' << read_operand(&chunk.code[offset]);
+
+        ostream << '\n';
+    }
+
+    for (const Chunk* function : chunk.functions)
+        disassemble(ostream, *function);
+}
+
+} // namespace loxxy
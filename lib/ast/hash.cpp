@@ -90,6 +90,14 @@ template <typename Payload, typename Indirection, bool ptr_variant>
 struct HashSeedImpl<AssignExpr<Payload, Indirection, ptr_variant>> : constant<0x5338a440b01371e1> {};
 template <typename Payload, typename Indirection, bool ptr_variant>
 struct HashSeedImpl<CallExpr<Payload, Indirection, ptr_variant>> : constant<0x219321066ff025b2> {};
+template <typename Payload, typename Indirection, bool ptr_variant>
+struct HashSeedImpl<GetExpr<Payload, Indirection, ptr_variant>> : constant<0x80b638fc880e8b96> {};
+template <typename Payload, typename Indirection, bool ptr_variant>
+struct HashSeedImpl<SetExpr<Payload, Indirection, ptr_variant>> : constant<0xc3b2175aab3a5a98> {};
+template <typename Payload, typename Indirection, bool ptr_variant>
+struct HashSeedImpl<ThisExpr<Payload, Indirection, ptr_variant>> : constant<0x1bdbde632013da01> {};
+template <typename Payload, typename Indirection, bool ptr_variant>
+struct HashSeedImpl<SuperExpr<Payload, Indirection, ptr_variant>> : constant<0x8c37d9c4f7e0eb43> {};
 
 template <typename Payload, typename Indirection, bool ptr_variant>
 struct HashSeedImpl<PrintStmt<Payload, Indirection, ptr_variant>> : constant<0x71e036f691c86a45> {};
@@ -107,6 +115,8 @@ template <typename Payload, typename Indirection, bool ptr_variant>
 struct HashSeedImpl<WhileStmt<Payload, Indirection, ptr_variant>> : constant<0x7d493bf5efc2588b> {};
 template <typename Payload, typename Indirection, bool ptr_variant>
 struct HashSeedImpl<ReturnStmt<Payload, Indirection, ptr_variant>> : constant<0x8fcc111160a8cd3a> {};
+template <typename Payload, typename Indirection, bool ptr_variant>
+struct HashSeedImpl<ClassDecl<Payload, Indirection, ptr_variant>> : constant<0x8dfcce11e9558c5a> {};
 
 // template <typename Payload, typename Indirection, bool ptr_variant>
 // struct HashSeedImpl<NilExpr<Payload, Indirection, ptr_variant>> : constant<0x80b638fc880e8b96> {};
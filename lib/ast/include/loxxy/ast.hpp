@@ -13,6 +13,10 @@
     using VarExpr = VarExpr<Payload, Indirection, ptr_variant>;                                                        \
     using AssignExpr = AssignExpr<Payload, Indirection, ptr_variant>;                                                  \
     using CallExpr = CallExpr<Payload, Indirection, ptr_variant>;                                                      \
+    using GetExpr = GetExpr<Payload, Indirection, ptr_variant>;                                                        \
+    using SetExpr = SetExpr<Payload, Indirection, ptr_variant>;                                                        \
+    using ThisExpr = ThisExpr<Payload, Indirection, ptr_variant>;                                                      \
+    using SuperExpr = SuperExpr<Payload, Indirection, ptr_variant>;                                                    \
     using PrintStmt = PrintStmt<Payload, Indirection, ptr_variant>;                                                    \
     using ExpressionStmt = ExpressionStmt<Payload, Indirection, ptr_variant>;                                          \
     using VarDecl = VarDecl<Payload, Indirection, ptr_variant>;                                                        \
@@ -21,4 +25,5 @@
     using IfStmt = IfStmt<Payload, Indirection, ptr_variant>;                                                          \
     using WhileStmt = WhileStmt<Payload, Indirection, ptr_variant>;                                                    \
     using ReturnStmt = ReturnStmt<Payload, Indirection, ptr_variant>;                                                  \
+    using ClassDecl = ClassDecl<Payload, Indirection, ptr_variant>;                                                    \
     using TURoot = TURoot<Payload, Indirection, ptr_variant>
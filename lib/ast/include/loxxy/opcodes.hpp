@@ -0,0 +1,38 @@
+#pragma once
+
+// X(name, number of 32 bit operands, stack effect)
+// The order is shared by the OpCode enum and the dispatch table of the VM.
+#define LOXXY_OPCODES(X)                                                                                               \
+    X(CONSTANT, 1, 1)                                                                                                  \
+    X(NIL, 0, 1)                                                                                                       \
+    X(TRUE, 0, 1)                                                                                                      \
+    X(FALSE, 0, 1)                                                                                                     \
+    X(POP, 0, -1)                                                                                                      \
+    X(GET_LOCAL, 1, 1)                                                                                                 \
+    X(SET_LOCAL, 1, 0)                                                                                                 \
+    X(DEFINE_LOCAL, 1, -1)                                                                                             \
+    X(GET_OUTER, 2, 1)                                                                                                 \
+    X(SET_OUTER, 2, 0)                                                                                                 \
+    X(GET_GLOBAL, 1, 1)                                                                                                \
+    X(SET_GLOBAL, 1, 0)                                                                                                \
+    X(DEFINE_GLOBAL, 1, -1)                                                                                            \
+    X(EQUAL, 0, -1)                                                                                                    \
+    X(NOT_EQUAL, 0, -1)                                                                                                \
+    X(GREATER, 0, -1)                                                                                                  \
+    X(GREATER_EQUAL, 0, -1)                                                                                            \
+    X(LESS, 0, -1)                                                                                                     \
+    X(LESS_EQUAL, 0, -1)                                                                                               \
+    X(ADD, 0, -1)                                                                                                      \
+    X(SUBTRACT, 0, -1)                                                                                                 \
+    X(MULTIPLY, 0, -1)                                                                                                 \
+    X(DIVIDE, 0, -1)                                                                                                   \
+    X(NOT, 0, 0)                                                                                                       \
+    X(NEGATE, 0, 0)                                                                                                    \
+    X(TRUTHY, 0, 0)                                                                                                    \
+    X(PRINT, 0, -1)                                                                                                    \
+    X(JUMP, 1, 0)                                                                                                      \
+    X(JUMP_IF_FALSE, 1, -1)                                                                                            \
+    X(JUMP_IF_TRUE, 1, -1)                                                                                             \
+    X(CLOSURE, 1, 1)                                                                                                   \
+    X(CALL, 1, 0)                                                                                                      \
+    X(RETURN, 0, -1)
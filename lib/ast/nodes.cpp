@@ -52,6 +52,14 @@ template <typename Payload = empty, typename Indirection = UniquePtrIndirection,
 struct AssignExpr;
 template <typename Payload = empty, typename Indirection = UniquePtrIndirection, bool ptr_variant = true>
 struct CallExpr;
+template <typename Payload = empty, typename Indirection = UniquePtrIndirection, bool ptr_variant = true>
+struct GetExpr;
+template <typename Payload = empty, typename Indirection = UniquePtrIndirection, bool ptr_variant = true>
+struct SetExpr;
+template <typename Payload = empty, typename Indirection = UniquePtrIndirection, bool ptr_variant = true>
+struct ThisExpr;
+template <typename Payload = empty, typename Indirection = UniquePtrIndirection, bool ptr_variant = true>
+struct SuperExpr;
 
 template <typename Payload = empty, typename Indirection = UniquePtrIndirection, bool ptr_variant = true>
 struct BlockStmt;
@@ -69,6 +77,8 @@ template <typename Payload = empty, typename Indirection = UniquePtrIndirection,
 struct VarDecl;
 template <typename Payload = empty, typename Indirection = UniquePtrIndirection, bool ptr_variant = true>
 struct ReturnStmt;
+template <typename Payload = empty, typename Indirection = UniquePtrIndirection, bool ptr_variant = true>
+struct ClassDecl;
 
 template <typename Payload = empty, typename Indirection = UniquePtrIndirection, bool ptr_variant = true>
 using Expression = variant<
@@ -76,14 +86,17 @@ using Expression = variant<
     GroupingExpr<Payload, Indirection, ptr_variant>, NumberExpr<Payload, Indirection, ptr_variant>,
     StringExpr<Payload, Indirection, ptr_variant>, BoolExpr<Payload, Indirection, ptr_variant>,
     NilExpr<Payload, Indirection, ptr_variant>, VarExpr<Payload, Indirection, ptr_variant>,
-    AssignExpr<Payload, Indirection, ptr_variant>, CallExpr<Payload, Indirection, ptr_variant>>;
+    AssignExpr<Payload, Indirection, ptr_variant>, CallExpr<Payload, Indirection, ptr_variant>,
+    GetExpr<Payload, Indirection, ptr_variant>, SetExpr<Payload, Indirection, ptr_variant>,
+    ThisExpr<Payload, Indirection, ptr_variant>, SuperExpr<Payload, Indirection, ptr_variant>>;
 
 template <typename Payload = empty, typename Indirection = UniquePtrIndirection, bool ptr_variant = true>
 using Statement = variant<
     ExpressionStmt<Payload, Indirection, ptr_variant>, PrintStmt<Payload, Indirection, ptr_variant>,
     VarDecl<Payload, Indirection, ptr_variant>, BlockStmt<Payload, Indirection, ptr_variant>,
     IfStmt<Payload, Indirection, ptr_variant>, WhileStmt<Payload, Indirection, ptr_variant>,
-    FunDecl<Payload, Indirection, ptr_variant>, ReturnStmt<Payload, Indirection, ptr_variant>>;
+    FunDecl<Payload, Indirection, ptr_variant>, ReturnStmt<Payload, Indirection, ptr_variant>,
+    ClassDecl<Payload, Indirection, ptr_variant>>;
 
 template <typename Payload = empty, typename Indirection = UniquePtrIndirection, bool ptr_variant = true>
 class ExprPointer : public utils::WrappedVar<MapTypes<Expression<Payload, Indirection, ptr_variant>, Indirection>> {
@@ -181,6 +194,32 @@ struct CallExpr {
     ExprPointer<Payload, Indirection, ptr_variant> callee;
     std::vector<ExprPointer<Payload, Indirection, ptr_variant>> arguments;
 };
+
+template <typename Payload, typename Indirection, bool ptr_variant>
+struct GetExpr {
+    Payload payload;
+    ExprPointer<Payload, Indirection, ptr_variant> object;
+    const persistent_string<>* name;
+};
+
+template <typename Payload, typename Indirection, bool ptr_variant>
+struct SetExpr {
+    Payload payload;
+    ExprPointer<Payload, Indirection, ptr_variant> object;
+    const persistent_string<>* name;
+    ExprPointer<Payload, Indirection, ptr_variant> value;
+};
+
+template <typename Payload, typename Indirection, bool ptr_variant>
+struct ThisExpr {
+    Payload payload;
+};
+
+template <typename Payload, typename Indirection, bool ptr_variant>
+struct SuperExpr {
+    Payload payload;
+    const persistent_string<>* method;
+};
 template <typename Payload = empty, typename Indirection = UniquePtrIndirection, bool ptr_variant = true>
 struct ExpressionStmt {
     Payload payload;
@@ -209,6 +248,8 @@ struct FunDecl {
     const persistent_string<>* identifier;
     std::vector<const persistent_string<>*> args;
     std::vector<StmtPointer<Payload, Indirection, ptr_variant>> body;
+    // of the `fun` keyword, or of the name of a method, counting from 1 unlike the lines of tokens
+    int line;
 };
 template <typename Payload = empty, typename Indirection = UniquePtrIndirection, bool ptr_variant = true>
 struct IfStmt {
@@ -229,6 +270,15 @@ struct ReturnStmt {
     ExprPointer<Payload, Indirection, ptr_variant> expr;
 };
 
+template <typename Payload, typename Indirection, bool ptr_variant>
+struct ClassDecl {
+    Payload payload;
+    const persistent_string<>* identifier;
+    std::optional<ExprPointer<Payload, Indirection, ptr_variant>> superclass;
+    // FunDecls
+    std::vector<StmtPointer<Payload, Indirection, ptr_variant>> methods;
+};
+
 template <typename Payload = empty, typename Indirection = UniquePtrIndirection, bool ptr_variant = true>
 struct TURoot {
     std::vector<StmtPointer<Payload, Indirection, ptr_variant>> statements;
@@ -255,6 +305,10 @@ void print_family() {
     std::cout << "  VarExpr:        " << sizeof(typename Family::VarExpr) << std::endl;
     std::cout << "  AssignExpr:     " << sizeof(typename Family::AssignExpr) << std::endl;
     std::cout << "  CallExpr:       " << sizeof(typename Family::CallExpr) << std::endl;
+    std::cout << "  GetExpr:        " << sizeof(typename Family::GetExpr) << std::endl;
+    std::cout << "  SetExpr:        " << sizeof(typename Family::SetExpr) << std::endl;
+    std::cout << "  ThisExpr:       " << sizeof(typename Family::ThisExpr) << std::endl;
+    std::cout << "  SuperExpr:      " << sizeof(typename Family::SuperExpr) << std::endl;
 
     std::cout << "  PrintStmt:      " << sizeof(typename Family::PrintStmt) << std::endl;
     std::cout << "  ExpressionStmt: " << sizeof(typename Family::ExpressionStmt) << std::endl;
@@ -264,6 +318,7 @@ void print_family() {
     std::cout << "  IfStmt:         " << sizeof(typename Family::IfStmt) << std::endl;
     std::cout << "  WhileStmt:      " << sizeof(typename Family::WhileStmt) << std::endl;
     std::cout << "  ReturnStmt:     " << sizeof(typename Family::ReturnStmt) << std::endl;
+    std::cout << "  ClassDecl:      " << sizeof(typename Family::ClassDecl) << std::endl;
 }
 
 } // namespace loxxy
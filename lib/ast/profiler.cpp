@@ -0,0 +1,190 @@
+module;
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+export module ast.profiler;
+import ast;
+import utils.string_store;
+
+export namespace loxxy {
+
+// Profiler policy of the Interpreter that records nothing. Its hooks are empty inline functions, so an interpreter
+// built with it compiles to the same code as one without hooks.
+struct NoProfiler {
+    void enter(const FunctionDescriptor*) {}
+    void leave() {}
+};
+
+// Instrumenting profiler for the Interpreter. Calls are recorded in a calling context tree, which has a node for every
+// distinct stack of Lox functions seen, so entering a function is a search among the few children of the current node
+// and leaving it is a subtraction. Everything else is derived from the tree when reporting, after finish().
+class CallProfiler {
+    using Clock = std::chrono::steady_clock;
+
+public:
+    CallProfiler() : started(Clock::now()) {}
+    CallProfiler(const CallProfiler&) = delete;
+    auto operator=(const CallProfiler&) -> CallProfiler& = delete;
+
+    void enter(const FunctionDescriptor* function) {
+        Node* node = current->child(function, functions);
+        node->calls++;
+        node->stats->calls++;
+        node->stats->active++;
+
+        activations.push_back(Activation{node, Clock::now()});
+        current = node;
+    }
+
+    void leave() {
+        Clock::time_point now = Clock::now();
+        Activation activation = activations.back();
+        activations.pop_back();
+
+        Clock::duration inclusive = now - activation.start;
+        Clock::duration exclusive = inclusive - activation.children;
+        Node* node = activation.node;
+        node->exclusive += exclusive;
+        node->stats->exclusive += exclusive;
+        // a recursive function only counts the time of its outermost activation as inclusive
+        if (--node->stats->active == 0)
+            node->stats->inclusive += inclusive;
+
+        if (activations.empty())
+            top_level_children += inclusive;
+        else
+            activations.back().children += inclusive;
+        current = node->parent;
+    }
+
+    // closes the calls that are still running, like the ones a runtime error unwound
+    void finish() {
+        while (!activations.empty())
+            leave();
+        finished = Clock::now();
+    }
+
+    // per function call counts and times, and how often each function called each other one
+    void report(std::ostream& ostream) const {
+        std::vector<std::pair<const FunctionDescriptor*, const Stats*>> by_time;
+        for (const auto& [function, stats] : functions)
+            by_time.emplace_back(function, &stats);
+        std::ranges::sort(by_time, [](const auto& lhs, const auto& rhs) {
+            return lhs.second->exclusive > rhs.second->exclusive;
+        });
+
+        ostream << "       calls  inclusive ms  exclusive ms  function\n";
+        for (const auto& [function, stats] : by_time) {
+            ostream << std::setw(12) << stats->calls << std::setw(14) << milliseconds(stats->inclusive)
+                    << std::setw(14) << milliseconds(stats->exclusive) << "  " << name(function) << '\n';
+        }
+
+        Edges edges;
+        collectEdges(root, edges);
+        ostream << "\n       calls  caller -> callee\n";
+        for (const auto& [edge, calls] : edges)
+            ostream << std::setw(12) << calls << "  " << edge.first << " -> " << edge.second << '\n';
+        ostream << std::flush;
+    }
+
+    // one line per stack with the microseconds spent in its innermost function, the input format of flamegraph.pl
+    void writeFoldedStacks(std::ostream& ostream) const {
+        Clock::duration top_level = finished - started - top_level_children;
+        ostream << name(nullptr) << ' ' << microseconds(top_level) << '\n';
+
+        std::string stack{name(nullptr)};
+        for (const std::unique_ptr<Node>& child : root.children)
+            writeFolded(ostream, *child, stack);
+        ostream << std::flush;
+    }
+
+private:
+    struct Stats {
+        uint64_t calls = 0;
+        Clock::duration inclusive{};
+        Clock::duration exclusive{};
+        // activations currently on the stack
+        uint32_t active = 0;
+    };
+
+    struct Node {
+        const FunctionDescriptor* function;
+        Node* parent;
+        Stats* stats;
+        uint64_t calls = 0;
+        Clock::duration exclusive{};
+        std::vector<std::unique_ptr<Node>> children;
+
+        auto child(const FunctionDescriptor* callee, std::unordered_map<const FunctionDescriptor*, Stats>& functions)
+            -> Node* {
+            for (const std::unique_ptr<Node>& node : children) {
+                if (node->function == callee)
+                    return node.get();
+            }
+
+            return children.emplace_back(new Node{callee, this, &functions[callee]}).get();
+        }
+    };
+
+    // calls from caller to callee, by name
+    using Edges = std::map<std::pair<std::string_view, std::string_view>, uint64_t>;
+
+    struct Activation {
+        Node* node;
+        Clock::time_point start;
+        // inclusive time of the calls made from this one
+        Clock::duration children{};
+    };
+
+    static auto name(const FunctionDescriptor* function) -> std::string_view {
+        if (function == nullptr)
+            return "<script>";
+        return std::string_view(*function->name);
+    }
+
+    static auto milliseconds(Clock::duration duration) -> double {
+        return std::chrono::duration<double, std::milli>(duration).count();
+    }
+
+    static auto microseconds(Clock::duration duration) -> int64_t {
+        return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+    }
+
+    static void collectEdges(const Node& node, Edges& edges) {
+        for (const std::unique_ptr<Node>& child : node.children) {
+            edges[{name(node.function), name(child->function)}] += child->calls;
+            collectEdges(*child, edges);
+        }
+    }
+
+    static void writeFolded(std::ostream& ostream, const Node& node, std::string& stack) {
+        size_t length = stack.size();
+        stack.push_back(';');
+        stack.append(name(node.function));
+        ostream << stack << ' ' << microseconds(node.exclusive) << '\n';
+
+        for (const std::unique_ptr<Node>& child : node.children)
+            writeFolded(ostream, *child, stack);
+        stack.resize(length);
+    }
+
+    Node root{nullptr, nullptr, nullptr};
+    Node* current = &root;
+    std::vector<Activation> activations;
+    std::unordered_map<const FunctionDescriptor*, Stats> functions;
+    Clock::time_point started;
+    Clock::time_point finished;
+    Clock::duration top_level_children{};
+};
+
+} // namespace loxxy
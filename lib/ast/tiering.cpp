@@ -0,0 +1,421 @@
+module;
+#include "loxxy/ast.hpp"
+#include "llvm/ExecutionEngine/JITEventListener.h"
+#include "llvm/ExecutionEngine/Orc/Core.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Error.h"
+
+#include <atomic>
+#include <bit>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+export module ast.tiering;
+import ast;
+import ast.llvm;
+import ast.resolver;
+import runtime;
+import utils.stupid_type_traits;
+import utils.string_store;
+import utils.variant;
+
+using utils::IndirectVisitor;
+
+export namespace loxxy {
+
+// Whether a function only computes with numbers when called with numbers, so that its native code can never raise a
+// type error nor make a string, which the interpreter would have no way to own. Its locals hold numbers, arithmetic
+// and comparisons take numbers, and booleans and nil may only be tested, compared, printed and returned. The only
+// function it can call is itself, through the global it is declared as: such a call is a number if the function
+// always returns a number, and anything otherwise.
+template <typename Payload, typename Indirection, bool ptr_variant, typename Resolver = void>
+    requires(SlotResolved<Payload>)
+struct NumericSubset
+    : IndirectVisitor<NumericSubset<Payload, Indirection, ptr_variant, Resolver>, Resolver, Indirection> {
+    USING_FAMILY(Payload, Indirection, ptr_variant);
+    using Self = NumericSubset<Payload, Indirection, ptr_variant, Resolver>;
+    using Parent = IndirectVisitor<Self, Resolver, Indirection>;
+    using Parent::operator();
+
+    using Adhoc = utils::Adhoc<Resolver, Indirection>;
+
+    // any is a value of unknown type, which is not a string
+    enum class Type : uint8_t { number, boolean, any, unsupported };
+    // how control leaves a statement
+    enum class Flow : uint8_t { falls_through, returns, unsupported };
+
+    template <typename... Args>
+    NumericSubset(const FunctionDescriptor& function, Args&&... args)
+        : function(function), adhoc(std::forward<Args>(args)...) {}
+
+    auto accepts(const std::vector<StmtPointer>& body) -> bool {
+        recursion = Type::number;
+        returns_number = true;
+        if (sequence(body) == Flow::returns && returns_number)
+            return true;
+
+        recursion = Type::any;
+        return sequence(body) != Flow::unsupported;
+    }
+
+    auto operator()(const ExpressionStmt& node) -> Flow { return supported(utils::visit(*this, node.expr)); }
+
+    auto operator()(const PrintStmt& node) -> Flow { return supported(utils::visit(*this, node.expr)); }
+
+    auto operator()(const VarDecl& node) -> Flow {
+        if (!node.expr.has_value())
+            return Flow::unsupported;
+        return expect(node.expr.value(), Type::number, Flow::falls_through);
+    }
+
+    auto operator()(const FunDecl&) -> Flow { return Flow::unsupported; }
+
+    auto operator()(const ClassDecl&) -> Flow { return Flow::unsupported; }
+
+    auto operator()(const BlockStmt& node) -> Flow { return sequence(node.statements); }
+
+    auto operator()(const IfStmt& node) -> Flow {
+        if (supported(utils::visit(*this, node.condition)) == Flow::unsupported)
+            return Flow::unsupported;
+
+        Flow then_flow = utils::visit(*this, node.then_branch);
+        Flow else_flow = node.else_branch.has_value() ? utils::visit(*this, node.else_branch.value())
+                                                      : Flow::falls_through;
+        if (then_flow == Flow::unsupported || else_flow == Flow::unsupported)
+            return Flow::unsupported;
+
+        return then_flow == Flow::returns && else_flow == Flow::returns ? Flow::returns : Flow::falls_through;
+    }
+
+    auto operator()(const WhileStmt& node) -> Flow {
+        if (supported(utils::visit(*this, node.condition)) == Flow::unsupported)
+            return Flow::unsupported;
+
+        return utils::visit(*this, node.body) == Flow::unsupported ? Flow::unsupported : Flow::falls_through;
+    }
+
+    auto operator()(const ReturnStmt& node) -> Flow {
+        Type type = utils::visit(*this, node.expr);
+        returns_number &= type == Type::number;
+        return type == Type::unsupported ? Flow::unsupported : Flow::returns;
+    }
+
+    auto operator()(const BinaryExpr& node) -> Type {
+        Type lhs = utils::visit(*this, node.lhs);
+        Type rhs = utils::visit(*this, node.rhs);
+        if (lhs == Type::unsupported || rhs == Type::unsupported)
+            return Type::unsupported;
+
+        switch (node.op.getType()) {
+        case AND:
+        case OR:
+        case EQUAL_EQUAL:
+        case BANG_EQUAL:
+            return Type::boolean;
+        case GREATER:
+        case GREATER_EQUAL:
+        case LESS:
+        case LESS_EQUAL:
+            return lhs == Type::number && rhs == Type::number ? Type::boolean : Type::unsupported;
+        case PLUS:
+        case MINUS:
+        case STAR:
+        case SLASH:
+            return lhs == Type::number && rhs == Type::number ? Type::number : Type::unsupported;
+        default:
+            return Type::unsupported;
+        }
+    }
+
+    auto operator()(const GroupingExpr& node) -> Type { return utils::visit(*this, node.expr); }
+
+    auto operator()(const UnaryExpr& node) -> Type {
+        Type operand = utils::visit(*this, node.expr);
+        if (node.op.getType() == MINUS && operand == Type::number)
+            return Type::number;
+        if (node.op.getType() == BANG && operand != Type::unsupported)
+            return Type::boolean;
+
+        return Type::unsupported;
+    }
+
+    auto operator()(const NumberExpr&) -> Type { return Type::number; }
+
+    auto operator()(const BoolExpr&) -> Type { return Type::boolean; }
+
+    auto operator()(const StringExpr&) -> Type { return Type::unsupported; }
+
+    auto operator()(const NilExpr&) -> Type { return Type::any; }
+
+    // locals are only ever assigned numbers, and arguments are numbers
+    auto operator()(const VarExpr& node) -> Type { return node.payload.depth == 0 ? Type::number : Type::unsupported; }
+
+    auto operator()(const AssignExpr& node) -> Type {
+        if (node.payload.depth != 0)
+            return Type::unsupported;
+        return utils::visit(*this, node.expr) == Type::number ? Type::number : Type::unsupported;
+    }
+
+    auto operator()(const CallExpr& node) -> Type {
+        auto recursive = adhoc.make_visitor(
+            [this](const VarExpr& var) {
+                return var.payload.depth == SlotPayload::global && var.identifier == function.name;
+            },
+            []<typename T>(const T&) { return false; }
+        );
+        if (!utils::visit(recursive, node.callee) || node.arguments.size() != function.arg_names.size())
+            return Type::unsupported;
+
+        for (const ExprPointer& arg : node.arguments) {
+            if (utils::visit(*this, arg) != Type::number)
+                return Type::unsupported;
+        }
+        return recursion;
+    }
+
+    auto operator()(const GetExpr&) -> Type { return Type::unsupported; }
+
+    auto operator()(const SetExpr&) -> Type { return Type::unsupported; }
+
+    auto operator()(const ThisExpr&) -> Type { return Type::unsupported; }
+
+    auto operator()(const SuperExpr&) -> Type { return Type::unsupported; }
+
+private:
+    auto sequence(const std::vector<StmtPointer>& statements) -> Flow {
+        // statements after a return are still compiled, so they have to be supported too
+        Flow flow = Flow::falls_through;
+        for (const StmtPointer& statement : statements) {
+            Flow next = utils::visit(*this, statement);
+            if (next == Flow::unsupported)
+                return Flow::unsupported;
+            if (next == Flow::returns)
+                flow = Flow::returns;
+        }
+        return flow;
+    }
+
+    auto expect(const ExprPointer& expr, Type type, Flow flow) -> Flow {
+        return utils::visit(*this, expr) == type ? flow : Flow::unsupported;
+    }
+
+    static auto supported(Type type) -> Flow {
+        return type == Type::unsupported ? Flow::unsupported : Flow::falls_through;
+    }
+
+    const FunctionDescriptor& function;
+    Adhoc adhoc;
+    // the type of a call to the function itself
+    Type recursion = Type::number;
+    bool returns_number = true;
+};
+
+// Tier policy of the Interpreter that promotes hot functions to native code. Calls and loop iterations are counted
+// per function, and a function whose count reaches hot_threshold gets compiled by the IRGenerator on a background
+// thread, if every call so far had numbers as arguments and it is in the NumericSubset. Once the code is ready, calls
+// go to it as long as their arguments are numbers, which is what the code was specialized to; the other calls fall
+// back to the interpreter, and after max_guard_failures of them the native code is dropped for good. Arguments and
+// results cross over boxed, with the layout of the runtime.
+//
+// A running call stays in the interpreter, even if its loop made the function hot: only the following calls get to
+// the native code. Calls from native code to itself are bound when compiling, they do not see the global being
+// assigned another function afterwards.
+template <typename Payload, typename Indirection, bool ptr_variant, typename Resolver = void>
+    requires(SlotResolved<Payload>)
+class TieredJit {
+    USING_FAMILY(Payload, Indirection, ptr_variant);
+    // the native code of a function, called with its arguments in an array
+    using Entry = uint64_t (*)(const uint64_t*);
+
+public:
+    static constexpr uint32_t hot_threshold = 1000;
+    static constexpr uint32_t max_guard_failures = 100;
+
+    TieredJit() : worker([this](std::stop_token stop) { compileLoop(stop); }) {}
+    TieredJit(const TieredJit&) = delete;
+    auto operator=(const TieredJit&) -> TieredJit& = delete;
+
+    auto call(const FunctionDescriptor* descriptor, std::span<const Value> args, bool bound) -> std::optional<Value> {
+        Function& function = functions.try_emplace(descriptor, descriptor).first->second;
+        bool numeric = !bound && numbers(args);
+
+        if (function.state == Function::native) {
+            Entry entry = function.entry.load(std::memory_order_acquire);
+            if (entry != nullptr && numeric)
+                return unbox(entry(arguments.data()));
+
+            if (entry != nullptr && ++function.guard_failures == max_guard_failures)
+                function.state = Function::interpreted_only;
+        } else if (function.state == Function::counting) {
+            function.numeric &= numeric;
+            heat(function);
+        }
+
+        running.push_back(&function);
+        return std::nullopt;
+    }
+
+    void backEdge() {
+        if (!running.empty() && running.back()->state == Function::counting)
+            heat(*running.back());
+    }
+
+    void leave() { running.pop_back(); }
+
+    // what profilers get to know of the native code, before the first call. Throws if jitdumps are asked for but not
+    // supported, rather than the compiler thread finding out
+    void setPerfSupport(PerfSupport support) {
+        if (support.jitdump && llvm::JITEventListener::createPerfJITEventListener() == nullptr)
+            throw std::runtime_error("this LLVM was built without jitdump support");
+
+        std::lock_guard lock(mutex);
+        perf = support;
+    }
+
+private:
+    struct Function {
+        enum State : uint8_t {
+            counting,
+            // queued or compiled, entry is set by the compiler thread if the compilation succeeded
+            native,
+            interpreted_only
+        };
+
+        explicit Function(const FunctionDescriptor* descriptor) : descriptor(descriptor) {}
+
+        const FunctionDescriptor* descriptor;
+        State state = counting;
+        uint32_t heat = 0;
+        uint32_t guard_failures = 0;
+        // whether every call so far had numbers as arguments
+        bool numeric = true;
+        std::atomic<Entry> entry{nullptr};
+    };
+
+    // copies the arguments into `arguments` if they are all numbers
+    auto numbers(std::span<const Value> args) -> bool {
+        arguments.clear();
+        for (const Value& arg : args) {
+            if (!utils::holds_alternative<double>(arg))
+                return false;
+            double x = utils::get<double>(arg);
+            arguments.push_back(x != x ? boxing::canonical_nan : std::bit_cast<uint64_t>(x));
+        }
+        return true;
+    }
+
+    // native code in the NumericSubset makes no strings
+    static auto unbox(uint64_t bits) -> Value {
+        if (boxing::is_number(bits))
+            return Value{std::bit_cast<double>(bits)};
+        if (bits == boxing::true_bits || bits == boxing::false_bits)
+            return Value{bits == boxing::true_bits};
+        return Value{nullptr};
+    }
+
+    void heat(Function& function) {
+        if (++function.heat < hot_threshold)
+            return;
+
+        if (!function.numeric) {
+            function.state = Function::interpreted_only;
+            return;
+        }
+
+        function.state = Function::native;
+        {
+            std::lock_guard lock(mutex);
+            queue.push_back(&function);
+        }
+        queued.notify_one();
+    }
+
+    void compileLoop(std::stop_token stop) {
+        while (true) {
+            Function* function;
+            {
+                std::unique_lock lock(mutex);
+                if (!queued.wait(lock, stop, [this] { return !queue.empty(); }))
+                    return;
+
+                function = queue.front();
+                queue.pop_front();
+            }
+
+            if (Entry entry = compile(*function->descriptor); entry != nullptr)
+                function->entry.store(entry, std::memory_order_release);
+        }
+    }
+
+    // nullptr if the function cannot be compiled
+    auto compile(const FunctionDescriptor& descriptor) -> Entry {
+        const auto& body = *static_cast<const std::vector<StmtPointer>*>(descriptor.body);
+        if (!NumericSubset<Payload, Indirection, ptr_variant, Resolver>{descriptor}.accepts(body))
+            return nullptr;
+
+        if (jit == nullptr) {
+            std::unique_lock lock(mutex);
+            PerfSupport support = perf;
+            lock.unlock();
+            jit = createJit(support);
+        }
+
+        // functions of the same name can be declared more than once
+        std::string symbol = std::string(std::string_view(*descriptor.name)) + ".tier" + std::to_string(n_compiled++);
+        llvm::orc::ThreadSafeModule module;
+        try {
+            IRGenerator<Payload, Indirection, ptr_variant, Resolver> generator;
+            llvm::Function* function =
+                generator.compileFunction(descriptor.name, descriptor.arg_names, body, descriptor.line);
+            module = generator.takeFunction(function, symbol);
+        } catch (const std::runtime_error&) {
+            return nullptr;
+        }
+
+        if (llvm::Error error = jit->addModule(std::move(module))) {
+            llvm::consumeError(std::move(error));
+            return nullptr;
+        }
+
+        llvm::Expected<llvm::orc::ExecutorSymbolDef> found = jit->lookup(symbol);
+        if (!found) {
+            llvm::consumeError(found.takeError());
+            return nullptr;
+        }
+        return found->getAddress().toPtr<Entry>();
+    }
+
+    // only touched by the interpreter's thread
+    std::unordered_map<const FunctionDescriptor*, Function> functions;
+    // functions with a call running in the interpreter, innermost last
+    std::vector<Function*> running;
+    std::vector<uint64_t> arguments;
+
+    std::mutex mutex;
+    std::condition_variable_any queued;
+    std::deque<Function*> queue;
+    PerfSupport perf;
+
+    // only touched by the worker
+    std::unique_ptr<LoxJit> jit;
+    uint32_t n_compiled = 0;
+
+    // declared last, so it is joined before anything it uses is destroyed
+    std::jthread worker;
+};
+
+} // namespace loxxy
@@ -1,6 +1,9 @@
 module;
 
+#include <cassert>
+#include <cstdint>
 #include <iostream>
+#include <vector>
 
 export module ast:token;
 import utils.string_store;
@@ -11,7 +14,7 @@ export namespace loxxy {
 
 using namespace utils;
 
-enum TokenType {
+enum TokenType : uint8_t {
     LEFT_PAREN,
     RIGHT_PAREN,
     LEFT_BRACE,
@@ -196,37 +199,113 @@ union Literal {
     Literal() : number(0) {}
 };
 
+// 16 bytes, four tokens to a cache line. NUMBER and STRING tokens keep their literal in place of their lexeme, which
+// nothing after the lexer needs; the others have no literal.
 class Token {
+    union Payload {
+        const persistent_string<char>* lexeme;
+        Literal literal;
+    };
+
 public:
-    Token(TokenType type, const persistent_string<char>* lexeme, Literal literal, int line, int column)
-        : type(type), lexeme(lexeme), literal(literal), line(line), column(column) {}
+    Token(TokenType type, const persistent_string<char>* lexeme, int line, int column)
+        : Token(type, Payload{.lexeme = lexeme}, line, column) {
+        assert(type != TokenType::NUMBER && type != TokenType::STRING);
+    }
+
+    Token(TokenType type, Literal literal, int line, int column)
+        : Token(type, Payload{.literal = literal}, line, column) {
+        assert(type == TokenType::NUMBER || type == TokenType::STRING);
+    }
 
     friend auto operator<<(std::ostream& ostream, const Token& token) -> std::ostream& {
-        ostream << token.type << " " << *token.lexeme;
+        ostream << token.getType() << " ";
         if (token.type == TokenType::STRING)
-            ostream << " " << *token.literal.string;
+            ostream << *token.payload.literal.string;
         else if (token.type == TokenType::NUMBER)
-            ostream << " " << token.literal.number;
+            ostream << token.payload.literal.number;
+        else
+            ostream << *token.payload.lexeme;
         ostream << ":" << token.line << "," << token.column;
         return ostream;
     }
 
     auto getType() const -> TokenType { return type; }
 
-    auto getLexeme() const -> const persistent_string<char>& { return *lexeme; }
+    auto getLexeme() const -> const persistent_string<char>& {
+        assert(type != TokenType::NUMBER && type != TokenType::STRING);
+        return *payload.lexeme;
+    }
 
-    auto getLiteral() const -> const Literal& { return literal; }
+    auto getLiteral() const -> const Literal& {
+        assert(type == TokenType::NUMBER || type == TokenType::STRING);
+        return payload.literal;
+    }
 
     auto getLine() const -> int { return line; }
 
     auto getColumn() const -> int { return column; }
 
 private:
-    TokenType type;
-    const persistent_string<char>* lexeme;
-    Literal literal;
+    friend class TokenBuffer;
+
+    Token(TokenType type, Payload payload, int line, int column)
+        : payload(payload), line(line), column(column), type(type) {}
+
+    Payload payload;
     int line;
-    int column;
+    // columns past 16M wrap around
+    unsigned column : 24;
+    TokenType type;
+};
+
+static_assert(sizeof(Token) == 16);
+
+// Tokens with one array per field, filled like a generic_stream by the lexer and read like one by the parser. The
+// parser mostly peeks at types, which are then all it reads.
+class TokenBuffer {
+public:
+    void emplace(const Token& token) {
+        types.push_back(token.type);
+        lines.push_back(token.line);
+        columns.push_back(token.column);
+        payloads.push_back(token.payload);
+    }
+
+    auto get() -> Token {
+        Token token = peek();
+        index++;
+        return token;
+    }
+
+    auto peek() const -> Token {
+        assert(index < types.size());
+        return Token(types[index], payloads[index], lines[index], columns[index]);
+    }
+
+    auto eof() const -> bool { return index == types.size(); }
+
+    auto fail() const -> bool { return false; }
+
+    // back to the first token
+    void reset() { index = 0; }
+
+    auto size() const -> size_t { return types.size(); }
+
+    void clear() {
+        types.clear();
+        lines.clear();
+        columns.clear();
+        payloads.clear();
+        index = 0;
+    }
+
+private:
+    std::vector<TokenType> types;
+    std::vector<int> lines;
+    std::vector<unsigned> columns;
+    std::vector<Token::Payload> payloads;
+    size_t index = 0;
 };
 
 } // namespace loxxy
@@ -45,6 +45,10 @@ template <typename Payload, typename Indirection, bool ptr_variant>
 struct LeafSTNImpl<NilExpr<Payload, Indirection, ptr_variant>> : true_type {};
 template <typename Payload, typename Indirection, bool ptr_variant>
 struct LeafSTNImpl<VarExpr<Payload, Indirection, ptr_variant>> : true_type {};
+template <typename Payload, typename Indirection, bool ptr_variant>
+struct LeafSTNImpl<ThisExpr<Payload, Indirection, ptr_variant>> : true_type {};
+template <typename Payload, typename Indirection, bool ptr_variant>
+struct LeafSTNImpl<SuperExpr<Payload, Indirection, ptr_variant>> : true_type {};
 
 template <typename T>
 concept LeafSTN = LeafSTNImpl<T>::value;
@@ -68,6 +72,8 @@ template <typename Payload, typename Indirection, bool ptr_variant>
 struct StatementSTNImpl<WhileStmt<Payload, Indirection, ptr_variant>> : true_type {};
 template <typename Payload, typename Indirection, bool ptr_variant>
 struct StatementSTNImpl<ReturnStmt<Payload, Indirection, ptr_variant>> : true_type {};
+template <typename Payload, typename Indirection, bool ptr_variant>
+struct StatementSTNImpl<ClassDecl<Payload, Indirection, ptr_variant>> : true_type {};
 
 template <typename T>
 concept StatementSTN = StatementSTNImpl<T>::value;
@@ -95,6 +101,14 @@ template <typename Payload, typename Indirection, bool ptr_variant>
 struct ExpressionSTNImpl<AssignExpr<Payload, Indirection, ptr_variant>> : true_type {};
 template <typename Payload, typename Indirection, bool ptr_variant>
 struct ExpressionSTNImpl<CallExpr<Payload, Indirection, ptr_variant>> : true_type {};
+template <typename Payload, typename Indirection, bool ptr_variant>
+struct ExpressionSTNImpl<GetExpr<Payload, Indirection, ptr_variant>> : true_type {};
+template <typename Payload, typename Indirection, bool ptr_variant>
+struct ExpressionSTNImpl<SetExpr<Payload, Indirection, ptr_variant>> : true_type {};
+template <typename Payload, typename Indirection, bool ptr_variant>
+struct ExpressionSTNImpl<ThisExpr<Payload, Indirection, ptr_variant>> : true_type {};
+template <typename Payload, typename Indirection, bool ptr_variant>
+struct ExpressionSTNImpl<SuperExpr<Payload, Indirection, ptr_variant>> : true_type {};
 
 template <typename T>
 concept ExpressionSTN = ExpressionSTNImpl<T>::value;
@@ -1,17 +1,308 @@
 module;
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <concepts>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <new>
+#include <optional>
 #include <span>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
 #include <vector>
 export module ast:value;
 import utils.variant;
 import utils.string_store;
+import utils.stupid_type_traits;
+
+using std::nullptr_t;
+using std::same_as;
+using utils::any_ref;
+using utils::persistent_string;
 
 export namespace loxxy {
 struct BuiltinCallable;
 struct LoxCallable;
+struct LoxClass;
+
+// An immutable runtime string. String literals borrow the lexer's interned storage, so two of them are equal exactly
+// if they are the same object. Strings built at runtime are refcounted and tagged by the lowest pointer bit.
+class LoxString {
+public:
+    explicit LoxString(const persistent_string<>* interned) : tagged(reinterpret_cast<uintptr_t>(interned)) {}
+
+    static auto concat(std::string_view lhs, std::string_view rhs) -> LoxString {
+        auto* memory = static_cast<std::byte*>(::operator new(
+            sizeof(Owned) + sizeof(persistent_string<>) + lhs.size() + rhs.size(), std::align_val_t{alignof(Owned)}
+        ));
+        new (memory) Owned{1};
+
+        persistent_string<>* string = persistent_string<>::construct_at(memory + sizeof(Owned));
+        std::memcpy(string->chars, lhs.data(), lhs.size());
+        std::memcpy(string->chars + lhs.size(), rhs.data(), rhs.size());
+        string->len = static_cast<utils::size_tt>(lhs.size() + rhs.size());
+        return LoxString{reinterpret_cast<uintptr_t>(string) | owned_bit};
+    }
+
+    LoxString(const LoxString& other) : tagged(other.tagged) { retain_raw(tagged); }
+    LoxString(LoxString&& other) noexcept : tagged(std::exchange(other.tagged, 0)) {}
+
+    auto operator=(const LoxString& other) -> LoxString& {
+        retain_raw(other.tagged);
+        release_raw(tagged);
+        tagged = other.tagged;
+        return *this;
+    }
+
+    auto operator=(LoxString&& other) noexcept -> LoxString& {
+        if (this != &other) {
+            release_raw(tagged);
+            tagged = std::exchange(other.tagged, 0);
+        }
+        return *this;
+    }
+
+    ~LoxString() { release_raw(tagged); }
+
+    [[nodiscard]] auto interned() const -> bool { return (tagged & owned_bit) == 0; }
+
+    [[nodiscard]] auto view() const -> std::string_view {
+        if (tagged == 0)
+            return {};
+        return *reinterpret_cast<const persistent_string<>*>(tagged & ~owned_bit);
+    }
+
+    friend auto operator==(const LoxString& lhs, const LoxString& rhs) -> bool {
+        if (lhs.tagged == rhs.tagged)
+            return true;
+        if (lhs.interned() && rhs.interned())
+            return false;
+        return lhs.view() == rhs.view();
+    }
+
+    friend auto operator<<(std::ostream& ostream, const LoxString& string) -> std::ostream& {
+        return ostream << string.view();
+    }
+
+    // hand the reference held by this string to a raw word and back, for containers that pack it, see NanBoxedValue
+    [[nodiscard]] auto into_raw() && -> uintptr_t { return std::exchange(tagged, 0); }
+    static auto from_raw(uintptr_t raw) -> LoxString { return LoxString{raw}; }
+
+    static void retain_raw(uintptr_t raw) {
+        if ((raw & owned_bit) != 0)
+            owned(raw)->refcount++;
+    }
+
+    static void release_raw(uintptr_t raw) {
+        if ((raw & owned_bit) == 0)
+            return;
+
+        Owned* header = owned(raw);
+        if (--header->refcount == 0)
+            ::operator delete(header, std::align_val_t{alignof(Owned)});
+    }
+
+private:
+    struct alignas(persistent_string<>) Owned {
+        uint32_t refcount;
+    };
+
+    static constexpr uintptr_t owned_bit = 1;
+
+    explicit LoxString(uintptr_t tagged) : tagged(tagged) {}
+
+    static auto owned(uintptr_t raw) -> Owned* { return reinterpret_cast<Owned*>((raw & ~owned_bit) - sizeof(Owned)); }
 
-using Value = utils::variant<bool, double, std::string, std::nullptr_t, const BuiltinCallable*, LoxCallable>;
+    uintptr_t tagged;
+};
+
+// Heap allocated part of the class system: classes, their instances and methods bound to an instance.
+struct Object {
+    enum class Kind : uint8_t { klass, instance, bound_method };
+
+    explicit Object(Kind kind) : kind(kind) {}
+    Object(const Object&) = delete;
+    auto operator=(const Object&) -> Object& = delete;
+    virtual ~Object() = default;
+
+    uint32_t refcount = 1;
+    const Kind kind;
+};
+
+// A refcounted handle to an Object. Objects are compared by identity, and reference cycles between them leak.
+class LoxObject {
+public:
+    // takes over the reference the object was created with
+    explicit LoxObject(Object* object) : object(object) {}
+
+    static auto share(Object* object) -> LoxObject {
+        object->refcount++;
+        return LoxObject{object};
+    }
+
+    LoxObject(const LoxObject& other) : object(other.object) { retain_raw(reinterpret_cast<uintptr_t>(object)); }
+    LoxObject(LoxObject&& other) noexcept : object(std::exchange(other.object, nullptr)) {}
+
+    auto operator=(const LoxObject& other) -> LoxObject& {
+        retain_raw(reinterpret_cast<uintptr_t>(other.object));
+        release_raw(reinterpret_cast<uintptr_t>(object));
+        object = other.object;
+        return *this;
+    }
+
+    auto operator=(LoxObject&& other) noexcept -> LoxObject& {
+        if (this != &other) {
+            release_raw(reinterpret_cast<uintptr_t>(object));
+            object = std::exchange(other.object, nullptr);
+        }
+        return *this;
+    }
+
+    ~LoxObject() { release_raw(reinterpret_cast<uintptr_t>(object)); }
+
+    [[nodiscard]] auto get() const -> Object* { return object; }
+
+    // the object as one of the Object kinds, or nullptr if it is of another kind
+    template <typename T>
+    [[nodiscard]] auto as() const -> T* {
+        return object->kind == T::object_kind ? static_cast<T*>(object) : nullptr;
+    }
+
+    friend auto operator==(const LoxObject& lhs, const LoxObject& rhs) -> bool { return lhs.object == rhs.object; }
+
+    // see LoxString
+    [[nodiscard]] auto into_raw() && -> uintptr_t {
+        return reinterpret_cast<uintptr_t>(std::exchange(object, nullptr));
+    }
+    static auto from_raw(uintptr_t raw) -> LoxObject { return LoxObject{reinterpret_cast<Object*>(raw)}; }
+
+    static void retain_raw(uintptr_t raw) {
+        if (raw != 0)
+            reinterpret_cast<Object*>(raw)->refcount++;
+    }
+
+    static void release_raw(uintptr_t raw) {
+        auto* object = reinterpret_cast<Object*>(raw);
+        if (object != nullptr && --object->refcount == 0)
+            delete object;
+    }
+
+private:
+    Object* object;
+};
+
+// A value packed into a single 64 bit word. Doubles are stored as is, everything else hides in the payload bits of a
+// quiet NaN that arithmetic never produces. Strings and functions live in refcounted heap boxes.
+class NanBoxedValue {
+public:
+    using custom_visitable = void;
+
+    NanBoxedValue() : bits(nil_bits) {}
+    NanBoxedValue(nullptr_t) : bits(nil_bits) {}
+    NanBoxedValue(bool b) : bits(b ? true_bits : false_bits) {}
+    NanBoxedValue(double x);
+    NanBoxedValue(const BuiltinCallable* fn);
+    NanBoxedValue(LoxString string);
+    NanBoxedValue(LoxCallable fn);
+    NanBoxedValue(LoxObject object);
+    NanBoxedValue(const char*) = delete;
+
+    NanBoxedValue(const NanBoxedValue& other);
+    NanBoxedValue(NanBoxedValue&& other) noexcept;
+    auto operator=(const NanBoxedValue& other) -> NanBoxedValue&;
+    auto operator=(NanBoxedValue&& other) noexcept -> NanBoxedValue&;
+    ~NanBoxedValue();
+
+    [[nodiscard]] auto is_number() const -> bool { return (bits & qnan) != qnan; }
+    [[nodiscard]] auto as_number() const -> double { return std::bit_cast<double>(bits); }
+
+    template <typename T>
+    [[nodiscard]] auto holds() const -> bool;
+
+    template <typename T>
+    [[nodiscard]] auto get() const -> decltype(auto);
+
+    template <typename Visitor>
+    auto visit(Visitor&& visitor) const -> std::invoke_result_t<Visitor, double>;
+
+private:
+    struct HeapHeader {
+        uint32_t refcount = 1;
+    };
+
+    // a LoxString or LoxObject viewed in place, without taking over the reference the value holds
+    template <typename T>
+    union Borrowed {
+        T value;
+        ~Borrowed() {}
+    };
+
+    template <typename T>
+    struct HeapBox : HeapHeader {
+        explicit HeapBox(T&& value) : value(std::move(value)) {}
+        T value;
+    };
+
+    enum class Kind : uint64_t { string = 0, function = 1, builtin = 2, object = 3 };
+
+    static constexpr uint64_t sign = uint64_t{1} << 63;
+    static constexpr uint64_t qnan = 0x7ffc000000000000;
+    static constexpr uint64_t nil_bits = qnan | 1;
+    static constexpr uint64_t false_bits = qnan | 2;
+    static constexpr uint64_t true_bits = qnan | 3;
+    static constexpr uint64_t pointer_tag = sign | qnan;
+    static constexpr int kind_shift = 48;
+    static constexpr uint64_t pointer_mask = (uint64_t{1} << kind_shift) - 1;
+
+    static auto box(Kind kind, const void* pointer) -> uint64_t {
+        return box(kind, reinterpret_cast<uintptr_t>(pointer));
+    }
+    static auto box(Kind kind, uintptr_t raw) -> uint64_t {
+        return pointer_tag | (static_cast<uint64_t>(kind) << kind_shift) | raw;
+    }
+
+    [[nodiscard]] auto is_pointer() const -> bool { return (bits & pointer_tag) == pointer_tag; }
+    [[nodiscard]] auto kind() const -> Kind { return static_cast<Kind>((bits >> kind_shift) & 3); }
+    [[nodiscard]] auto is(Kind k) const -> bool { return is_pointer() && kind() == k; }
+    [[nodiscard]] auto payload() const -> uintptr_t { return bits & pointer_mask; }
+    [[nodiscard]] auto header() const -> HeapHeader* { return reinterpret_cast<HeapHeader*>(payload()); }
+
+    template <typename T>
+    [[nodiscard]] auto unbox() const -> const T& {
+        return static_cast<HeapBox<T>*>(header())->value;
+    }
+
+    void retain() const {
+        if (is(Kind::function))
+            header()->refcount++;
+        else if (is(Kind::string))
+            LoxString::retain_raw(payload());
+        else if (is(Kind::object))
+            LoxObject::retain_raw(payload());
+    }
+
+    void release();
+
+    uint64_t bits;
+};
+
+static_assert(sizeof(NanBoxedValue) == sizeof(uint64_t));
+
+#ifdef LOXXY_NAN_BOXING
+using Value = NanBoxedValue;
+constexpr bool nan_boxed_values = true;
+#else
+using Value = utils::variant<bool, double, LoxString, std::nullptr_t, const BuiltinCallable*, LoxCallable, LoxObject>;
+constexpr bool nan_boxed_values = false;
+#endif
 
 struct BuiltinCallable {
     Value (*fn)(std::span<Value>);
@@ -19,9 +310,424 @@ struct BuiltinCallable {
     size_t arity;
 };
 
+// Everything about a function that is fixed at its declaration. Backends create one per declaration and function
+// values only refer to it.
+struct FunctionDescriptor {
+    const persistent_string<>* name = nullptr;
+    std::span<const persistent_string<>* const> arg_names;
+    // backend specific: the FunDecl's body for the tree walking interpreter, a Chunk for the VM
+    const void* body = nullptr;
+    // only used when variables are resolved to slots, see SlotResolver
+    uint32_t frame_size = 0;
+    // where the function is declared, for profilers
+    int line = 0;
+};
+
 struct LoxCallable {
-    std::vector<const utils::persistent_string<>*> arg_names;
-    const void* function_body;
+    const FunctionDescriptor* descriptor;
+    // frame of the enclosing function at the time of declaration
+    uint32_t static_link = 0;
+    uint32_t generation = 0;
+};
+
+inline NanBoxedValue::NanBoxedValue(double x) {
+    // arithmetic may yield NaNs with arbitrary payloads, collapse them to the canonical one
+    if (x != x)
+        x = std::numeric_limits<double>::quiet_NaN();
+    bits = std::bit_cast<uint64_t>(x);
+}
+
+inline NanBoxedValue::NanBoxedValue(const BuiltinCallable* fn) : bits(box(Kind::builtin, fn)) {}
+
+inline NanBoxedValue::NanBoxedValue(LoxString string) : bits(box(Kind::string, std::move(string).into_raw())) {}
+
+inline NanBoxedValue::NanBoxedValue(LoxCallable fn)
+    : bits(box(Kind::function, static_cast<HeapHeader*>(new HeapBox<LoxCallable>(std::move(fn))))) {}
+
+inline NanBoxedValue::NanBoxedValue(LoxObject object) : bits(box(Kind::object, std::move(object).into_raw())) {}
+
+inline NanBoxedValue::NanBoxedValue(const NanBoxedValue& other) : bits(other.bits) { retain(); }
+
+inline NanBoxedValue::NanBoxedValue(NanBoxedValue&& other) noexcept : bits(std::exchange(other.bits, nil_bits)) {}
+
+inline auto NanBoxedValue::operator=(const NanBoxedValue& other) -> NanBoxedValue& {
+    other.retain();
+    release();
+    bits = other.bits;
+    return *this;
+}
+
+inline auto NanBoxedValue::operator=(NanBoxedValue&& other) noexcept -> NanBoxedValue& {
+    if (this != &other) {
+        release();
+        bits = std::exchange(other.bits, nil_bits);
+    }
+    return *this;
+}
+
+inline NanBoxedValue::~NanBoxedValue() { release(); }
+
+inline void NanBoxedValue::release() {
+    if (is(Kind::string))
+        LoxString::release_raw(payload());
+    else if (is(Kind::object))
+        LoxObject::release_raw(payload());
+    else if (is(Kind::function) && --header()->refcount == 0)
+        delete static_cast<HeapBox<LoxCallable>*>(header());
+}
+
+template <typename T>
+auto NanBoxedValue::holds() const -> bool {
+    if constexpr (same_as<T, double>)
+        return is_number();
+    else if constexpr (same_as<T, bool>)
+        return bits == true_bits || bits == false_bits;
+    else if constexpr (same_as<T, nullptr_t>)
+        return bits == nil_bits;
+    else if constexpr (same_as<T, const BuiltinCallable*>)
+        return is(Kind::builtin);
+    else if constexpr (same_as<T, LoxString>)
+        return is(Kind::string);
+    else if constexpr (same_as<T, LoxCallable>)
+        return is(Kind::function);
+    else if constexpr (same_as<T, LoxObject>)
+        return is(Kind::object);
+    else
+        static_assert(false, "not a value alternative");
+}
+
+template <typename T>
+auto NanBoxedValue::get() const -> decltype(auto) {
+    if (!holds<T>())
+        throw utils::bad_variant_access();
+
+    if constexpr (same_as<T, double>)
+        return as_number();
+    else if constexpr (same_as<T, bool>)
+        return bits == true_bits;
+    else if constexpr (same_as<T, nullptr_t>)
+        return nullptr;
+    else if constexpr (same_as<T, const BuiltinCallable*>)
+        return reinterpret_cast<const BuiltinCallable*>(payload());
+    else if constexpr (same_as<T, LoxString>) {
+        LoxString::retain_raw(payload());
+        return LoxString::from_raw(payload());
+    } else if constexpr (same_as<T, LoxObject>) {
+        LoxObject::retain_raw(payload());
+        return LoxObject::from_raw(payload());
+    } else
+        return unbox<T>();
+}
+
+template <typename Visitor>
+auto NanBoxedValue::visit(Visitor&& visitor) const -> std::invoke_result_t<Visitor, double> {
+    if (is_number())
+        return visitor(as_number());
+
+    if (!is_pointer()) {
+        if (bits == nil_bits)
+            return visitor(nullptr);
+        return visitor(bits == true_bits);
+    }
+
+    switch (kind()) {
+    case Kind::string: {
+        Borrowed<LoxString> borrowed{LoxString::from_raw(payload())};
+        return visitor(std::as_const(borrowed.value));
+    }
+    case Kind::function:
+        return visitor(unbox<LoxCallable>());
+    case Kind::object: {
+        Borrowed<LoxObject> borrowed{LoxObject::from_raw(payload())};
+        return visitor(std::as_const(borrowed.value));
+    }
+    default:
+        return visitor(reinterpret_cast<const BuiltinCallable*>(payload()));
+    }
+}
+
+// Hidden class of an instance: which fields it has, and the slot of each. Instances of a class that got the same
+// fields in the same order share their shape, so an inline cache that saw a shape once knows where its field lives.
+// Shapes form a tree rooted in their class, and are never freed before it.
+class Shape {
+public:
+    static constexpr uint32_t no_id = std::numeric_limits<uint32_t>::max();
+
+    Shape() : id(next_id++) {}
+
+    [[nodiscard]] auto find(const persistent_string<>* name) const -> std::optional<uint32_t> {
+        auto it = std::ranges::find(fields, name);
+        if (it == fields.end())
+            return std::nullopt;
+
+        return static_cast<uint32_t>(it - fields.begin());
+    }
+
+    // the shape an instance of this shape gets when the field `name` is added to it
+    auto with(const persistent_string<>* name) -> Shape* {
+        for (const std::unique_ptr<Shape>& transition : transitions) {
+            if (transition->fields.back() == name)
+                return transition.get();
+        }
+
+        return transitions.emplace_back(new Shape{*this, name}).get();
+    }
+
+    [[nodiscard]] auto size() const -> uint32_t { return static_cast<uint32_t>(fields.size()); }
+
+    // unique over the whole run, unlike the address of a shape
+    const uint32_t id;
+
+private:
+    Shape(const Shape& parent, const persistent_string<>* name) : id(next_id++), fields(parent.fields) {
+        fields.push_back(name);
+    }
+
+    inline static uint32_t next_id = 0;
+
+    // identifiers are interned, so fields are compared by address
+    std::vector<const persistent_string<>*> fields;
+    std::vector<std::unique_ptr<Shape>> transitions;
+};
+
+struct LoxMethod {
+    const persistent_string<>* name;
+    LoxCallable function;
+    // the class that declared the method, which `super` starts looking from
+    LoxClass* holder;
+};
+
+struct LoxClass : Object {
+    static constexpr Kind object_kind = Kind::klass;
+
+    LoxClass(const persistent_string<>* name, std::optional<LoxObject> superclass)
+        : Object(object_kind), name(name), superclass(std::move(superclass)) {
+        // inherited methods are copied down, a lookup never walks the hierarchy
+        if (this->superclass.has_value()) {
+            const LoxClass& parent = *this->superclass->as<LoxClass>();
+            methods = parent.methods;
+            initializer = parent.initializer;
+        }
+    }
+
+    void addMethod(const persistent_string<>* method_name, LoxCallable function) {
+        LoxMethod method{method_name, function, this};
+        std::optional<uint32_t> index = findMethod(method_name);
+        if (index.has_value())
+            methods[index.value()] = method;
+        else {
+            index = static_cast<uint32_t>(methods.size());
+            methods.push_back(method);
+        }
+
+        if (std::string_view(*method_name) == "init")
+            initializer = index;
+    }
+
+    [[nodiscard]] auto findMethod(const persistent_string<>* method_name) const -> std::optional<uint32_t> {
+        auto it = std::ranges::find(methods, method_name, &LoxMethod::name);
+        if (it == methods.end())
+            return std::nullopt;
+
+        return static_cast<uint32_t>(it - methods.begin());
+    }
+
+    const persistent_string<>* name;
+    std::optional<LoxObject> superclass;
+    std::vector<LoxMethod> methods;
+    std::optional<uint32_t> initializer;
+    // shape of the instances that have no fields yet
+    Shape shape;
+    // largest number of fields an instance had so far, new instances reserve room for as many
+    uint32_t instance_size = 0;
+};
+
+struct LoxInstance : Object {
+    static constexpr Kind object_kind = Kind::instance;
+
+    explicit LoxInstance(LoxObject klass) : Object(object_kind), klass(std::move(klass)) {
+        LoxClass& of = ofClass();
+        shape = &of.shape;
+        fields.reserve(of.instance_size);
+    }
+
+    [[nodiscard]] auto ofClass() const -> LoxClass& { return *klass.as<LoxClass>(); }
+
+    // appends a field the instance does not have yet
+    void addField(const persistent_string<>* name, Value&& value) {
+        shape = shape->with(name);
+        fields.push_back(std::move(value));
+
+        LoxClass& of = ofClass();
+        of.instance_size = std::max(of.instance_size, shape->size());
+    }
+
+    LoxObject klass;
+    Shape* shape;
+    // in the order of the shape
+    std::vector<Value> fields;
+};
+
+struct LoxBoundMethod : Object {
+    static constexpr Kind object_kind = Kind::bound_method;
+
+    LoxBoundMethod(Value receiver, const LoxMethod& method)
+        : Object(object_kind), receiver(std::move(receiver)), method(method) {}
+
+    Value receiver;
+    LoxMethod method;
+};
+
+struct TypeError : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+struct UndefinedVariable : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+struct NotCallable : std::runtime_error {
+    using std::runtime_error::runtime_error;
 };
+struct WrongNumberOfArguments : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+struct UndefinedProperty : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+// Global variables of all backends, in a flat table indexed by the id the lexer gave their identifier when interning
+// it. Lookups are a bounds check and a load.
+class Globals {
+public:
+    auto find(utils::size_tt id) -> Value* {
+        if (id >= slots.size() || !slots[id].defined)
+            return nullptr;
+
+        return &slots[id].value;
+    }
+
+    auto find(const persistent_string<>* identifier) -> Value* { return find(identifier->id); }
+
+    void define(utils::size_tt id, Value&& value) {
+        if (id >= slots.size())
+            slots.resize(id + 1);
+
+        slots[id] = Slot{std::move(value), true};
+    }
+
+    void define(const persistent_string<>* identifier, Value&& value) { define(identifier->id, std::move(value)); }
+
+private:
+    struct Slot {
+        Value value{nullptr};
+        bool defined = false;
+    };
+
+    std::vector<Slot> slots;
+};
+
+// operations on values, shared by all execution backends
+
+struct Equals {
+    auto operator()(const LoxCallable& lhs, const LoxCallable& rhs) -> bool {
+        return lhs.descriptor == rhs.descriptor;
+    }
+    auto operator()(const BuiltinCallable* lhs, const BuiltinCallable* rhs) -> bool { return lhs == rhs; }
+    auto operator()(nullptr_t, nullptr_t) -> bool { return true; }
+    auto operator()(bool lhs, bool rhs) -> bool { return lhs == rhs; }
+    auto operator()(double lhs, double rhs) -> bool { return lhs == rhs; }
+    auto operator()(const LoxString& lhs, const LoxString& rhs) -> bool { return lhs == rhs; }
+    auto operator()(const LoxObject& lhs, const LoxObject& rhs) -> bool { return lhs == rhs; }
+    template <typename T, typename U>
+        requires(!same_as<T, U>)
+    auto operator()(T&&, U&&) -> bool {
+        return false;
+    }
+};
+
+struct Greater {
+    auto operator()(double x, double y) -> bool { return x > y; }
+    auto operator()(auto&&, auto&&) -> bool { throw TypeError("bad operands for greater than"); }
+};
+
+struct GreaterEq {
+    auto operator()(double x, double y) -> bool { return x >= y; }
+    auto operator()(auto&&, auto&&) -> bool { throw TypeError("bad operands for greater equal"); }
+};
+
+struct Less {
+    auto operator()(double x, double y) -> bool { return x < y; }
+    auto operator()(auto&&, auto&&) -> bool { throw TypeError("bad operands for less than"); }
+};
+
+struct LessEq {
+    auto operator()(double x, double y) -> bool { return x <= y; }
+    auto operator()(auto&&, auto&&) -> bool { throw TypeError("bad operands for less equal"); }
+};
+
+struct Not {
+    auto operator()(bool value) -> bool { return !value; }
+    auto operator()(nullptr_t) -> bool { return true; }
+    auto operator()(auto&&) -> bool { return false; }
+};
+
+auto truthy(const Value& v) -> bool { return !utils::visit(Not{}, v); }
+
+struct Plus {
+    auto operator()(double x, double y) -> Value { return Value{x + y}; }
+    auto operator()(any_ref<LoxString> auto&& x, any_ref<LoxString> auto&& y) -> Value {
+        return Value{LoxString::concat(x.view(), y.view())};
+    }
+    auto operator()(auto&&, auto&&) -> Value { throw TypeError("bad operands for addition"); }
+};
+
+struct Times {
+    auto operator()(double x, double y) -> double { return x * y; }
+    auto operator()(auto&&, auto&&) -> double { throw TypeError("bad operands for multiplication"); }
+};
+
+struct Divide {
+    auto operator()(double x, double y) -> double { return x / y; }
+    auto operator()(auto&&, auto&&) -> double { throw TypeError("bad operands for division"); }
+};
+
+struct Minus {
+    auto operator()(double x, double y) -> double { return x - y; }
+    auto operator()(double x) -> double { return -x; }
+    auto operator()(auto&&, auto&&) -> double { throw TypeError("bad operands for subtraction"); }
+    auto operator()(auto&&) -> double { throw TypeError("bad operand for negation"); }
+};
+
+struct ValuePrinter {
+    std::ostream& ostream;
+    void operator()(auto&& x) { ostream << x; }
+    void operator()(bool x) { ostream << std::string_view(x ? "true" : "false"); }
+    void operator()(nullptr_t) { ostream << std::string_view("nil"); }
+    void operator()(const LoxString& x) { ostream << x.view(); }
+    void operator()(const BuiltinCallable* x) {
+        ostream << "<builtin fn: " << std::string_view(x->name) << "#" << x->arity << "@" << &x->fn << ">";
+    }
+    void operator()(const LoxCallable& x) { ostream << "<function>"; }
+    void operator()(const LoxObject& x) {
+        if (const auto* klass = x.as<LoxClass>())
+            ostream << std::string_view(*klass->name);
+        else if (const auto* instance = x.as<LoxInstance>())
+            ostream << std::string_view(*instance->ofClass().name) << " instance";
+        else
+            ostream << "<function>";
+    }
+};
+
+auto operator<<(std::ostream& ostream, const Value& value) -> std::ostream& {
+    utils::visit(ValuePrinter{ostream}, value);
+    return ostream;
+}
+
+auto clock_impl(std::span<Value> vs) -> Value {
+    const static auto t0 = std::chrono::high_resolution_clock::now();
+    auto t = std::chrono::high_resolution_clock::now();
+    return static_cast<double>((t - t0).count()) / 1000000000;
+}
+
+constexpr BuiltinCallable clock_builtin{.fn = clock_impl, .name = "clock", .arity = 0};
 
 } // namespace loxxy
@@ -0,0 +1,282 @@
+module;
+#include "loxxy/ast.hpp"
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+export module ast.compiler;
+import ast;
+import ast.bytecode;
+import ast.resolver;
+import utils.stupid_type_traits;
+import utils.string_store;
+import utils.variant;
+
+using utils::IndirectVisitor;
+
+export namespace loxxy {
+
+// Lowers a slot resolved tree to bytecode for the VM. Chunks live as long as the compiler, since functions created at
+// runtime keep pointing into them.
+template <typename Payload, typename Indirection, bool ptr_variant, typename Resolver = void>
+    requires(SlotResolved<Payload>)
+struct Compiler : IndirectVisitor<Compiler<Payload, Indirection, ptr_variant, Resolver>, Resolver, Indirection> {
+    USING_FAMILY(Payload, Indirection, ptr_variant);
+    using Self = Compiler<Payload, Indirection, ptr_variant, Resolver>;
+    using Parent = IndirectVisitor<Self, Resolver, Indirection>;
+    using Parent::operator();
+    using Parent::Parent;
+
+    auto compile(const std::vector<StmtPointer>& statements) -> const Chunk& {
+        Chunk* script = newChunk();
+        current = script;
+        stack_depth = 0;
+        for (const StmtPointer& statement : statements)
+            utils::visit(*this, statement);
+
+        emit(OpCode::NIL);
+        emit(OpCode::RETURN);
+        return *script;
+    }
+
+    void operator()(const ExpressionStmt& node) {
+        utils::visit(*this, node.expr);
+        emit(OpCode::POP);
+    }
+
+    void operator()(const PrintStmt& node) {
+        utils::visit(*this, node.expr);
+        emit(OpCode::PRINT);
+    }
+
+    void operator()(const VarDecl& node) {
+        if (node.expr.has_value())
+            utils::visit(*this, node.expr.value());
+        else
+            emit(OpCode::NIL);
+
+        define(node.payload, node.identifier);
+    }
+
+    void operator()(const FunDecl& node) {
+        Chunk* function = newChunk();
+        function->name = node.identifier;
+        function->arg_names = node.args;
+        function->frame_size = node.payload.frame_size;
+
+        Chunk* enclosing = std::exchange(current, function);
+        uint32_t enclosing_depth = std::exchange(stack_depth, 0);
+        for (const StmtPointer& statement : node.body)
+            utils::visit(*this, statement);
+
+        emit(OpCode::NIL);
+        emit(OpCode::RETURN);
+        function->descriptor =
+            FunctionDescriptor{node.identifier, function->arg_names, function, function->frame_size, node.line};
+        current = enclosing;
+        stack_depth = enclosing_depth;
+
+        current->functions.push_back(function);
+        emit(OpCode::CLOSURE, current->functions.size() - 1);
+        define(node.payload, node.identifier);
+    }
+
+    void operator()(const BlockStmt& node) {
+        current->frame_size = std::max(current->frame_size, node.payload.frame_size);
+        for (const StmtPointer& statement : node.statements)
+            utils::visit(*this, statement);
+    }
+
+    void operator()(const IfStmt& node) {
+        utils::visit(*this, node.condition);
+        size_t else_jump = emitJump(OpCode::JUMP_IF_FALSE);
+        utils::visit(*this, node.then_branch);
+
+        if (node.else_branch.has_value()) {
+            size_t end_jump = emitJump(OpCode::JUMP);
+            patchJump(else_jump);
+            utils::visit(*this, node.else_branch.value());
+            patchJump(end_jump);
+        } else
+            patchJump(else_jump);
+    }
+
+    void operator()(const WhileStmt& node) {
+        size_t loop_start = current->code.size();
+        utils::visit(*this, node.condition);
+        size_t exit_jump = emitJump(OpCode::JUMP_IF_FALSE);
+        utils::visit(*this, node.body);
+        emit(OpCode::JUMP, loop_start);
+        patchJump(exit_jump);
+    }
+
+    void operator()(const ReturnStmt& node) {
+        utils::visit(*this, node.expr);
+        emit(OpCode::RETURN);
+    }
+
+    void operator()(const BinaryExpr& node) {
+        utils::visit(*this, node.lhs);
+
+        // both short circuit to a bool, like the tree walking interpreter
+        if (node.op.getType() == AND || node.op.getType() == OR) {
+            bool is_and = node.op.getType() == AND;
+            size_t short_circuit = emitJump(is_and ? OpCode::JUMP_IF_FALSE : OpCode::JUMP_IF_TRUE);
+            utils::visit(*this, node.rhs);
+            emit(OpCode::TRUTHY);
+            size_t end_jump = emitJump(OpCode::JUMP);
+
+            patchJump(short_circuit);
+            stack_depth--;
+            emit(is_and ? OpCode::FALSE : OpCode::TRUE);
+            patchJump(end_jump);
+            return;
+        }
+
+        utils::visit(*this, node.rhs);
+        switch (node.op.getType()) {
+        case GREATER:
+            return emit(OpCode::GREATER);
+        case GREATER_EQUAL:
+            return emit(OpCode::GREATER_EQUAL);
+        case LESS:
+            return emit(OpCode::LESS);
+        case LESS_EQUAL:
+            return emit(OpCode::LESS_EQUAL);
+        case EQUAL_EQUAL:
+            return emit(OpCode::EQUAL);
+        case BANG_EQUAL:
+            return emit(OpCode::NOT_EQUAL);
+        case PLUS:
+            return emit(OpCode::ADD);
+        case MINUS:
+            return emit(OpCode::SUBTRACT);
+        case STAR:
+            return emit(OpCode::MULTIPLY);
+        case SLASH:
+            return emit(OpCode::DIVIDE);
+        default:
+            throw std::runtime_error("malformed binary node");
+        }
+    }
+
+    void operator()(const GroupingExpr& node) { utils::visit(*this, node.expr); }
+
+    void operator()(const UnaryExpr& node) {
+        utils::visit(*this, node.expr);
+        switch (node.op.getType()) {
+        case MINUS:
+            return emit(OpCode::NEGATE);
+        case BANG:
+            return emit(OpCode::NOT);
+        default:
+            throw std::runtime_error("malformed unary node");
+        }
+    }
+
+    void operator()(const NumberExpr& node) { emitConstant(Value{node.x}); }
+
+    void operator()(const StringExpr& node) { emitConstant(Value{LoxString{node.string}}); }
+
+    void operator()(const NilExpr& node) { emit(OpCode::NIL); }
+
+    void operator()(const BoolExpr& node) { emit(node.x ? OpCode::TRUE : OpCode::FALSE); }
+
+    void operator()(const VarExpr& node) {
+        if (node.payload.depth == SlotPayload::global)
+            emit(OpCode::GET_GLOBAL, name(node.identifier));
+        else if (node.payload.depth == 0)
+            emit(OpCode::GET_LOCAL, node.payload.slot);
+        else
+            emit(OpCode::GET_OUTER, node.payload.depth, node.payload.slot);
+    }
+
+    void operator()(const AssignExpr& node) {
+        utils::visit(*this, node.expr);
+        if (node.payload.depth == SlotPayload::global)
+            emit(OpCode::SET_GLOBAL, name(node.identifier));
+        else if (node.payload.depth == 0)
+            emit(OpCode::SET_LOCAL, node.payload.slot);
+        else
+            emit(OpCode::SET_OUTER, node.payload.depth, node.payload.slot);
+    }
+
+    void operator()(const CallExpr& node) {
+        utils::visit(*this, node.callee);
+        for (const ExprPointer& arg : node.arguments)
+            utils::visit(*this, arg);
+
+        emit(OpCode::CALL, node.arguments.size());
+        stack_depth -= node.arguments.size();
+    }
+
+    void operator()(const ClassDecl&) { unsupported(); }
+
+    void operator()(const GetExpr&) { unsupported(); }
+
+    void operator()(const SetExpr&) { unsupported(); }
+
+    void operator()(const ThisExpr&) { unsupported(); }
+
+    void operator()(const SuperExpr&) { unsupported(); }
+
+private:
+    [[noreturn]] static void unsupported() { throw std::runtime_error("classes are not supported by the bytecode VM"); }
+
+    auto newChunk() -> Chunk* { return chunks.emplace_back(std::make_unique<Chunk>()).get(); }
+
+    template <std::convertible_to<Operand>... Operands>
+    void emit(OpCode op, Operands... operands) {
+        auto op_index = static_cast<uint8_t>(op);
+        current->code.push_back(op_index);
+        (writeOperand(static_cast<Operand>(operands)), ...);
+
+        stack_depth += opcode_stack_effects[op_index];
+        current->max_stack = std::max(current->max_stack, stack_depth);
+    }
+
+    void writeOperand(Operand operand) {
+        size_t at = current->code.size();
+        current->code.resize(at + sizeof(Operand));
+        write_operand(&current->code[at], operand);
+    }
+
+    auto emitJump(OpCode op) -> size_t {
+        emit(op, Operand{0});
+        return current->code.size() - sizeof(Operand);
+    }
+
+    void patchJump(size_t operand_at) { write_operand(&current->code[operand_at], current->code.size()); }
+
+    void emitConstant(Value&& value) {
+        current->constants.push_back(std::move(value));
+        emit(OpCode::CONSTANT, current->constants.size() - 1);
+    }
+
+    // globals are addressed by the id of their identifier, the chunk remembers the names for error messages
+    auto name(const persistent_string<>* identifier) -> Operand {
+        if (std::find(current->names.begin(), current->names.end(), identifier) == current->names.end())
+            current->names.push_back(identifier);
+
+        return identifier->id;
+    }
+
+    void define(const Payload& payload, const persistent_string<>* identifier) {
+        if (payload.depth == SlotPayload::global)
+            emit(OpCode::DEFINE_GLOBAL, name(identifier));
+        else
+            emit(OpCode::DEFINE_LOCAL, payload.slot);
+    }
+
+    std::vector<std::unique_ptr<Chunk>> chunks;
+    Chunk* current = nullptr;
+    uint32_t stack_depth = 0;
+};
+
+} // namespace loxxy
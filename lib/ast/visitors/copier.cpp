@@ -2,7 +2,10 @@ module;
 #include "loxxy/ast.hpp"
 #include <concepts>
 #include <memory>
+#include <optional>
+#include <type_traits>
 #include <utility>
+#include <vector>
 
 export module ast.copier;
 import ast;
@@ -14,57 +17,157 @@ using utils::IndirectVisitor;
 
 export namespace loxxy {
 
-template <typename Payload, typename Indirection, bool ptr_variant, typename Builder, typename Resolver = void>
+// Rebuilds a tree through any node builder. Passes that rewrite the tree derive from it and pass themselves as
+// Derived, so the copy recurses through their overloads.
+template <
+    typename Payload, typename Indirection, bool ptr_variant, typename Builder, typename Resolver = void,
+    typename Derived = void>
 struct ASTCopier
-    : public IndirectVisitor<ASTCopier<Payload, Indirection, ptr_variant, Builder, Resolver>, Resolver, Indirection> {
+    : public IndirectVisitor<
+          std::conditional_t<
+              std::same_as<Derived, void>, ASTCopier<Payload, Indirection, ptr_variant, Builder, Resolver>, Derived>,
+          Resolver, Indirection> {
     using Target = Family<typename Builder::Payload, typename Builder::Indirection, Builder::ptr_variant>;
+    using TargetExpr = typename Target::ExprPointer;
+    using TargetStmt = typename Target::StmtPointer;
 
-    using Self = ASTCopier<Payload, Indirection, ptr_variant, Builder, Resolver>;
+    using Self = std::conditional_t<
+        std::same_as<Derived, void>, ASTCopier<Payload, Indirection, ptr_variant, Builder, Resolver>, Derived>;
     using Parent = IndirectVisitor<Self, Resolver, Indirection>;
     USING_FAMILY(Payload, Indirection, ptr_variant);
 
     using Parent::operator();
 
-    template <NodeBuilder<Payload, Indirection, ptr_variant> Builder_, typename... Args>
+    template <typename Builder_, typename... Args>
+        requires(NodeBuilder<
+                 std::remove_cvref_t<Builder_>, typename Builder::Payload, typename Builder::Indirection,
+                 Builder::ptr_variant>)
     ASTCopier(Builder_&& builder, Args&&... args)
-        : builder(std::forward<Builder_>(builder)), Parent(std::forward<Args>(args)...) {}
+        : Parent(std::forward<Args>(args)...), builder(std::forward<Builder_>(builder)) {}
 
-    auto operator()(const BinaryExpr& node) {
-        auto copy_lhs = visit(*this, node.lhs);
-        auto copy_rhs = visit(*this, node.rhs);
+    auto operator()(const BinaryExpr& node) -> TargetExpr {
+        TargetExpr lhs = copy(node.lhs);
+        TargetExpr rhs = copy(node.rhs);
 
-        return builder(mark<typename Target::BinaryExpr>, std::move(copy_lhs), std::move(copy_rhs), node.op);
+        return builder(mark<typename Target::BinaryExpr>, std::move(lhs), std::move(rhs), node.op);
     }
 
-    auto operator()(const GroupingExpr& node) {
-        return builder(mark<typename Target::GroupingExpr>, visit(*this, node.expr));
+    auto operator()(const GroupingExpr& node) -> TargetExpr {
+        return builder(mark<typename Target::GroupingExpr>, copy(node.expr));
     }
 
-    auto operator()(const UnaryExpr& node) {
-        return builder(mark<typename Target::UnaryExpr>, visit(*this, node.expr), node.op);
+    auto operator()(const UnaryExpr& node) -> TargetExpr {
+        return builder(mark<typename Target::UnaryExpr>, copy(node.expr), node.op);
     }
 
-    auto operator()(const NumberExpr& node) { return builder(mark<typename Target::NumberExpr>, node.x); }
+    auto operator()(const NumberExpr& node) -> TargetExpr { return builder(mark<typename Target::NumberExpr>, node.x); }
 
-    auto operator()(const StringExpr& node) { return builder(mark<typename Target::StringExpr>, node.string); }
+    auto operator()(const StringExpr& node) -> TargetExpr {
+        return builder(mark<typename Target::StringExpr>, node.string);
+    }
+
+    auto operator()(const BoolExpr& node) -> TargetExpr { return builder(mark<typename Target::BoolExpr>, node.x); }
+
+    auto operator()(const NilExpr&) -> TargetExpr { return builder(mark<typename Target::NilExpr>); }
+
+    auto operator()(const VarExpr& node) -> TargetExpr {
+        return builder(mark<typename Target::VarExpr>, node.identifier);
+    }
+
+    auto operator()(const AssignExpr& node) -> TargetExpr {
+        return builder(mark<typename Target::AssignExpr>, node.identifier, copy(node.expr));
+    }
+
+    auto operator()(const CallExpr& node) -> TargetExpr {
+        TargetExpr callee = copy(node.callee);
+        return builder(mark<typename Target::CallExpr>, std::move(callee), copy(node.arguments));
+    }
 
-    auto operator()(const BoolExpr& node) { return builder(mark<typename Target::BoolExpr>, node.x); }
+    auto operator()(const GetExpr& node) -> TargetExpr {
+        return builder(mark<typename Target::GetExpr>, copy(node.object), node.name);
+    }
 
-    auto operator()(const NilExpr&) { return builder(mark<typename Target::NilExpr>); }
+    auto operator()(const SetExpr& node) -> TargetExpr {
+        TargetExpr object = copy(node.object);
+        return builder(mark<typename Target::SetExpr>, std::move(object), node.name, copy(node.value));
+    }
 
-    auto operator()(const VarExpr& node) { return builder(mark<typename Target::VarExpr>, node.identifier); }
+    auto operator()(const ThisExpr&) -> TargetExpr { return builder(mark<typename Target::ThisExpr>); }
 
-    auto operator()(const AssignExpr& node) {
-        return builder(mark<typename Target::AssignExpr>, node.identifier, node.expr);
+    auto operator()(const SuperExpr& node) -> TargetExpr {
+        return builder(mark<typename Target::SuperExpr>, node.method);
     }
 
-    auto operator()(const ExpressionStmt& node) { return builder(mark<typename Target::ExpressionStmt>, node.expr); }
+    auto operator()(const ExpressionStmt& node) -> TargetStmt {
+        return builder(mark<typename Target::ExpressionStmt>, copy(node.expr));
+    }
+
+    auto operator()(const PrintStmt& node) -> TargetStmt {
+        return builder(mark<typename Target::PrintStmt>, copy(node.expr));
+    }
+
+    auto operator()(const VarDecl& node) -> TargetStmt {
+        return builder(mark<typename Target::VarDecl>, node.identifier, copy(node.expr));
+    }
+
+    auto operator()(const FunDecl& node) -> TargetStmt {
+        return builder(mark<typename Target::FunDecl>, node.identifier, node.args, copy(node.body), node.line);
+    }
 
-    auto operator()(const PrintStmt& node) { return builder(mark<typename Target::PrintStmt>, node.expr); }
+    auto operator()(const BlockStmt& node) -> TargetStmt {
+        return builder(mark<typename Target::BlockStmt>, copy(node.statements));
+    }
+
+    auto operator()(const IfStmt& node) -> TargetStmt {
+        TargetExpr condition = copy(node.condition);
+        TargetStmt then_branch = copy(node.then_branch);
+        return builder(
+            mark<typename Target::IfStmt>, std::move(condition), std::move(then_branch), copy(node.else_branch)
+        );
+    }
+
+    auto operator()(const WhileStmt& node) -> TargetStmt {
+        TargetExpr condition = copy(node.condition);
+        return builder(mark<typename Target::WhileStmt>, std::move(condition), copy(node.body));
+    }
+
+    auto operator()(const ReturnStmt& node) -> TargetStmt {
+        return builder(mark<typename Target::ReturnStmt>, copy(node.expr));
+    }
+
+    auto operator()(const ClassDecl& node) -> TargetStmt {
+        auto superclass = copy(node.superclass);
+        return builder(mark<typename Target::ClassDecl>, node.identifier, std::move(superclass), copy(node.methods));
+    }
+
+    template <typename Node>
+    auto copy(const Node& node) {
+        return utils::visit(self(), node);
+    }
+
+    template <typename Node>
+    auto copy(const std::optional<Node>& node) {
+        using Copy = decltype(copy(node.value()));
+        if (!node.has_value())
+            return std::optional<Copy>{};
+
+        return std::optional<Copy>{copy(node.value())};
+    }
+
+    template <typename Node>
+    auto copy(const std::vector<Node>& nodes) {
+        using Copy = decltype(copy(nodes.front()));
+        std::vector<Copy> copies;
+        copies.reserve(nodes.size());
+        for (const Node& node : nodes)
+            copies.push_back(copy(node));
+
+        return copies;
+    }
 
-    auto operator()(const VarDecl& node) { return builder(mark<typename Target::VarDecl>, node.identifier, node.expr); }
+protected:
+    auto self() -> Self& { return static_cast<Self&>(*this); }
 
-private:
     Builder builder;
 };
 
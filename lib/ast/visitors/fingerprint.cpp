@@ -0,0 +1,133 @@
+module;
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+export module ast.fingerprint;
+import ast;
+import utils.murmurhash;
+import utils.stupid_type_traits;
+import utils.string_store;
+import utils.variant;
+
+using utils::IndirectVisitor;
+using utils::MurmurHash64A;
+using utils::persistent_string;
+
+export namespace loxxy {
+
+// Merkle hash of a tree that is the same in every run of the program, to find what was compiled before. The NodeHash
+// of the HashPayloadBuilder cannot tell: it hashes interned strings by address, and tokens along with their position.
+// A fingerprint covers the contents of strings and only the type of tokens, so moving a function around in the source
+// keeps its fingerprint. Nodes are seeded like NodeHashes are.
+template <typename Payload, typename Indirection, bool ptr_variant, typename Resolver = void>
+struct Fingerprinter
+    : IndirectVisitor<Fingerprinter<Payload, Indirection, ptr_variant, Resolver>, Resolver, Indirection> {
+    using Self = Fingerprinter<Payload, Indirection, ptr_variant, Resolver>;
+    using Parent = IndirectVisitor<Self, Resolver, Indirection>;
+    USING_FAMILY(Payload, Indirection, ptr_variant);
+
+    using Parent::operator();
+    using Parent::Parent;
+
+    auto operator()(const BinaryExpr& node) -> uint64_t {
+        return combine<BinaryExpr>(of(node.lhs), of(node.rhs), node.op.getType());
+    }
+
+    auto operator()(const GroupingExpr& node) -> uint64_t { return combine<GroupingExpr>(of(node.expr)); }
+
+    auto operator()(const UnaryExpr& node) -> uint64_t { return combine<UnaryExpr>(of(node.expr), node.op.getType()); }
+
+    auto operator()(const NumberExpr& node) -> uint64_t { return combine<NumberExpr>(std::bit_cast<uint64_t>(node.x)); }
+
+    auto operator()(const StringExpr& node) -> uint64_t { return combine<StringExpr>(of(node.string)); }
+
+    auto operator()(const BoolExpr& node) -> uint64_t { return combine<BoolExpr>(node.x); }
+
+    auto operator()(const NilExpr&) -> uint64_t { return combine<NilExpr>(); }
+
+    auto operator()(const VarExpr& node) -> uint64_t { return combine<VarExpr>(of(node.identifier)); }
+
+    auto operator()(const AssignExpr& node) -> uint64_t {
+        return combine<AssignExpr>(of(node.identifier), of(node.expr));
+    }
+
+    auto operator()(const CallExpr& node) -> uint64_t {
+        return combine<CallExpr>(of(node.callee), of(node.arguments));
+    }
+
+    auto operator()(const GetExpr& node) -> uint64_t { return combine<GetExpr>(of(node.object), of(node.name)); }
+
+    auto operator()(const SetExpr& node) -> uint64_t {
+        return combine<SetExpr>(of(node.object), of(node.name), of(node.value));
+    }
+
+    auto operator()(const ThisExpr&) -> uint64_t { return combine<ThisExpr>(); }
+
+    auto operator()(const SuperExpr& node) -> uint64_t { return combine<SuperExpr>(of(node.method)); }
+
+    auto operator()(const ExpressionStmt& node) -> uint64_t { return combine<ExpressionStmt>(of(node.expr)); }
+
+    auto operator()(const PrintStmt& node) -> uint64_t { return combine<PrintStmt>(of(node.expr)); }
+
+    auto operator()(const VarDecl& node) -> uint64_t {
+        return combine<VarDecl>(of(node.identifier), of(node.expr));
+    }
+
+    auto operator()(const FunDecl& node) -> uint64_t {
+        return combine<FunDecl>(of(node.identifier), of(node.args), of(node.body));
+    }
+
+    auto operator()(const BlockStmt& node) -> uint64_t { return combine<BlockStmt>(of(node.statements)); }
+
+    auto operator()(const IfStmt& node) -> uint64_t {
+        return combine<IfStmt>(of(node.condition), of(node.then_branch), of(node.else_branch));
+    }
+
+    auto operator()(const WhileStmt& node) -> uint64_t {
+        return combine<WhileStmt>(of(node.condition), of(node.body));
+    }
+
+    auto operator()(const ReturnStmt& node) -> uint64_t { return combine<ReturnStmt>(of(node.expr)); }
+
+    auto operator()(const ClassDecl& node) -> uint64_t {
+        return combine<ClassDecl>(of(node.identifier), of(node.superclass), of(node.methods));
+    }
+
+private:
+    template <typename NodeType, typename... Words>
+    static auto combine(Words... words) -> uint64_t {
+        std::array<uint64_t, sizeof...(Words)> buffer{static_cast<uint64_t>(words)...};
+        return MurmurHash64A(buffer.data(), static_cast<int>(buffer.size() * sizeof(uint64_t)), hash_seed<NodeType>);
+    }
+
+    template <typename Node>
+    auto of(const Node& node) -> uint64_t {
+        return utils::visit(*this, node);
+    }
+
+    // an absent node is not any node
+    template <typename Node>
+    auto of(const std::optional<Node>& node) -> uint64_t {
+        return node.has_value() ? of(node.value()) : 0;
+    }
+
+    template <typename Node>
+    auto of(const std::vector<Node>& nodes) -> uint64_t {
+        std::vector<uint64_t> hashes;
+        hashes.reserve(nodes.size());
+        for (const Node& node : nodes)
+            hashes.push_back(of(node));
+        return MurmurHash64A(hashes.data(), static_cast<int>(hashes.size() * sizeof(uint64_t)), nodes.size());
+    }
+
+    static auto of(const persistent_string<>* string) -> uint64_t {
+        auto chars = std::string_view(*string);
+        return MurmurHash64A(chars.data(), static_cast<int>(chars.size()), 0);
+    }
+};
+
+} // namespace loxxy
@@ -0,0 +1,285 @@
+module;
+#include "loxxy/ast.hpp"
+#include <concepts>
+#include <cstddef>
+#include <optional>
+#include <utility>
+#include <vector>
+
+export module ast.folder;
+import ast;
+import ast.copier;
+import utils.stupid_type_traits;
+import utils.variant;
+
+using utils::IndirectVisitor;
+
+export namespace loxxy {
+
+// Copies a tree while evaluating the expressions whose operands are all literals, and dropping the branches and loops
+// whose conditions are. Run it before resolving, the copy has fresh payloads.
+//
+// Only rewrites that keep the behaviour of the program are applied: an operation that would throw at runtime, like
+// `1 + nil`, stays in the tree, and so do identities like `x + 0` that would hide a type error on `x`.
+template <typename Payload, typename Indirection, bool ptr_variant, typename Builder, typename Resolver = void>
+struct ConstantFolder : ASTCopier<
+                            Payload, Indirection, ptr_variant, Builder, Resolver,
+                            ConstantFolder<Payload, Indirection, ptr_variant, Builder, Resolver>> {
+    using Copier = ASTCopier<Payload, Indirection, ptr_variant, Builder, Resolver, ConstantFolder>;
+    using Target = typename Copier::Target;
+    using TargetExpr = typename Copier::TargetExpr;
+    using TargetStmt = typename Copier::TargetStmt;
+    USING_FAMILY(Payload, Indirection, ptr_variant);
+
+    using Copier::Copier;
+    using Copier::operator();
+
+    auto operator()(const BinaryExpr& node) -> TargetExpr {
+        auto [lhs, lhs_value] = fold(node.lhs);
+
+        // the right operand is never evaluated when the left one decides
+        if (lhs_value.has_value() && (node.op.getType() == AND || node.op.getType() == OR)) {
+            bool lhs_truthy = truthy(lhs_value.value());
+            if (lhs_truthy == (node.op.getType() == OR))
+                return constant(Value{lhs_truthy});
+        }
+
+        auto [rhs, rhs_value] = fold(node.rhs);
+        if (lhs_value.has_value() && rhs_value.has_value()) {
+            std::optional<Value> result = evaluate(node.op.getType(), lhs_value.value(), rhs_value.value());
+            if (result.has_value())
+                return constant(std::move(result.value()));
+        }
+
+        folded = std::nullopt;
+        return this->builder(mark<typename Target::BinaryExpr>, std::move(lhs), std::move(rhs), node.op);
+    }
+
+    // the parser only groups to override precedence, which the tree already encodes
+    auto operator()(const GroupingExpr& node) -> TargetExpr { return utils::visit(*this, node.expr); }
+
+    auto operator()(const UnaryExpr& node) -> TargetExpr {
+        auto [expr, value] = fold(node.expr);
+        if (value.has_value()) {
+            std::optional<Value> result = evaluate(node.op.getType(), value.value());
+            if (result.has_value())
+                return constant(std::move(result.value()));
+        }
+
+        folded = std::nullopt;
+        return this->builder(mark<typename Target::UnaryExpr>, std::move(expr), node.op);
+    }
+
+    auto operator()(const NumberExpr& node) -> TargetExpr { return literal(node, Value{node.x}); }
+
+    auto operator()(const StringExpr& node) -> TargetExpr { return literal(node, Value{LoxString{node.string}}); }
+
+    auto operator()(const BoolExpr& node) -> TargetExpr { return literal(node, Value{node.x}); }
+
+    auto operator()(const NilExpr& node) -> TargetExpr { return literal(node, Value{nullptr}); }
+
+    auto operator()(const VarExpr& node) -> TargetExpr { return opaque(Copier::operator()(node)); }
+
+    auto operator()(const AssignExpr& node) -> TargetExpr { return opaque(Copier::operator()(node)); }
+
+    auto operator()(const CallExpr& node) -> TargetExpr { return opaque(Copier::operator()(node)); }
+
+    auto operator()(const GetExpr& node) -> TargetExpr { return opaque(Copier::operator()(node)); }
+
+    auto operator()(const SetExpr& node) -> TargetExpr { return opaque(Copier::operator()(node)); }
+
+    auto operator()(const ThisExpr& node) -> TargetExpr { return opaque(Copier::operator()(node)); }
+
+    auto operator()(const SuperExpr& node) -> TargetExpr { return opaque(Copier::operator()(node)); }
+
+    auto operator()(const IfStmt& node) -> TargetStmt {
+        auto [condition, value] = fold(node.condition);
+        if (!value.has_value()) {
+            TargetStmt then_branch = this->copy(node.then_branch);
+            return this->builder(
+                mark<typename Target::IfStmt>, std::move(condition), std::move(then_branch),
+                this->copy(node.else_branch)
+            );
+        }
+
+        if (truthy(value.value()))
+            return this->copy(node.then_branch);
+        if (node.else_branch.has_value())
+            return this->copy(node.else_branch.value());
+
+        return empty_statement();
+    }
+
+    auto operator()(const WhileStmt& node) -> TargetStmt {
+        auto [condition, value] = fold(node.condition);
+        if (value.has_value() && !truthy(value.value()))
+            return empty_statement();
+
+        return this->builder(mark<typename Target::WhileStmt>, std::move(condition), this->copy(node.body));
+    }
+
+private:
+    // copies an expression, along with its value if it is known before running the program
+    auto fold(const ExprPointer& expr) -> std::pair<TargetExpr, std::optional<Value>> {
+        TargetExpr copy = utils::visit(*this, expr);
+        return {std::move(copy), std::exchange(folded, std::nullopt)};
+    }
+
+    template <typename Node>
+    auto literal(const Node& node, Value&& value) -> TargetExpr {
+        folded = std::move(value);
+        return Copier::operator()(node);
+    }
+
+    auto opaque(TargetExpr&& expr) -> TargetExpr {
+        folded = std::nullopt;
+        return std::move(expr);
+    }
+
+    auto constant(Value&& value) -> TargetExpr {
+        TargetExpr expr = [&]() -> TargetExpr {
+            if (utils::holds_alternative<double>(value))
+                return this->builder(mark<typename Target::NumberExpr>, utils::get<double>(value));
+            if (utils::holds_alternative<bool>(value))
+                return this->builder(mark<typename Target::BoolExpr>, utils::get<bool>(value));
+
+            return this->builder(mark<typename Target::NilExpr>);
+        }();
+
+        folded = std::move(value);
+        return expr;
+    }
+
+    auto empty_statement() -> TargetStmt {
+        return this->builder(mark<typename Target::BlockStmt>, std::vector<TargetStmt>{});
+    }
+
+    // nullopt if the operation throws, or produces a value that has no literal (a concatenated string)
+    static auto evaluate(TokenType op, const Value& lhs, const Value& rhs) -> std::optional<Value> {
+        try {
+            switch (op) {
+            case GREATER:
+                return Value{utils::visit(Greater{}, lhs, rhs)};
+            case GREATER_EQUAL:
+                return Value{utils::visit(GreaterEq{}, lhs, rhs)};
+            case LESS:
+                return Value{utils::visit(Less{}, lhs, rhs)};
+            case LESS_EQUAL:
+                return Value{utils::visit(LessEq{}, lhs, rhs)};
+            case EQUAL_EQUAL:
+                return Value{utils::visit(Equals{}, lhs, rhs)};
+            case BANG_EQUAL:
+                return Value{!utils::visit(Equals{}, lhs, rhs)};
+            case PLUS: {
+                Value sum = utils::visit(Plus{}, lhs, rhs);
+                if (utils::holds_alternative<LoxString>(sum))
+                    return std::nullopt;
+                return sum;
+            }
+            case MINUS:
+                return Value{utils::visit(Minus{}, lhs, rhs)};
+            case STAR:
+                return Value{utils::visit(Times{}, lhs, rhs)};
+            case SLASH:
+                return Value{utils::visit(Divide{}, lhs, rhs)};
+            case AND:
+            case OR:
+                return Value{truthy(rhs)};
+            default:
+                return std::nullopt;
+            }
+        } catch (const TypeError&) {
+            return std::nullopt;
+        }
+    }
+
+    static auto evaluate(TokenType op, const Value& operand) -> std::optional<Value> {
+        try {
+            switch (op) {
+            case MINUS:
+                return Value{utils::visit(Minus{}, operand)};
+            case BANG:
+                return Value{utils::visit(Not{}, operand)};
+            default:
+                return std::nullopt;
+            }
+        } catch (const TypeError&) {
+            return std::nullopt;
+        }
+    }
+
+    // value of the expression copied last, if it is a constant
+    std::optional<Value> folded;
+};
+
+// Counts the nodes of a tree, to tell how much a pass like the ConstantFolder removed.
+template <typename Payload, typename Indirection, bool ptr_variant, typename Resolver = void>
+struct NodeCounter
+    : IndirectVisitor<NodeCounter<Payload, Indirection, ptr_variant, Resolver>, Resolver, Indirection> {
+    using Self = NodeCounter<Payload, Indirection, ptr_variant, Resolver>;
+    using Parent = IndirectVisitor<Self, Resolver, Indirection>;
+    USING_FAMILY(Payload, Indirection, ptr_variant);
+
+    using Parent::operator();
+    using Parent::Parent;
+
+    auto operator()(const BinaryExpr& node) -> size_t { return 1 + count(node.lhs) + count(node.rhs); }
+
+    auto operator()(const GroupingExpr& node) -> size_t { return 1 + count(node.expr); }
+
+    auto operator()(const UnaryExpr& node) -> size_t { return 1 + count(node.expr); }
+
+    auto operator()(const AssignExpr& node) -> size_t { return 1 + count(node.expr); }
+
+    auto operator()(const CallExpr& node) -> size_t { return 1 + count(node.callee) + count(node.arguments); }
+
+    auto operator()(const GetExpr& node) -> size_t { return 1 + count(node.object); }
+
+    auto operator()(const SetExpr& node) -> size_t { return 1 + count(node.object) + count(node.value); }
+
+    auto operator()(const ExpressionStmt& node) -> size_t { return 1 + count(node.expr); }
+
+    auto operator()(const PrintStmt& node) -> size_t { return 1 + count(node.expr); }
+
+    auto operator()(const VarDecl& node) -> size_t { return 1 + count(node.expr); }
+
+    auto operator()(const FunDecl& node) -> size_t { return 1 + count(node.body); }
+
+    auto operator()(const BlockStmt& node) -> size_t { return 1 + count(node.statements); }
+
+    auto operator()(const IfStmt& node) -> size_t {
+        return 1 + count(node.condition) + count(node.then_branch) + count(node.else_branch);
+    }
+
+    auto operator()(const WhileStmt& node) -> size_t { return 1 + count(node.condition) + count(node.body); }
+
+    auto operator()(const ReturnStmt& node) -> size_t { return 1 + count(node.expr); }
+
+    auto operator()(const ClassDecl& node) -> size_t { return 1 + count(node.superclass) + count(node.methods); }
+
+    // literals and variables
+    template <typename T>
+    auto operator()(const T&) -> size_t {
+        return 1;
+    }
+
+    template <typename Node>
+    auto count(const Node& node) -> size_t {
+        return utils::visit(*this, node);
+    }
+
+    template <typename Node>
+    auto count(const std::optional<Node>& node) -> size_t {
+        return node.has_value() ? count(node.value()) : 0;
+    }
+
+    template <typename Node>
+    auto count(const std::vector<Node>& nodes) -> size_t {
+        size_t n = 0;
+        for (const Node& node : nodes)
+            n += count(node);
+        return n;
+    }
+};
+
+} // namespace loxxy
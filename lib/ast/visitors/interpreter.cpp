@@ -1,21 +1,28 @@
 module;
 #include "loxxy/ast.hpp"
-#include <chrono>
+#include <algorithm>
 #include <concepts>
 #include <cstddef>
+#include <cstdint>
 #include <iostream>
 #include <map>
 #include <optional>
 #include <ranges>
+#include <span>
+#include <sstream>
 #include <stdexcept>
 #include <string>
 #include <string_view>
 #include <type_traits>
+#include <utility>
+#include <unordered_map>
 #include <vector>
 // #include "tsl/htrie_map.h"
 
 export module ast.interpreter;
 import ast;
+import ast.profiler;
+import ast.resolver;
 import utils.stupid_type_traits;
 import utils.string_store;
 import utils.variant;
@@ -28,137 +35,52 @@ using utils::IndirectVisitor;
 
 export namespace loxxy {
 
-struct TypeError : std::runtime_error {
-    using std::runtime_error::runtime_error;
-};
-struct UndefinedVariable : std::runtime_error {
-    using std::runtime_error::runtime_error;
-};
-struct NotCallable : std::runtime_error {
-    using std::runtime_error::runtime_error;
-};
-struct WrongNumberOfArguments : std::runtime_error {
-    using std::runtime_error::runtime_error;
-};
-
-}; // namespace loxxy
-
-using loxxy::TypeError;
-using loxxy::Value;
-
-struct Equals {
-    auto operator()(const loxxy::LoxCallable& lhs, const loxxy::LoxCallable& rhs) -> bool {
-        return lhs.function_body == rhs.function_body;
-    }
-    auto operator()(const loxxy::BuiltinCallable* lhs, const loxxy::BuiltinCallable* rhs) -> bool { return lhs == rhs; }
-    auto operator()(nullptr_t, nullptr_t) -> bool { return true; }
-    auto operator()(bool lhs, bool rhs) -> bool { return lhs == rhs; }
-    auto operator()(double lhs, double rhs) -> bool { return lhs == rhs; }
-    auto operator()(const string& lhs, const string& rhs) -> bool { return lhs == rhs; }
-    template <typename T, typename U>
-        requires(!same_as<T, U>)
-    auto operator()(T&&, U&&) -> bool {
-        return false;
-    }
-};
-
-struct Greater {
-    auto operator()(double x, double y) -> bool { return x > y; }
-    auto operator()(auto&&, auto&&) -> bool { throw TypeError("bad operands for greater than"); }
-};
-
-struct GreaterEq {
-    auto operator()(double x, double y) -> bool { return x >= y; }
-    auto operator()(auto&&, auto&&) -> bool { throw TypeError("bad operands for greater equal"); }
-};
-
-struct Less {
-    auto operator()(double x, double y) -> bool { return x < y; }
-    auto operator()(auto&&, auto&&) -> bool { throw TypeError("bad operands for less than"); }
-};
-
-struct LessEq {
-    auto operator()(double x, double y) -> bool { return x <= y; }
-    auto operator()(auto&&, auto&&) -> bool { throw TypeError("bad operands for less equal"); }
-};
-
-struct Not {
-    auto operator()(bool value) -> bool { return !value; }
-    auto operator()(nullptr_t) -> bool { return true; }
-    auto operator()(auto&&) -> bool { return false; }
+// Tier policy of the Interpreter that runs every function in the interpreter, see TieredJit for one that does not.
+struct NoTier {
+    auto call(const FunctionDescriptor*, std::span<const Value>, bool) -> std::optional<Value> { return std::nullopt; }
+    void backEdge() {}
+    void leave() {}
 };
 
-auto truthy(const Value& v) -> bool { return !utils::visit(Not{}, v); }
-
-struct Plus {
-    auto operator()(double x, double y) -> Value { return Value{x + y}; }
-    auto operator()(any_ref<string> auto&& x, any_ref<string> auto&& y) -> Value { return Value{x + y}; }
-    auto operator()(auto&&, auto&&) -> Value { throw TypeError("bad operands for addition"); }
-};
-
-struct Times {
-    auto operator()(double x, double y) -> double { return x * y; }
-    auto operator()(auto&&, auto&&) -> double { throw TypeError("bad operands for multiplication"); }
-};
-
-struct Divide {
-    auto operator()(double x, double y) -> double { return x / y; }
-    auto operator()(auto&&, auto&&) -> double { throw TypeError("bad operands for division"); }
-};
-
-struct Minus {
-    auto operator()(double x, double y) -> double { return x - y; }
-    auto operator()(double x) -> double { return -x; }
-    auto operator()(auto&&, auto&&) -> double { throw TypeError("bad operands for subtraction"); }
-    auto operator()(auto&&) -> double { throw TypeError("bad operand for negation"); }
-};
-
-export namespace loxxy {
-
-struct ValuePrinter {
-    std::ostream& ostream;
-    void operator()(auto&& x) { ostream << x; }
-    void operator()(bool x) { ostream << std::string_view(x ? "true" : "false"); }
-    void operator()(nullptr_t) { ostream << std::string_view("nil"); }
-    void operator()(const BuiltinCallable* x) {
-        ostream << "<builtin fn: " << std::string_view(x->name) << "#" << x->arity << "@" << &x->fn << ">";
-    }
-    void operator()(const LoxCallable& x) { ostream << "<function>"; }
-};
-
-auto operator<<(std::ostream& ostream, const Value& value) -> std::ostream& {
-    utils::visit(ValuePrinter{ostream}, value);
-    return ostream;
-}
-
-template <typename Payload, typename Indirection, bool ptr_variant, typename Resolver = void>
-struct Interpreter : IndirectVisitor<Interpreter<Payload, Indirection, ptr_variant, Resolver>, Resolver, Indirection> {
+// Profiler gets told about every call of a Lox function and its end, see CallProfiler.
+// Tier is asked first about every call, and may run it in native code instead. The calls it leaves to the interpreter
+// are followed by a leave(), and every iteration of their loops by a backEdge().
+template <
+    typename Payload, typename Indirection, bool ptr_variant, typename Resolver = void, typename Profiler = NoProfiler,
+    typename Tier = NoTier>
+struct Interpreter
+    : IndirectVisitor<
+          Interpreter<Payload, Indirection, ptr_variant, Resolver, Profiler, Tier>, Resolver, Indirection> {
 
     USING_FAMILY(Payload, Indirection, ptr_variant);
-    using Self = Interpreter<Payload, Indirection, ptr_variant, Resolver>;
+    using Self = Interpreter<Payload, Indirection, ptr_variant, Resolver, Profiler, Tier>;
     using Parent = IndirectVisitor<Self, Resolver, Indirection>;
     using Parent::operator();
     using Parent::Parent;
 
     using Adhoc = utils::Adhoc<Resolver, Indirection>;
 
-    static auto _clock_builtin(std::span<loxxy::Value> vs) -> Value {
-        const static auto t0 = std::chrono::high_resolution_clock::now();
-        auto t = std::chrono::high_resolution_clock::now();
-        return static_cast<double>((t - t0).count()) / 1000000000;
-    }
+    // with a SlotResolver having annotated the tree, locals live in flat per-call frames on a single value stack
+    // instead of a map per scope
+    static constexpr bool slot_mode = SlotResolved<Payload>;
 
-    static constexpr BuiltinCallable clock_builtin{.fn = _clock_builtin, .name = "clock", .arity = 0};
+    // what a method runs on besides its arguments: the instance, and the class that declared the method
+    struct Receiver {
+        Value instance;
+        Value holder;
+    };
 
     class Call {
         using Interpreter = Self;
 
     public:
-        Call(const std::span<Value> args, Interpreter& interpreter) : args(args), interpreter(interpreter) {
+        // the arguments are the values on the interpreter's stack from `window` upwards
+        Call(uint32_t window, Interpreter& interpreter) : window(window), interpreter(interpreter) {
             interpreter.return_value = std::nullopt;
         }
 
         auto operator()(const BuiltinCallable* fn) -> Value {
+            std::span<Value> args = std::span(interpreter.stack).subspan(window);
             if (args.size() != fn->arity) {
                 std::stringstream error_msg;
                 error_msg << "got " << args.size() << " arguments, for builtin function '" << fn->name
@@ -169,31 +91,116 @@ struct Interpreter : IndirectVisitor<Interpreter<Payload, Indirection, ptr_varia
             return fn->fn(args);
         }
 
-        auto operator()(const LoxCallable& fn) -> Value {
-            auto body = reinterpret_cast<const std::vector<StmtPointer>*>(fn.function_body);
-            if (fn.arg_names.size() != args.size()) {
+        auto operator()(const LoxCallable& fn) -> Value { return invoke(fn, std::nullopt); }
+
+        auto operator()(const LoxObject& object) -> Value {
+            if (const auto* bound = object.as<LoxBoundMethod>())
+                return invoke(bound->method.function, receiverOf(bound->receiver, bound->method));
+
+            const auto* klass = object.as<LoxClass>();
+            if (klass == nullptr)
+                throw NotCallable("bad callee");
+
+            Value instance{LoxObject{new LoxInstance{object}}};
+            if (klass->initializer.has_value()) {
+                LoxMethod initializer = klass->methods[klass->initializer.value()];
+                invoke(initializer.function, receiverOf(instance, initializer));
+            } else if (interpreter.stack.size() != window) {
                 std::stringstream error_msg;
-                error_msg << "function expects " << fn.arg_names.size() << " arguments, but got " << args.size() << ".";
+                error_msg << "class expects 0 arguments, but got " << interpreter.stack.size() - window << ".";
                 throw WrongNumberOfArguments(error_msg.str());
             }
 
-            interpreter.variables.emplace_back();
-            for (size_t i = 0; i < args.size(); i++) {
-                interpreter.variables.back()[fn.arg_names[i]] = args[i];
-            }
+            return instance;
+        }
 
-            interpreter.return_value = std::nullopt;
-            for (const StmtPointer& statement : *body) {
-                utils::visit(interpreter, statement);
-                if (interpreter.return_value.has_value())
-                    break;
+        // methods get their receiver in the two slots following their arguments
+        auto invoke(const LoxCallable& fn, std::optional<Receiver>&& receiver) -> Value {
+            LoxCallable callee = fn;
+            // tail calls replace the frame and continue here instead of recursing, see ReturnStmt
+            while (true) {
+                const FunctionDescriptor& descriptor = *callee.descriptor;
+                auto body = static_cast<const std::vector<StmtPointer>*>(descriptor.body);
+                size_t n_args = interpreter.stack.size() - window;
+                if (descriptor.arg_names.size() != n_args) {
+                    std::stringstream error_msg;
+                    error_msg << "function expects " << descriptor.arg_names.size() << " arguments, but got "
+                              << n_args << ".";
+                    throw WrongNumberOfArguments(error_msg.str());
+                }
+
+                interpreter.profiler.enter(callee.descriptor);
+                std::span<const Value> args = std::span(interpreter.stack).subspan(window);
+                std::optional<Value> native = interpreter.tier.call(callee.descriptor, args, receiver.has_value());
+                if (native.has_value()) {
+                    interpreter.profiler.leave();
+                    return std::move(native).value();
+                }
+
+                if constexpr (slot_mode) {
+                    interpreter.enterFrame(callee, window);
+                    if (receiver.has_value()) {
+                        interpreter.stack[window + n_args] = std::move(receiver->instance);
+                        interpreter.stack[window + n_args + 1] = std::move(receiver->holder);
+                    }
+                } else {
+                    interpreter.variables.emplace_back();
+                    for (size_t i = 0; i < n_args; i++) {
+                        interpreter.variables.back()[descriptor.arg_names[i]] =
+                            std::move(interpreter.stack[window + i]);
+                    }
+                    if (receiver.has_value())
+                        interpreter.receivers.push_back(std::move(receiver.value()));
+                }
+
+                interpreter.return_value = std::nullopt;
+                for (const StmtPointer& statement : *body) {
+                    utils::visit(interpreter, statement);
+                    if (interpreter.return_value.has_value())
+                        break;
+                }
+
+                if constexpr (slot_mode) {
+                    if (interpreter.tail_callee.has_value()) {
+                        Value next = std::move(interpreter.tail_callee.value());
+                        interpreter.tail_callee = std::nullopt;
+                        interpreter.return_value = std::nullopt;
+                        interpreter.replaceFrame();
+                        interpreter.tier.leave();
+                        interpreter.profiler.leave();
+                        receiver = std::nullopt;
+
+                        // a bound method keeps the loop too, so that methods recursing through this do not nest
+                        if (utils::holds_alternative<LoxObject>(next)) {
+                            if (const auto* bound = utils::get<LoxObject>(next).template as<LoxBoundMethod>()) {
+                                receiver = receiverOf(bound->receiver, bound->method);
+                                callee = bound->method.function;
+                                continue;
+                            }
+                        }
+                        if (!utils::holds_alternative<LoxCallable>(next))
+                            return utils::visit(*this, next);
+
+                        callee = utils::get<LoxCallable>(next);
+                        continue;
+                    }
+                }
+
+                if constexpr (slot_mode)
+                    interpreter.leaveFrame();
+                else {
+                    interpreter.variables.pop_back();
+                    if (receiver.has_value())
+                        interpreter.receivers.pop_back();
+                }
+                interpreter.tier.leave();
+                interpreter.profiler.leave();
+
+                // the caller runs on with no return value pending
+                Value result = std::move(interpreter.return_value).value_or(Value{nullptr});
+                interpreter.return_value = std::nullopt;
+                return result;
             }
-            interpreter.variables.pop_back();
-
-            if (!interpreter.return_value.has_value())
-                interpreter.return_value = nullptr;
-
-            return interpreter.return_value.value();
         }
 
         template <typename T>
@@ -202,17 +209,28 @@ struct Interpreter : IndirectVisitor<Interpreter<Payload, Indirection, ptr_varia
         }
 
     private:
-        const std::span<Value> args;
+        const uint32_t window;
         Interpreter& interpreter;
     };
 
     template <typename... Args>
     Interpreter(const persistent_string<>* clock_id, Args&&... args) : adhoc(std::forward<Args>(args)...) {
-        variables.front().emplace(clock_id, &clock_builtin);
+        globals.define(clock_id, &clock_builtin);
     }
 
     void addBuiltin(const persistent_string<>* identifier, Value&& value) {
-        variables.front().emplace(identifier, std::move(value));
+        globals.define(identifier, std::move(value));
+    }
+
+    auto getProfiler() -> Profiler& { return profiler; }
+
+    auto getTier() -> Tier& { return tier; }
+
+    // lets binary and unary nodes specialize on the operand types they see, see TypeFeedback
+    void enableQuickening()
+        requires(slot_mode)
+    {
+        quickening = true;
     }
 
     void operator()(const ExpressionStmt& node) {
@@ -227,20 +245,53 @@ struct Interpreter : IndirectVisitor<Interpreter<Payload, Indirection, ptr_varia
         if (node.expr.has_value())
             init = utils::visit(*this, node.expr.value());
 
-        variables.back()[node.identifier] = std::move(init);
+        define(node.payload, node.identifier, std::move(init));
     }
 
-    void operator()(const FunDecl& node) {
-        LoxCallable fn{node.args, &node.body};
-        variables.back()[node.identifier] = Value{fn};
+    void operator()(const FunDecl& node) { define(node.payload, node.identifier, Value{makeFunction(node)}); }
+
+    void operator()(const ClassDecl& node) {
+        std::optional<LoxObject> superclass;
+        if (node.superclass.has_value()) {
+            Value value = utils::visit(*this, node.superclass.value());
+            if (!utils::holds_alternative<LoxObject>(value) || utils::get<LoxObject>(value).as<LoxClass>() == nullptr)
+                throw TypeError("superclass must be a class");
+
+            superclass = utils::get<LoxObject>(value);
+        }
+
+        auto* klass = new LoxClass{node.identifier, std::move(superclass)};
+        Value value{LoxObject{klass}};
+
+        auto as_method = adhoc.make_visitor(
+            [](const FunDecl& method) { return &method; },
+            []<typename T>(const T&) -> const FunDecl* { return nullptr; }
+        );
+        for (const StmtPointer& method : node.methods) {
+            const FunDecl& declaration = *utils::visit(as_method, method);
+            klass->addMethod(declaration.identifier, makeFunction(declaration));
+        }
+
+        define(node.payload, node.identifier, std::move(value));
     }
 
     void operator()(const BlockStmt& node) {
-        variables.emplace_back();
-        for (const auto& statement : node.statements) {
-            utils::visit(*this, statement);
+        if constexpr (slot_mode) {
+            reserveSlots(node.payload.frame_size);
+            for (const auto& statement : node.statements) {
+                utils::visit(*this, statement);
+                if (return_value.has_value())
+                    break;
+            }
+        } else {
+            variables.emplace_back();
+            for (const auto& statement : node.statements) {
+                utils::visit(*this, statement);
+                if (return_value.has_value())
+                    break;
+            }
+            variables.pop_back();
         }
-        variables.pop_back();
     }
 
     void operator()(const IfStmt& node) {
@@ -251,11 +302,18 @@ struct Interpreter : IndirectVisitor<Interpreter<Payload, Indirection, ptr_varia
     }
 
     void operator()(const WhileStmt& node) {
-        while (truthy(utils::visit(*this, node.condition)))
+        while (!return_value.has_value() && truthy(utils::visit(*this, node.condition))) {
             utils::visit(*this, node.body);
+            tier.backEdge();
+        }
     }
 
-    void operator()(const ReturnStmt& node) { return_value = utils::visit(*this, node.expr); }
+    void operator()(const ReturnStmt& node) {
+        if constexpr (slot_mode)
+            tail_position = node.payload.tail_call;
+
+        return_value = utils::visit(*this, node.expr);
+    }
 
     template <typename T>
     void operator()(const T&) {}
@@ -269,6 +327,17 @@ struct Interpreter : IndirectVisitor<Interpreter<Payload, Indirection, ptr_varia
             return Value{true};
 
         auto rhs = utils::visit(*this, node.rhs);
+        if constexpr (slot_mode) {
+            TypeFeedback& feedback = node.payload.feedback;
+            if (quickening && feedback.handler != TypeFeedback::generic) {
+                bool numbers = utils::holds_alternative<double>(lhs) && utils::holds_alternative<double>(rhs);
+                if (numbers && feedback.handler != TypeFeedback::warming)
+                    return numeric(feedback.handler, utils::get<double>(lhs), utils::get<double>(rhs));
+
+                observe(feedback, numbers, numericHandler(node.op.getType()));
+            }
+        }
+
         switch (node.op.getType()) {
         case GREATER:
             return Value{utils::visit(Greater{}, lhs, rhs)};
@@ -302,6 +371,19 @@ struct Interpreter : IndirectVisitor<Interpreter<Payload, Indirection, ptr_varia
 
     auto operator()(const UnaryExpr& node) -> Value {
         Value rhs = utils::visit(*this, node.expr);
+        if constexpr (slot_mode) {
+            TypeFeedback& feedback = node.payload.feedback;
+            if (quickening && feedback.handler != TypeFeedback::generic) {
+                bool number = utils::holds_alternative<double>(rhs);
+                if (number && feedback.handler != TypeFeedback::warming)
+                    return Value{-utils::get<double>(rhs)};
+
+                TypeFeedback::Handler specialized =
+                    node.op.getType() == MINUS ? TypeFeedback::negate_number : TypeFeedback::generic;
+                observe(feedback, number, specialized);
+            }
+        }
+
         switch (node.op.getType()) {
         case MINUS:
             return Value{utils::visit(Minus{}, rhs)};
@@ -314,14 +396,14 @@ struct Interpreter : IndirectVisitor<Interpreter<Payload, Indirection, ptr_varia
 
     auto operator()(const NumberExpr& node) -> Value { return Value{node.x}; }
 
-    auto operator()(const StringExpr& node) -> Value { return Value{string(*node.string)}; }
+    auto operator()(const StringExpr& node) -> Value { return Value{LoxString{node.string}}; }
 
     auto operator()(const NilExpr& node) -> Value { return Value{nullptr}; }
 
     auto operator()(const BoolExpr& node) -> Value { return Value{node.x}; }
 
     auto operator()(const VarExpr& node) -> Value {
-        Value* loc = getVarAddress(node.identifier);
+        Value* loc = locate(node.payload, node.identifier);
         if (loc == nullptr) {
             std::string error{};
             error.append(*node.identifier);
@@ -332,7 +414,8 @@ struct Interpreter : IndirectVisitor<Interpreter<Payload, Indirection, ptr_varia
     }
 
     auto operator()(const AssignExpr& node) -> Value {
-        Value* loc = getVarAddress(node.identifier);
+        Value value = utils::visit(*this, node.expr);
+        Value* loc = locate(node.payload, node.identifier);
 
         if (loc == nullptr) {
             std::string error{};
@@ -341,24 +424,323 @@ struct Interpreter : IndirectVisitor<Interpreter<Payload, Indirection, ptr_varia
             throw UndefinedVariable(error);
         }
 
-        *loc = utils::visit(*this, node.expr);
+        *loc = std::move(value);
         return *loc;
     }
 
+    auto operator()(const GetExpr& node) -> Value {
+        Value object = utils::visit(*this, node.object);
+        LoxInstance& instance = instanceOf(object);
+
+        PropertyCache property = findProperty(instance, node.name, node.payload);
+        if (property.kind == PropertyCache::field)
+            return instance.fields[property.index];
+
+        return Value{LoxObject{new LoxBoundMethod{std::move(object), instance.ofClass().methods[property.index]}}};
+    }
+
+    auto operator()(const SetExpr& node) -> Value {
+        Value object = utils::visit(*this, node.object);
+        Value value = utils::visit(*this, node.value);
+        LoxInstance& instance = instanceOf(object);
+
+        if constexpr (slot_mode) {
+            const PropertyCache& cache = node.payload.cache;
+            if (cache.shape == instance.shape->id) {
+                if (cache.kind == PropertyCache::field)
+                    instance.fields[cache.index] = value;
+                else
+                    instance.addField(node.name, Value{value});
+                return value;
+            }
+        }
+
+        PropertyCache property{instance.shape->id};
+        std::optional<uint32_t> field = instance.shape->find(node.name);
+        if (field.has_value()) {
+            property.index = field.value();
+            instance.fields[field.value()] = value;
+        } else {
+            property.index = instance.shape->size();
+            property.kind = PropertyCache::new_field;
+            instance.addField(node.name, Value{value});
+        }
+
+        if constexpr (slot_mode)
+            node.payload.cache = property;
+        return value;
+    }
+
+    auto operator()(const ThisExpr& node) -> Value { return receiverOf(node.payload).instance; }
+
+    auto operator()(const SuperExpr& node) -> Value {
+        Receiver receiver = receiverOf(node.payload);
+        const LoxClass& holder = *utils::get<LoxObject>(receiver.holder).template as<LoxClass>();
+        if (!holder.superclass.has_value())
+            throw TypeError("'super' used in a class without superclass");
+
+        const LoxClass& superclass = *holder.superclass->as<LoxClass>();
+        std::optional<uint32_t> method = superclass.findMethod(node.method);
+        if (!method.has_value())
+            throw undefinedProperty(node.method);
+
+        return Value{LoxObject{new LoxBoundMethod{std::move(receiver.instance), superclass.methods[method.value()]}}};
+    }
+
     auto operator()(const CallExpr& node) -> Value {
-        std::vector<Value> args;
-        args.reserve(node.arguments.size());
+        bool tail_call = std::exchange(tail_position, false);
+
+        // a method that is called right away gets its receiver passed along instead of being bound to it first
+        auto as_property = adhoc.make_visitor(
+            [](const GetExpr& get) { return &get; }, []<typename T>(const T&) -> const GetExpr* { return nullptr; }
+        );
+        const GetExpr* property = tail_call ? nullptr : utils::visit(as_property, node.callee);
+
+        Value callee{nullptr};
+        Value object{nullptr};
+        std::optional<LoxMethod> method;
+        if (property != nullptr) {
+            object = utils::visit(*this, property->object);
+            LoxInstance& instance = instanceOf(object);
+            PropertyCache found = findProperty(instance, property->name, property->payload);
+            if (found.kind == PropertyCache::field)
+                callee = instance.fields[found.index];
+            else
+                method = instance.ofClass().methods[found.index];
+        } else
+            callee = utils::visit(*this, node.callee);
+
+        // arguments are evaluated straight onto the stack, where they become the callee's first slots
+        auto window = static_cast<uint32_t>(stack.size());
         for (const ExprPointer& arg : node.arguments) {
-            args.push_back(utils::visit(*this, arg));
+            Value value = utils::visit(*this, arg);
+            stack.push_back(std::move(value));
         }
 
-        Value callee = utils::visit(*this, node.callee);
-        Call call{args, *this};
+        // the call is made by the Call that is running the current function, once this frame is gone
+        if (tail_call) {
+            tail_callee = std::move(callee);
+            tail_window = window;
+            return Value{nullptr};
+        }
 
-        return utils::visit(call, callee);
+        Call call{window, *this};
+        Value result = method.has_value() ? call.invoke(method->function, receiverOf(std::move(object), method.value()))
+                                          : utils::visit(call, callee);
+        stack.resize(window);
+        return result;
     }
 
 private:
+    // counts down the warm-up of a node, or drops it to the generic path once its specialized handler missed
+    static void observe(TypeFeedback& feedback, bool numbers, TypeFeedback::Handler specialized) {
+        if (feedback.handler != TypeFeedback::warming) {
+            feedback.handler = TypeFeedback::generic;
+            return;
+        }
+
+        feedback.mixed |= !numbers;
+        if (--feedback.warmup == 0)
+            feedback.handler = feedback.mixed ? TypeFeedback::generic : specialized;
+    }
+
+    static auto numericHandler(TokenType op) -> TypeFeedback::Handler {
+        switch (op) {
+        case PLUS:
+            return TypeFeedback::add_numbers;
+        case MINUS:
+            return TypeFeedback::subtract_numbers;
+        case STAR:
+            return TypeFeedback::multiply_numbers;
+        case SLASH:
+            return TypeFeedback::divide_numbers;
+        case GREATER:
+            return TypeFeedback::greater_numbers;
+        case GREATER_EQUAL:
+            return TypeFeedback::greater_equal_numbers;
+        case LESS:
+            return TypeFeedback::less_numbers;
+        case LESS_EQUAL:
+            return TypeFeedback::less_equal_numbers;
+        case EQUAL_EQUAL:
+            return TypeFeedback::equal_numbers;
+        case BANG_EQUAL:
+            return TypeFeedback::not_equal_numbers;
+        default:
+            return TypeFeedback::generic;
+        }
+    }
+
+    static auto numeric(TypeFeedback::Handler handler, double x, double y) -> Value {
+        switch (handler) {
+        case TypeFeedback::add_numbers:
+            return Value{x + y};
+        case TypeFeedback::subtract_numbers:
+            return Value{x - y};
+        case TypeFeedback::multiply_numbers:
+            return Value{x * y};
+        case TypeFeedback::divide_numbers:
+            return Value{x / y};
+        case TypeFeedback::greater_numbers:
+            return Value{x > y};
+        case TypeFeedback::greater_equal_numbers:
+            return Value{x >= y};
+        case TypeFeedback::less_numbers:
+            return Value{x < y};
+        case TypeFeedback::less_equal_numbers:
+            return Value{x <= y};
+        case TypeFeedback::equal_numbers:
+            return Value{x == y};
+        case TypeFeedback::not_equal_numbers:
+            return Value{x != y};
+        default:
+            throw std::runtime_error("not a binary numeric handler");
+        }
+    }
+
+    struct AsInstance {
+        auto operator()(const LoxObject& object) -> LoxInstance* { return object.as<LoxInstance>(); }
+        auto operator()(const auto&) -> LoxInstance* { return nullptr; }
+    };
+
+    static auto instanceOf(const Value& value) -> LoxInstance& {
+        LoxInstance* instance = utils::visit(AsInstance{}, value);
+        if (instance == nullptr)
+            throw TypeError("only instances have properties");
+
+        return *instance;
+    }
+
+    static auto undefinedProperty(const persistent_string<>* name) -> UndefinedProperty {
+        std::string error{"undefined property "};
+        error.append(*name);
+        return UndefinedProperty(error);
+    }
+
+    static auto receiverOf(Value instance, const LoxMethod& method) -> Receiver {
+        return Receiver{std::move(instance), Value{LoxObject::share(method.holder)}};
+    }
+
+    // the receiver of the method a ThisExpr or SuperExpr is in
+    auto receiverOf(const Payload& payload) -> Receiver {
+        if constexpr (slot_mode) {
+            if (payload.depth == SlotPayload::global)
+                throw UndefinedVariable("'this' used outside of a method");
+
+            Value* slots = &slotAddress(payload);
+            return Receiver{slots[0], slots[1]};
+        } else {
+            if (receivers.empty())
+                throw UndefinedVariable("'this' used outside of a method");
+
+            return receivers.back();
+        }
+    }
+
+    // where an instance keeps a property, from the cache of the node if the instance has the shape the node saw last
+    auto findProperty(const LoxInstance& instance, const persistent_string<>* name, const Payload& payload)
+        -> PropertyCache {
+        if constexpr (slot_mode) {
+            if (payload.cache.shape == instance.shape->id)
+                return payload.cache;
+        }
+
+        PropertyCache property{instance.shape->id};
+        if (std::optional<uint32_t> field = instance.shape->find(name); field.has_value())
+            property.index = field.value();
+        else if (std::optional<uint32_t> method = instance.ofClass().findMethod(name); method.has_value()) {
+            property.index = method.value();
+            property.kind = PropertyCache::method;
+        } else
+            throw undefinedProperty(name);
+
+        if constexpr (slot_mode)
+            payload.cache = property;
+        return property;
+    }
+
+    auto makeFunction(const FunDecl& node) -> LoxCallable {
+        uint32_t frame_size = 0;
+        if constexpr (slot_mode)
+            frame_size = node.payload.frame_size;
+
+        FunctionDescriptor descriptor{node.identifier, node.args, &node.body, frame_size, node.line};
+        LoxCallable fn{&descriptors.try_emplace(&node, descriptor).first->second};
+        if constexpr (slot_mode) {
+            fn.static_link = frames.size() - 1;
+            fn.generation = frames.back().generation;
+        }
+
+        return fn;
+    }
+
+    struct Frame {
+        uint32_t base;
+        // frame of the function the callee was declared in, and the generation that frame had at the time
+        uint32_t static_link;
+        uint32_t link_generation;
+        uint32_t generation;
+    };
+
+    void enterFrame(const LoxCallable& fn, uint32_t base) {
+        stack.resize(base + fn.descriptor->frame_size);
+        frames.push_back(Frame{base, fn.static_link, fn.generation, next_generation++});
+    }
+
+    void leaveFrame() {
+        stack.resize(frames.back().base);
+        frames.pop_back();
+    }
+
+    // moves the arguments of the pending tail call down over the current frame, which they replace
+    void replaceFrame() {
+        uint32_t base = frames.back().base;
+        size_t n_args = stack.size() - tail_window;
+        std::move(stack.begin() + tail_window, stack.end(), stack.begin() + base);
+        stack.resize(base + n_args);
+        frames.pop_back();
+    }
+
+    void reserveSlots(uint32_t n_slots) {
+        size_t required = frames.back().base + n_slots;
+        if (stack.size() < required)
+            stack.resize(required);
+    }
+
+    auto slotAddress(const SlotPayload& resolved) -> Value& {
+        const Frame* frame = &frames.back();
+        for (uint32_t depth = resolved.depth; depth > 0; depth--) {
+            if (frame->static_link >= frames.size() || frames[frame->static_link].generation != frame->link_generation)
+                throw UndefinedVariable("closure outlived the function it captures variables from");
+
+            frame = &frames[frame->static_link];
+        }
+
+        return stack[frame->base + resolved.slot];
+    }
+
+    auto locate(const Payload& payload, const persistent_string<>* identifier) -> Value* {
+        if constexpr (slot_mode) {
+            if (payload.depth != SlotPayload::global)
+                return &slotAddress(payload);
+
+            return globals.find(identifier);
+        } else
+            return getVarAddress(identifier);
+    }
+
+    void define(const Payload& payload, const persistent_string<>* identifier, Value&& value) {
+        if constexpr (slot_mode) {
+            if (payload.depth != SlotPayload::global)
+                slotAddress(payload) = std::move(value);
+            else
+                globals.define(identifier, std::move(value));
+        } else if (variables.empty())
+            globals.define(identifier, std::move(value));
+        else
+            variables.back()[identifier] = std::move(value);
+    }
+
     auto getVarAddress(const persistent_string<>* identifier) -> Value* {
         for (auto& env : variables | std::ranges::views::reverse) {
             auto it = env.find(identifier);
@@ -368,11 +750,26 @@ private:
             return &it->second;
         }
 
-        return nullptr;
+        return globals.find(identifier);
     }
 
-    std::vector<std::map<const persistent_string<>*, Value>> variables{1};
+    // scopes of the map mode, innermost last
+    std::vector<std::map<const persistent_string<>*, Value>> variables;
+    // receivers of the running methods in map mode, innermost last
+    std::vector<Receiver> receivers;
+    Globals globals;
+    std::unordered_map<const FunDecl*, FunctionDescriptor> descriptors;
+    std::vector<Value> stack;
+    std::vector<Frame> frames{Frame{0, 0, 0, 0}};
+    uint32_t next_generation = 1;
     std::optional<Value> return_value{};
+    // set while evaluating the expression of a ReturnStmt the SlotResolver marked as a tail call
+    bool tail_position = false;
+    std::optional<Value> tail_callee{};
+    uint32_t tail_window = 0;
+    bool quickening = false;
+    [[no_unique_address]] Profiler profiler;
+    [[no_unique_address]] Tier tier;
     Adhoc adhoc;
 };
 
@@ -1,42 +1,90 @@
 module;
-#include "KaleidoscopeJIT.h"
 #include "loxxy/ast.hpp"
 #include "llvm/ADT/APFloat.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/Analysis/CGSCCPassManager.h"
 #include "llvm/Analysis/LoopAnalysisManager.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/DebugInfo/DIContext.h"
+#include "llvm/DebugInfo/DWARF/DWARFContext.h"
+#include "llvm/ExecutionEngine/JITEventListener.h"
+#include "llvm/ExecutionEngine/JITSymbol.h"
+#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "llvm/ExecutionEngine/Orc/Core.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/ExecutorProcessControl.h"
+#include "llvm/ExecutionEngine/Orc/IRCompileLayer.h"
+#include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include "llvm/ExecutionEngine/Orc/Mangling.h"
+#include "llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/ExecutionEngine/RuntimeDyld.h"
+#include "llvm/ExecutionEngine/SectionMemoryManager.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Constants.h"
+#include "llvm/IR/DIBuilder.h"
+#include "llvm/IR/DebugInfoMetadata.h"
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LegacyPassManager.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/PassInstrumentation.h"
 #include "llvm/IR/PassManager.h"
 #include "llvm/IR/Type.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/Object/SymbolSize.h"
+#include "llvm/Passes/OptimizationLevel.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/StandardInstrumentations.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
 #include "llvm/Target/TargetMachine.h"
-#include "llvm/Transforms/InstCombine/InstCombine.h"
-#include "llvm/Transforms/Scalar.h"
-#include "llvm/Transforms/Scalar/GVN.h"
-#include "llvm/Transforms/Scalar/Reassociate.h"
-#include "llvm/Transforms/Scalar/SimplifyCFG.h"
+#include "llvm/Target/TargetOptions.h"
+#include "llvm/TargetParser/Host.h"
 
+#include <algorithm>
+#include <atomic>
 #include <concepts>
+#include <condition_variable>
 #include <cstddef>
 #include <cstdint>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <iterator>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ranges>
+#include <set>
+#include <span>
 #include <stdexcept>
+#include <stop_token>
 #include <string>
 #include <string_view>
+#include <thread>
+#include <utility>
+#include <unistd.h>
+#include <vector>
 
 export module ast.llvm;
 import ast;
+import ast.fingerprint;
+import runtime;
+import utils.murmurhash;
 import utils.stupid_type_traits;
 import utils.string_store;
 import utils.variant;
@@ -49,6 +97,421 @@ using utils::IndirectVisitor;
 
 export namespace loxxy {
 
+// The JIT of the Kaleidoscope tutorial, which compiles modules eagerly as they are added, along with a way for tools
+// to see the code it loads.
+class LoxJit {
+public:
+    static auto create() -> llvm::Expected<std::unique_ptr<LoxJit>> {
+        llvm::Expected<std::unique_ptr<llvm::orc::SelfExecutorProcessControl>> control =
+            llvm::orc::SelfExecutorProcessControl::Create();
+        if (!control)
+            return control.takeError();
+
+        // the machine createTargetMachine() makes for the host, which the modules are generated for
+        llvm::Expected<llvm::orc::JITTargetMachineBuilder> machine = llvm::orc::JITTargetMachineBuilder::detectHost();
+        if (!machine)
+            return machine.takeError();
+        llvm::Expected<llvm::DataLayout> layout = machine->getDefaultDataLayoutForTarget();
+        if (!layout)
+            return layout.takeError();
+
+        auto session = std::make_unique<llvm::orc::ExecutionSession>(std::move(control.get()));
+        return std::make_unique<LoxJit>(std::move(session), std::move(machine.get()), std::move(layout.get()));
+    }
+
+    LoxJit(
+        std::unique_ptr<llvm::orc::ExecutionSession> session, llvm::orc::JITTargetMachineBuilder machine,
+        llvm::DataLayout layout
+    )
+        : session(std::move(session)), layout(std::move(layout)), mangle(*this->session, this->layout),
+          object_layer(*this->session, [] { return std::make_unique<llvm::SectionMemoryManager>(); }),
+          compile_layer(
+              *this->session, object_layer, std::make_unique<llvm::orc::ConcurrentIRCompiler>(std::move(machine))
+          ),
+          dylib(this->session->createBareJITDylib("<main>")) {
+        dylib.addGenerator(llvm::cantFail(
+            llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(this->layout.getGlobalPrefix())
+        ));
+    }
+
+    LoxJit(const LoxJit&) = delete;
+    auto operator=(const LoxJit&) -> LoxJit& = delete;
+
+    ~LoxJit() {
+        if (llvm::Error error = session->endSession())
+            session->reportError(std::move(error));
+    }
+
+    auto getDataLayout() const -> const llvm::DataLayout& { return layout; }
+
+    auto getMainJITDylib() -> llvm::orc::JITDylib& { return dylib; }
+
+    auto addModule(llvm::orc::ThreadSafeModule module) -> llvm::Error {
+        return compile_layer.add(dylib.getDefaultResourceTracker(), std::move(module));
+    }
+
+    auto lookup(llvm::StringRef name) -> llvm::Expected<llvm::orc::ExecutorSymbolDef> {
+        return session->lookup({&dylib}, mangle(name.str()));
+    }
+
+    // notified of every object file loaded from then on, the listener has to outlive the JIT
+    void registerListener(llvm::JITEventListener& listener) { object_layer.registerJITEventListener(listener); }
+
+private:
+    std::unique_ptr<llvm::orc::ExecutionSession> session;
+    llvm::DataLayout layout;
+    llvm::orc::MangleAndInterner mangle;
+    llvm::orc::RTDyldObjectLinkingLayer object_layer;
+    llvm::orc::IRCompileLayer compile_layer;
+    llvm::orc::JITDylib& dylib;
+};
+
+// Appends the functions of the code JITs load to /tmp/perf-<pid>.map, where perf looks up the addresses it finds in no
+// binary, so samples of compiled Lox functions get their names, along with the line the function is declared at if the
+// debug info has it. One file per process, shared by all of its JITs.
+class PerfMap : public llvm::JITEventListener {
+public:
+    static auto get() -> PerfMap& {
+        static PerfMap map;
+        return map;
+    }
+
+    void notifyObjectLoaded(
+        ObjectKey, const llvm::object::ObjectFile& object, const llvm::RuntimeDyld::LoadedObjectInfo& info
+    ) override {
+        // the symbols of the copy for debuggers have the addresses the sections were loaded at
+        llvm::object::OwningBinary<llvm::object::ObjectFile> loaded = info.getObjectForDebug(object);
+        if (loaded.getBinary() == nullptr)
+            return;
+
+        std::unique_ptr<llvm::DWARFContext> debug_info = llvm::DWARFContext::create(*loaded.getBinary());
+        std::lock_guard lock(mutex);
+        for (const auto& [symbol, size] : llvm::object::computeSymbolSizes(*loaded.getBinary())) {
+            llvm::Expected<llvm::object::SymbolRef::Type> type = symbol.getType();
+            llvm::Expected<llvm::StringRef> name = symbol.getName();
+            llvm::Expected<uint64_t> address = symbol.getAddress();
+            llvm::Expected<llvm::object::section_iterator> section = symbol.getSection();
+            if (!type || !name || !address || !section || type.get() != llvm::object::SymbolRef::ST_Function ||
+                size == 0) {
+                llvm::consumeError(type.takeError());
+                llvm::consumeError(name.takeError());
+                llvm::consumeError(address.takeError());
+                llvm::consumeError(section.takeError());
+                continue;
+            }
+
+            uint64_t section_index = section.get() != loaded.getBinary()->section_end()
+                                         ? section.get()->getIndex()
+                                         : llvm::object::SectionedAddress::UndefSection;
+            // the line of the declaration comes with the name of the function
+            using Kind = llvm::DILineInfoSpecifier::FileLineInfoKind;
+            llvm::DILineInfo line = debug_info->getLineInfoForAddress(
+                {address.get(), section_index}, llvm::DILineInfoSpecifier(Kind::None, llvm::DINameKind::ShortName)
+            );
+            file << std::format("{:x} {:x} {}", address.get(), size, std::string_view(name.get()));
+            if (line.StartLine != 0)
+                file << ":" << line.StartLine;
+            file << "\n";
+        }
+        file.flush();
+    }
+
+private:
+    PerfMap() : file(std::format("/tmp/perf-{}.map", getpid())) {}
+
+    std::mutex mutex;
+    std::ofstream file;
+};
+
+// what createJit() tells profilers about the code it compiles, so that perf can attribute samples to Lox functions
+struct PerfSupport {
+    // names and the lines of their declarations, in the perf map of the process
+    bool map = false;
+    // the jitdump format of `perf inject --jit`, with the code and its line table, which needs an LLVM built with
+    // LLVM_USE_PERF
+    bool jitdump = false;
+};
+
+// A JIT for compiled Lox code, which can call into the runtime.
+auto createJit(PerfSupport perf = {}) -> std::unique_ptr<LoxJit> {
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    llvm::InitializeNativeTargetAsmParser();
+
+    std::unique_ptr<LoxJit> jit = llvm::cantFail(LoxJit::create());
+    if (perf.map)
+        jit->registerListener(PerfMap::get());
+    if (perf.jitdump) {
+        llvm::JITEventListener* jitdump = llvm::JITEventListener::createPerfJITEventListener();
+        if (jitdump == nullptr)
+            throw std::runtime_error("this LLVM was built without jitdump support");
+        jit->registerListener(*jitdump);
+    }
+
+    // the runtime is linked into this executable, its symbols are handed to the JIT directly
+    llvm::orc::JITDylib& dylib = jit->getMainJITDylib();
+    llvm::orc::MangleAndInterner mangle(dylib.getExecutionSession(), jit->getDataLayout());
+    llvm::orc::SymbolMap runtime;
+    auto define = [&](std::string_view name, auto* function) {
+        llvm::orc::ExecutorAddr address = llvm::orc::ExecutorAddr::fromPtr(function);
+        runtime[mangle(name)] = llvm::orc::ExecutorSymbolDef(address, llvm::JITSymbolFlags::Exported);
+    };
+    define("lox_print", &lox_print);
+    define("lox_type_error", &lox_type_error);
+    define("lox_add", &lox_add);
+    define("lox_equal", &lox_equal);
+    define("lox_clock", &lox_clock);
+    llvm::cantFail(dylib.define(llvm::orc::absoluteSymbols(std::move(runtime))));
+
+    return jit;
+}
+
+// What compiled code is generated for: the host, which the JIT runs it on, or any CPU of the host's architecture, for
+// object files that may be shipped elsewhere.
+enum class CodeTarget : uint8_t { host, generic };
+
+// The machine of the target, which the optimizer asks about the costs of instructions and which generates the code.
+// Its code generation level starts out at -O0.
+auto createTargetMachine(CodeTarget target) -> std::unique_ptr<llvm::TargetMachine> {
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+
+    if (target == CodeTarget::host) {
+        llvm::orc::JITTargetMachineBuilder host = llvm::cantFail(llvm::orc::JITTargetMachineBuilder::detectHost());
+        host.setCodeGenOptLevel(llvm::CodeGenOptLevel::None);
+        return llvm::cantFail(host.createTargetMachine());
+    }
+
+    string triple = llvm::sys::getDefaultTargetTriple();
+    string error;
+    const llvm::Target* architecture = llvm::TargetRegistry::lookupTarget(triple, error);
+    if (architecture == nullptr)
+        throw std::runtime_error(error);
+
+    return std::unique_ptr<llvm::TargetMachine>{architecture->createTargetMachine(
+        triple, "generic", "", llvm::TargetOptions{}, llvm::Reloc::PIC_, std::nullopt, llvm::CodeGenOptLevel::None
+    )};
+}
+
+// Functions compiled before, as the optimized bitcode of a module of their own, in files named by a key of everything
+// they were compiled from. A file is written under a name of its own and renamed, so that compilers sharing the
+// directory never read one half written. Bitcode from a different LLVM is not read back, the version is part of keys.
+class CodeCache {
+public:
+    using Bitcode = llvm::SmallVector<char, 0>;
+
+    explicit CodeCache(std::filesystem::path directory) : directory(std::move(directory)) {
+        std::filesystem::create_directories(this->directory);
+    }
+
+    auto load(uint64_t key) const -> std::optional<Bitcode> {
+        std::ifstream file(path(key), std::ios::binary | std::ios::ate);
+        if (!file.is_open()) {
+            misses++;
+            return std::nullopt;
+        }
+
+        Bitcode bitcode(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        file.read(bitcode.data(), static_cast<std::streamsize>(bitcode.size()));
+        const auto* begin = reinterpret_cast<const unsigned char*>(bitcode.data());
+        if (!file || !llvm::isBitcode(begin, begin + bitcode.size())) {
+            misses++;
+            return std::nullopt;
+        }
+
+        hits++;
+        return bitcode;
+    }
+
+    // a cache that cannot be written to is only slower
+    void store(uint64_t key, const Bitcode& bitcode) const {
+        std::filesystem::path target = path(key);
+        std::filesystem::path temporary = target;
+        temporary += std::format(".{}.{}", getpid(), std::hash<std::thread::id>{}(std::this_thread::get_id()));
+
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            file.write(bitcode.data(), static_cast<std::streamsize>(bitcode.size()));
+            if (!file)
+                return;
+        }
+        std::error_code error;
+        std::filesystem::rename(temporary, target, error);
+        if (error)
+            std::filesystem::remove(temporary, error);
+    }
+
+    auto getHits() const -> uint64_t { return hits; }
+    auto getMisses() const -> uint64_t { return misses; }
+
+private:
+    auto path(uint64_t key) const -> std::filesystem::path { return directory / std::format("{:016x}.bc", key); }
+
+    std::filesystem::path directory;
+    mutable std::atomic<uint64_t> hits = 0;
+    mutable std::atomic<uint64_t> misses = 0;
+};
+
+// What is known about the value of an expression when compiling it, which decides how it is represented: as a double,
+// as an i1, or boxed in an i64 with the layout of the runtime.
+enum class StaticType : uint8_t { number, boolean, boxed };
+
+auto binaryType(TokenType op, StaticType lhs, StaticType rhs) -> StaticType {
+    switch (op) {
+    case PLUS:
+        return lhs == StaticType::number && rhs == StaticType::number ? StaticType::number : StaticType::boxed;
+    case MINUS:
+    case STAR:
+    case SLASH:
+        return StaticType::number;
+    default:
+        return StaticType::boolean;
+    }
+}
+
+auto unaryType(TokenType op) -> StaticType { return op == MINUS ? StaticType::number : StaticType::boolean; }
+
+// Finds the locals of a function that are only ever assigned numbers, which the IRGenerator keeps unboxed. Every
+// local with an initializer starts out as one, and those assigned something that may not be a number are dropped
+// until none are left to drop, since assigning one local to another makes it depend on the other. Variables are
+// resolved by scope like the IRGenerator does; parameters and globals always stay boxed.
+template <typename Payload, typename Indirection, bool ptr_variant, typename Resolver = void>
+struct NumericLocals
+    : IndirectVisitor<NumericLocals<Payload, Indirection, ptr_variant, Resolver>, Resolver, Indirection> {
+    USING_FAMILY(Payload, Indirection, ptr_variant);
+    using Self = NumericLocals<Payload, Indirection, ptr_variant, Resolver>;
+    using Parent = IndirectVisitor<Self, Resolver, Indirection>;
+    using Parent::operator();
+    using Parent::Parent;
+
+    auto find(std::span<const persistent_string<>* const> args, const std::vector<StmtPointer>& body)
+        -> std::set<const VarDecl*> {
+        do {
+            changed = false;
+            scopes.assign(1, {});
+            for (const persistent_string<>* arg : args)
+                scopes.back()[arg] = nullptr;
+
+            for (const StmtPointer& stmt : body)
+                utils::visit(*this, stmt);
+        } while (changed);
+
+        return numeric;
+    }
+
+    void operator()(const ExpressionStmt& node) { utils::visit(*this, node.expr); }
+
+    void operator()(const PrintStmt& node) { utils::visit(*this, node.expr); }
+
+    void operator()(const VarDecl& node) {
+        StaticType type = node.expr.has_value() ? utils::visit(*this, node.expr.value()) : StaticType::boxed;
+        bool first = seen.insert(&node).second;
+        if (type != StaticType::number)
+            drop(&node);
+        else if (first)
+            numeric.insert(&node);
+
+        scopes.back()[node.identifier] = &node;
+    }
+
+    // the body is a function of its own
+    void operator()(const FunDecl& node) { scopes.back()[node.identifier] = nullptr; }
+
+    void operator()(const ClassDecl& node) { scopes.back()[node.identifier] = nullptr; }
+
+    void operator()(const BlockStmt& node) {
+        scopes.emplace_back();
+        for (const StmtPointer& stmt : node.statements)
+            utils::visit(*this, stmt);
+        scopes.pop_back();
+    }
+
+    void operator()(const IfStmt& node) {
+        utils::visit(*this, node.condition);
+        utils::visit(*this, node.then_branch);
+        if (node.else_branch.has_value())
+            utils::visit(*this, node.else_branch.value());
+    }
+
+    void operator()(const WhileStmt& node) {
+        utils::visit(*this, node.condition);
+        utils::visit(*this, node.body);
+    }
+
+    void operator()(const ReturnStmt& node) { utils::visit(*this, node.expr); }
+
+    auto operator()(const BinaryExpr& node) -> StaticType {
+        StaticType lhs = utils::visit(*this, node.lhs);
+        StaticType rhs = utils::visit(*this, node.rhs);
+        return binaryType(node.op.getType(), lhs, rhs);
+    }
+
+    auto operator()(const GroupingExpr& node) -> StaticType { return utils::visit(*this, node.expr); }
+
+    auto operator()(const UnaryExpr& node) -> StaticType {
+        utils::visit(*this, node.expr);
+        return unaryType(node.op.getType());
+    }
+
+    auto operator()(const NumberExpr&) -> StaticType { return StaticType::number; }
+
+    auto operator()(const BoolExpr&) -> StaticType { return StaticType::boolean; }
+
+    auto operator()(const VarExpr& node) -> StaticType {
+        return numeric.contains(resolve(node.identifier)) ? StaticType::number : StaticType::boxed;
+    }
+
+    auto operator()(const AssignExpr& node) -> StaticType {
+        StaticType type = utils::visit(*this, node.expr);
+        if (const VarDecl* local = resolve(node.identifier); local != nullptr && type != StaticType::number)
+            drop(local);
+        return type;
+    }
+
+    auto operator()(const CallExpr& node) -> StaticType {
+        for (const ExprPointer& arg : node.arguments)
+            utils::visit(*this, arg);
+        return StaticType::boxed;
+    }
+
+    // strings, nil, and the class nodes the IRGenerator does not compile anyway
+    template <typename T>
+    auto operator()(const T&) -> StaticType {
+        return StaticType::boxed;
+    }
+
+private:
+    auto resolve(const persistent_string<>* identifier) -> const VarDecl* {
+        for (const auto& scope : scopes | std::ranges::views::reverse) {
+            if (auto it = scope.find(identifier); it != scope.end())
+                return it->second;
+        }
+        return nullptr;
+    }
+
+    void drop(const VarDecl* local) {
+        if (numeric.erase(local) > 0)
+            changed = true;
+    }
+
+    // what each name in scope is declared by, nullptr for anything that is not a local
+    std::vector<std::map<const persistent_string<>*, const VarDecl*>> scopes;
+    std::set<const VarDecl*> seen;
+    std::set<const VarDecl*> numeric;
+    bool changed = false;
+};
+
+// Compiles a tree to LLVM IR, and runs it natively with ORC. Top-level statements are collected in a function of
+// their own, which the JIT calls to run the program.
+//
+// Values are boxed in an i64 with the layout of the runtime, which is the one of NanBoxedValue, unless the type of an
+// expression is known when compiling it: numbers then stay unboxed doubles and booleans i1s, and so do the locals
+// NumericLocals finds. Operations check the types of boxed operands inline and handle numbers right there, anything
+// else goes to the runtime. Functions can only be called by name, closures and classes are not supported.
+//
+// The functions of the top-level code can be generated apart, on threads of their own and through a CodeCache, see
+// parallelize(): each of them gets a module in an LLVM context of its own, which is read back into this one as bitcode.
 template <typename Payload, typename Indirection, bool ptr_variant, typename Resolver = void>
 struct IRGenerator : IndirectVisitor<IRGenerator<Payload, Indirection, ptr_variant, Resolver>, Resolver, Indirection> {
 
@@ -60,194 +523,874 @@ struct IRGenerator : IndirectVisitor<IRGenerator<Payload, Indirection, ptr_varia
 
     using Adhoc = utils::Adhoc<Resolver, Indirection>;
 
+    // the code computing an expression, and how it represents the value
+    struct Typed {
+        llvm::Value* value;
+        StaticType type;
+    };
+
     template <typename... Args>
     IRGenerator(Args&&... args) : adhoc(std::forward<Args>(args)...) {
-        fpm.addPass(llvm::InstCombinePass());
-        fpm.addPass(llvm::ReassociatePass());
-        fpm.addPass(llvm::GVNPass());
-        fpm.addPass(llvm::SimplifyCFGPass());
+        setTarget(CodeTarget::host);
 
-        llvm::PassBuilder pass_builder;
-        pass_builder.registerModuleAnalyses(mam);
-        pass_builder.registerFunctionAnalyses(fam);
-        pass_builder.crossRegisterProxies(lam, fam, cgam, mam);
-
-        si.registerCallbacks(pic, &mam);
+        llvm::Function* script = llvm::Function::Create(
+            llvm::FunctionType::get(boxedType(), false), llvm::Function::ExternalLinkage, script_name, *module
+        );
+        builder.SetInsertPoint(llvm::BasicBlock::Create(*context, "entry", script));
+        functions.push_back(FunctionContext{script});
     }
 
-    void operator()(const ExpressionStmt& node) {
-        utils::visit(*this, node.expr);
-        return;
-    }
+    void operator()(const ExpressionStmt& node) { utils::visit(*this, node.expr); }
 
-    void operator()(const PrintStmt& node) {}
+    void operator()(const PrintStmt& node) {
+        llvm::Function* print = runtimeFunction("lox_print", builder.getVoidTy(), {boxedType()});
+        builder.CreateCall(print, {box(utils::visit(*this, node.expr))});
+    }
 
     void operator()(const VarDecl& node) {
-        if (!node.expr.has_value())
-            named_values[node.identifier] = llvm::ConstantFP::get(context, llvm::APFloat(0.0));
-        else
-            named_values[node.identifier] = utils::visit(*this, node.expr.value());
+        Typed value = node.expr.has_value() ? utils::visit(*this, node.expr.value()) : nil();
+        store(declare(node.identifier, functions.back().numeric.contains(&node)), value);
     }
 
     void operator()(const FunDecl& node) {
-        std::vector<llvm::Type*> doubles(node.args.size(), llvm::Type::getDoubleTy(context));
+        // functions declared by the top-level code cannot see any of its locals, so they can be generated apart
+        if (apart && functions.size() == 1 && functions.back().scopes.empty()) {
+            llvm::Function* function = declareFunction(std::string_view(*node.identifier), node.args.size());
+            if (!function->empty() || !offloaded.insert(function).second)
+                throw std::runtime_error(string("the JIT cannot redeclare function ") + string(*node.identifier));
+            // units are cached wherever the function moves, so they carry no lines, finish() adds them
+            lines[function->getName().str()] = node.line;
 
-        llvm::FunctionType* ft = llvm::FunctionType::get(llvm::Type::getDoubleTy(context), doubles, false);
-        llvm::Function* func = llvm::Function::Create(
-            ft, llvm::Function::ExternalLinkage, std::string(std::string_view(*node.identifier)), &module
-        );
+            // the unit has to call the same clock as this module would
+            llvm::Function* clock = module->getFunction("clock");
+            Task task{&node, clock != nullptr ? std::optional(clock->arg_size()) : std::nullopt};
+            if (workers.empty()) {
+                units.push_back(compileUnit(task));
+                return;
+            }
 
-        uint8_t idx = 0;
-        for (auto& arg : func->args()) {
-            arg.setName(std::string_view(*node.args[idx++]));
+            {
+                std::lock_guard lock(mutex);
+                tasks.push_back(task);
+            }
+            queued.notify_one();
+            return;
         }
 
-        llvm::BasicBlock* basic_block = llvm::BasicBlock::Create(context, "entry", func);
-        builder.SetInsertPoint(basic_block);
-
-        named_values.clear();
-
-        idx = 0;
-        for (auto& arg : func->args()) {
-            named_values[node.args[idx++]] = &arg;
-        }
-        return_value = nullptr;
+        compileFunction(node.identifier, node.args, node.body, node.line);
+    }
 
-        for (auto& stmt : node.body) {
+    void operator()(const BlockStmt& node) {
+        functions.back().scopes.emplace_back();
+        for (const StmtPointer& stmt : node.statements)
             utils::visit(*this, stmt);
-            if (return_value)
-                break;
-        }
+        functions.back().scopes.pop_back();
+    }
 
-        if (return_value)
-            builder.CreateRet(return_value);
-        else
-            builder.CreateRetVoid();
+    void operator()(const IfStmt& node) {
+        llvm::Value* condition = truthy(utils::visit(*this, node.condition));
 
-        llvm::verifyFunction(*func);
+        llvm::BasicBlock* then_block = newBlock("then");
+        llvm::BasicBlock* else_block = newBlock("else");
+        llvm::BasicBlock* merge_block = newBlock("endif");
+        builder.CreateCondBr(condition, then_block, else_block);
 
-        fpm.run(*func, fam);
+        builder.SetInsertPoint(then_block);
+        utils::visit(*this, node.then_branch);
+        branchTo(merge_block);
 
-        functions.push_back(func);
+        builder.SetInsertPoint(else_block);
+        if (node.else_branch.has_value())
+            utils::visit(*this, node.else_branch.value());
+        branchTo(merge_block);
+
+        builder.SetInsertPoint(merge_block);
     }
 
-    void operator()(const BlockStmt& node) {}
+    void operator()(const WhileStmt& node) {
+        llvm::BasicBlock* condition_block = newBlock("while");
+        llvm::BasicBlock* body_block = newBlock("loop");
+        llvm::BasicBlock* exit_block = newBlock("endwhile");
+
+        builder.CreateBr(condition_block);
+        builder.SetInsertPoint(condition_block);
+        builder.CreateCondBr(truthy(utils::visit(*this, node.condition)), body_block, exit_block);
 
-    void operator()(const IfStmt& node) {}
+        builder.SetInsertPoint(body_block);
+        utils::visit(*this, node.body);
+        branchTo(condition_block);
 
-    void operator()(const WhileStmt& node) {}
+        builder.SetInsertPoint(exit_block);
+    }
 
-    void operator()(const ReturnStmt& node) { return_value = utils::visit(*this, node.expr); }
+    void operator()(const ReturnStmt& node) {
+        builder.CreateRet(box(utils::visit(*this, node.expr)));
+        // whatever follows the return in the same block is dead, but still needs a block to go into
+        builder.SetInsertPoint(newBlock("unreachable"));
+    }
 
-    template <typename T>
-    void operator()(const T&) {}
+    void operator()(const ClassDecl&) { throw std::runtime_error("classes are not supported by the JIT"); }
 
-    auto operator()(const BinaryExpr& node) -> llvm::Value* {
-        llvm::Value* lhs = utils::visit(*this, node.lhs);
-        llvm::Value* rhs = utils::visit(*this, node.rhs);
+    auto operator()(const BinaryExpr& node) -> Typed {
+        if (node.op.getType() == AND || node.op.getType() == OR)
+            return logical(node);
 
-        if (!lhs || !rhs)
-            return nullptr;
+        Typed lhs = utils::visit(*this, node.lhs);
+        Typed rhs = utils::visit(*this, node.rhs);
 
         switch (node.op.getType()) {
         case GREATER:
-            return builder.CreateFCmpUGT(lhs, rhs, "cmptmp");
+            return compare(llvm::CmpInst::FCMP_OGT, lhs, rhs, "bad operands for greater than");
         case GREATER_EQUAL:
-            return builder.CreateFCmpUGE(lhs, rhs, "cmptmp");
+            return compare(llvm::CmpInst::FCMP_OGE, lhs, rhs, "bad operands for greater equal");
         case LESS:
-            return builder.CreateFCmpULT(lhs, rhs, "cmptmp");
+            return compare(llvm::CmpInst::FCMP_OLT, lhs, rhs, "bad operands for less than");
         case LESS_EQUAL:
-            return builder.CreateFCmpULE(lhs, rhs, "cmptmp");
+            return compare(llvm::CmpInst::FCMP_OLE, lhs, rhs, "bad operands for less equal");
         case EQUAL_EQUAL:
-            return builder.CreateFCmpUEQ(lhs, rhs, "cmptmp");
+            return Typed{equal(lhs, rhs), StaticType::boolean};
         case BANG_EQUAL:
-            return builder.CreateFCmpUNE(lhs, rhs, "cmptmp");
+            return Typed{builder.CreateNot(equal(lhs, rhs), "netmp"), StaticType::boolean};
         case PLUS:
-            return builder.CreateFAdd(lhs, rhs, "addtmp");
+            return add(lhs, rhs);
         case MINUS:
-            return builder.CreateFSub(lhs, rhs, "subtmp");
+            return arithmetic(llvm::Instruction::FSub, lhs, rhs, "bad operands for subtraction");
         case STAR:
-            return builder.CreateFMul(lhs, rhs, "multmp");
+            return arithmetic(llvm::Instruction::FMul, lhs, rhs, "bad operands for multiplication");
         case SLASH:
-            return builder.CreateFDiv(lhs, rhs, "divtmp");
-        case AND:
-            return builder.CreateAnd(lhs, rhs, "conjtmp");
-        case OR:
-            return builder.CreateOr(lhs, rhs, "disjtmp");
+            return arithmetic(llvm::Instruction::FDiv, lhs, rhs, "bad operands for division");
         default:
             throw std::runtime_error("malformed binary node");
         }
     }
 
-    auto operator()(const GroupingExpr& node) -> llvm::Value* { return utils::visit(*this, node.expr); }
+    auto operator()(const GroupingExpr& node) -> Typed { return utils::visit(*this, node.expr); }
 
-    auto operator()(const UnaryExpr& node) -> llvm::Value* {
-        llvm::Value* value = utils::visit(*this, node.expr);
+    auto operator()(const UnaryExpr& node) -> Typed {
+        Typed value = utils::visit(*this, node.expr);
         switch (node.op.getType()) {
         case MINUS:
-            return builder.CreateFSub(llvm::ConstantFP::get(context, llvm::APFloat(0.0)), value);
+            return Typed{builder.CreateFNeg(toNumber(value, "bad operand for negation"), "negtmp"), StaticType::number};
         case BANG:
-            return builder.CreateNot(value);
+            return Typed{builder.CreateNot(truthy(value), "nottmp"), StaticType::boolean};
         default:
             throw std::runtime_error("malformed unary node");
         }
     }
 
-    auto operator()(const NumberExpr& node) -> llvm::Value* {
-        return llvm::ConstantFP::get(context, llvm::APFloat(node.x));
-    }
+    auto operator()(const NumberExpr& node) -> Typed { return Typed{number(node.x), StaticType::number}; }
+
+    auto operator()(const StringExpr& node) -> Typed {
+        llvm::GlobalVariable*& literal = strings[node.string];
+        if (literal == nullptr) {
+            auto chars = std::string_view(*node.string);
+            llvm::StructType* type = llvm::StructType::get(*context, {boxedType(), ptrType()});
+            llvm::Constant* initializer = llvm::ConstantStruct::get(
+                type, {builder.getInt64(chars.size()), builder.CreateGlobalStringPtr(chars, "chars")}
+            );
+            literal = new llvm::GlobalVariable(
+                *module, type, true, llvm::GlobalValue::PrivateLinkage, initializer, "string"
+            );
+            literal->setAlignment(llvm::Align(8));
+        }
 
-    auto operator()(const StringExpr& node) -> llvm::Value* {
-        return llvm::ConstantFP::get(context, llvm::APFloat(0.0));
+        llvm::Value* address = builder.CreatePtrToInt(literal, boxedType());
+        return Typed{builder.CreateOr(address, boxing::string_tag, "stringtmp"), StaticType::boxed};
     }
 
-    auto operator()(const NilExpr& node) -> llvm::Value* { return llvm::ConstantFP::get(context, llvm::APFloat(0.0)); }
+    auto operator()(const NilExpr&) -> Typed { return nil(); }
 
-    auto operator()(const BoolExpr& node) -> llvm::Value* { return llvm::ConstantFP::get(context, llvm::APFloat(0.0)); }
+    auto operator()(const BoolExpr& node) -> Typed { return Typed{builder.getInt1(node.x), StaticType::boolean}; }
 
-    auto operator()(const VarExpr& node) -> llvm::Value* {
-        llvm::Value* value = named_values[node.identifier];
-        return value;
-    }
+    auto operator()(const VarExpr& node) -> Typed { return load(address(node.identifier), node.identifier); }
 
-    auto operator()(const AssignExpr& node) -> llvm::Value* {
-        named_values[node.identifier] = utils::visit(*this, node.expr);
-        return named_values[node.identifier];
+    auto operator()(const AssignExpr& node) -> Typed {
+        Typed value = utils::visit(*this, node.expr);
+        store(address(node.identifier), value);
+        return value;
     }
 
-    auto operator()(const CallExpr& node) -> llvm::Value* {
+    auto operator()(const CallExpr& node) -> Typed {
         auto get_callee = adhoc.make_visitor(
             [](const VarExpr& var) -> const persistent_string<>* { return var.identifier; },
-            []<typename T>(const T&) -> const persistent_string<>* { throw 1; }
+            []<typename T>(const T&) -> const persistent_string<>* {
+                throw std::runtime_error("the JIT can only call functions by name");
+            }
         );
+        const persistent_string<>* identifier = utils::visit(get_callee, node.callee);
 
-        llvm::Function* callee = module.getFunction(std::string_view(*utils::visit(get_callee, node.callee)));
         std::vector<llvm::Value*> args;
-        for (const auto& arg : node.arguments) {
-            args.push_back(utils::visit(*this, arg));
+        for (const auto& arg : node.arguments)
+            args.push_back(box(utils::visit(*this, arg)));
+
+        if (std::string_view(*identifier) == "clock" && args.empty() && module->getFunction("clock") == nullptr) {
+            llvm::Function* clock = runtimeFunction("lox_clock", numberType(), {});
+            return Typed{builder.CreateCall(clock, {}, "clocktmp"), StaticType::number};
         }
 
-        return builder.CreateCall(callee, args, "calltmp");
+        llvm::Function* function = declareFunction(std::string_view(*identifier), args.size());
+        return Typed{builder.CreateCall(function, args, "calltmp"), StaticType::boxed};
+    }
+
+    auto operator()(const GetExpr&) -> Typed { throw std::runtime_error("classes are not supported by the JIT"); }
+
+    auto operator()(const SetExpr&) -> Typed { throw std::runtime_error("classes are not supported by the JIT"); }
+
+    auto operator()(const ThisExpr&) -> Typed { throw std::runtime_error("classes are not supported by the JIT"); }
+
+    auto operator()(const SuperExpr&) -> Typed { throw std::runtime_error("classes are not supported by the JIT"); }
+
+    // ends the top-level code, after which the module is complete
+    void finish() {
+        returnNil();
+        verify(*functions.front().function);
+        linkUnits();
+
+        for (llvm::GlobalVariable& variable : module->globals()) {
+            if (variable.isDeclaration())
+                variable.setInitializer(builder.getInt64(boxing::nil_bits));
+            if (!variable.hasLocalLinkage())
+                variable.setLinkage(llvm::GlobalValue::InternalLinkage);
+        }
+        for (llvm::Function& function : module->functions()) {
+            if (function.isDeclaration() && !function.getName().starts_with("lox_"))
+                throw std::runtime_error("function " + function.getName().str() + " is called but never declared");
+            // only the top-level code is called from outside, which lets the optimizer inline and drop the rest
+            if (!function.isDeclaration() && &function != functions.front().function)
+                function.setLinkage(llvm::GlobalValue::InternalLinkage);
+        }
+        addDebugInfo();
     }
 
-    void printIR() { module.print(llvm::errs(), nullptr); }
+    // the file debug info names as the source of the functions, before finish()
+    void setSourcePath(std::string_view path) { source_path = path; }
+
+    // generates the module for `target`, the host unless set before anything is generated, and the units too if it
+    // is set before parallelize()
+    void setTarget(CodeTarget target) {
+        machine = createTargetMachine(target);
+        module->setTargetTriple(machine->getTargetTriple().str());
+        module->setDataLayout(machine->createDataLayout());
+        this->target = target;
+    }
+
+    // runs the default pipeline of clang at `level` over the whole module, once everything is generated, and makes
+    // the code generator of emitObject() use the level too. Variables live in allocas until then, -O0 keeps them
+    // there. If units were linked in, this is the pipeline clang runs at link time, which is left with inlining across
+    // the units
+    void optimize(llvm::OptimizationLevel level) { runPipeline(linked ? Stage::post_link : Stage::whole, level); }
+
+    // from now on, generates each function the top-level code declares in a module of its own, the unit, on `jobs`
+    // threads or on this one if there are none. Units have contexts of their own and are optimized at `level` ahead of
+    // finish() linking them into this module, so pass the same level to optimize(). With a cache, units compiled
+    // before are loaded from it instead, and the others are stored in it
+    void parallelize(unsigned jobs, llvm::OptimizationLevel level, const CodeCache* cache = nullptr) {
+        apart = true;
+        unit_optimization = level;
+        this->cache = cache;
+        for (unsigned i = 0; i < jobs; i++) {
+            auto& worker = *workers.emplace_back(std::make_unique<Worker>());
+            worker.thread = std::jthread([this, &worker](std::stop_token stop) { work(worker, stop); });
+        }
+    }
+
+    void printIR() { module->print(llvm::errs(), nullptr); }
+
+    // a C entry point that runs the top-level code, for linking the module into an executable. After finish()
+    void addMain() {
+        llvm::Function* main = llvm::Function::Create(
+            llvm::FunctionType::get(builder.getInt32Ty(), false), llvm::Function::ExternalLinkage, "main", *module
+        );
+        builder.SetInsertPoint(llvm::BasicBlock::Create(*context, "entry", main));
+        builder.CreateCall(functions.front().function);
+        builder.CreateRet(builder.getInt32(0));
+        verify(*main);
+    }
+
+    // compiles the finished module to an object file for its target, which calls into the runtime library
+    void emitObject(const string& path) {
+        std::error_code code;
+        llvm::raw_fd_ostream file(path, code, llvm::sys::fs::OF_None);
+        if (code)
+            throw std::runtime_error("could not open " + path + ": " + code.message());
+
+        llvm::legacy::PassManager pass_manager;
+        if (machine->addPassesToEmitFile(pass_manager, file, nullptr, llvm::CodeGenFileType::ObjectFile))
+            throw std::runtime_error("the target cannot emit object files");
+
+        pass_manager.run(*module);
+        file.flush();
+    }
+
+    // compiles the finished module to native code and runs the top-level code. The JIT takes the module over
+    void run(PerfSupport perf = {}) {
+        jit = createJit(perf);
+        if (module->getDataLayout() != jit->getDataLayout())
+            throw std::runtime_error("the JIT runs modules generated for the host only");
+
+        llvm::cantFail(jit->addModule(llvm::orc::ThreadSafeModule(std::move(module), std::move(context))));
+        llvm::orc::ExecutorSymbolDef script = llvm::cantFail(jit->lookup(script_name));
+        script.getAddress().toPtr<uint64_t (*)()>()();
+    }
+
+    // generates a function of the module, for a FunDecl or a function body compiled on its own, declared at `line`
+    auto compileFunction(
+        const persistent_string<>* identifier, std::span<const persistent_string<>* const> args,
+        const std::vector<StmtPointer>& body, int line = 0
+    ) -> llvm::Function* {
+        llvm::Function* function = declareFunction(std::string_view(*identifier), args.size());
+        if (!function->empty() || offloaded.contains(function))
+            throw std::runtime_error(string("the JIT cannot redeclare function ") + string(*identifier));
+        lines[function->getName().str()] = line;
+
+        llvm::IRBuilderBase::InsertPointGuard guard(builder);
+        builder.SetInsertPoint(llvm::BasicBlock::Create(*context, "entry", function));
+        NumericLocals<Payload, Indirection, ptr_variant, Resolver> numeric;
+        functions.push_back(FunctionContext{function, {{}}, numeric.find(args, body)});
+
+        size_t idx = 0;
+        for (llvm::Argument& arg : function->args()) {
+            const persistent_string<>* name = args[idx++];
+            arg.setName(std::string_view(*name));
+            store(declare(name, false), Typed{&arg, StaticType::boxed});
+        }
+
+        for (const StmtPointer& stmt : body)
+            utils::visit(*this, stmt);
+
+        returnNil();
+        functions.pop_back();
+        verify(*function);
+        return function;
+    }
+
+    // hands the module over for a JIT of its own, with only `function` of it: the top-level code is dropped, and
+    // `symbol` is defined as an entry point that takes the boxed arguments as an array, so it can be called from C++
+    // whatever the arity is. The module is optimized at `level`, and modules of functions taken with different symbols
+    // can share a JIT
+    auto takeFunction(
+        llvm::Function* function, const string& symbol, llvm::OptimizationLevel level = llvm::OptimizationLevel::O2
+    ) -> llvm::orc::ThreadSafeModule {
+        functions.front().function->eraseFromParent();
+        functions.clear();
+        // the entry point is the Lox function as much as the function it calls
+        int line = lines[function->getName().str()];
+        lines = {{symbol, line}, {symbol + ".impl", line}};
+        function->setName(symbol + ".impl");
+        function->setLinkage(llvm::GlobalValue::InternalLinkage);
+
+        llvm::Function* entry = llvm::Function::Create(
+            llvm::FunctionType::get(boxedType(), {ptrType()}, false), llvm::Function::ExternalLinkage, symbol, *module
+        );
+        builder.SetInsertPoint(llvm::BasicBlock::Create(*context, "entry", entry));
+
+        std::vector<llvm::Value*> args;
+        for (unsigned idx = 0; idx < function->arg_size(); idx++) {
+            llvm::Value* address = builder.CreateConstInBoundsGEP1_32(boxedType(), entry->getArg(0), idx);
+            args.push_back(builder.CreateLoad(boxedType(), address));
+        }
+        builder.CreateRet(builder.CreateCall(function, args));
+        verify(*entry);
+        addDebugInfo();
+        runPipeline(Stage::whole, level);
+
+        return llvm::orc::ThreadSafeModule(std::move(module), std::move(context));
+    }
 
 private:
-    llvm::LLVMContext context;
-    llvm::IRBuilder<> builder{context};
-    llvm::Module module{"loxxy", context};
-    std::map<const utils::persistent_string<>*, llvm::Value*> named_values;
-    std::vector<llvm::Function*> functions;
-    llvm::Value* return_value = nullptr;
-    llvm::FunctionPassManager fpm;
-    llvm::LoopAnalysisManager lam;
-    llvm::FunctionAnalysisManager fam;
-    llvm::CGSCCAnalysisManager cgam;
-    llvm::ModuleAnalysisManager mam;
-    llvm::PassInstrumentationCallbacks pic;
-    llvm::StandardInstrumentations si{context, true};
+    static constexpr std::string_view script_name = "script.main";
+
+    enum class Stage : uint8_t { whole, pre_link, post_link };
+
+    // bumped whenever the code generated for a function changes, which invalidates what is cached
+    static constexpr uint32_t cache_version = 1;
+
+    // a FunDecl of the top-level code for a unit, and the arity of the clock function it could call, if any
+    struct Task {
+        const FunDecl* declaration;
+        std::optional<size_t> clock;
+    };
+
+    struct Worker {
+        // optimized units, for the context of this module to read back
+        std::vector<CodeCache::Bitcode> units;
+        std::exception_ptr error;
+        std::jthread thread;
+    };
+
+    // a double for the locals known to hold only numbers, a boxed value otherwise
+    struct Variable {
+        llvm::Value* address = nullptr;
+        bool numeric = false;
+    };
+
+    struct FunctionContext {
+        llvm::Function* function;
+        // locals of the blocks being generated, innermost last
+        std::vector<std::map<const persistent_string<>*, Variable>> scopes;
+        std::set<const VarDecl*> numeric;
+    };
+
+    auto numberType() -> llvm::Type* { return builder.getDoubleTy(); }
+    auto boxedType() -> llvm::Type* { return builder.getInt64Ty(); }
+    auto ptrType() -> llvm::Type* { return builder.getPtrTy(); }
+
+    auto number(double x) -> llvm::Value* { return llvm::ConstantFP::get(numberType(), x); }
+    auto nil() -> Typed { return Typed{builder.getInt64(boxing::nil_bits), StaticType::boxed}; }
+
+    auto box(Typed value) -> llvm::Value* {
+        switch (value.type) {
+        case StaticType::number: {
+            // arithmetic may yield NaNs with any payload, collapse them to the one that is not a tag
+            llvm::Value* is_nan = builder.CreateFCmpUNO(value.value, value.value);
+            llvm::Value* x = builder.CreateSelect(is_nan, llvm::ConstantFP::getNaN(numberType()), value.value);
+            return builder.CreateBitCast(x, boxedType(), "boxtmp");
+        }
+        case StaticType::boolean:
+            return builder.CreateSelect(
+                value.value, builder.getInt64(boxing::true_bits), builder.getInt64(boxing::false_bits), "boxtmp"
+            );
+        default:
+            return value.value;
+        }
+    }
+
+    auto isNumber(llvm::Value* boxed) -> llvm::Value* {
+        llvm::Value* nan_bits = builder.CreateAnd(boxed, boxing::qnan);
+        return builder.CreateICmpNE(nan_bits, builder.getInt64(boxing::qnan), "isnumber");
+    }
+
+    // the double in a value, or a type error
+    auto toNumber(Typed value, std::string_view message) -> llvm::Value* {
+        if (value.type == StaticType::number)
+            return value.value;
+
+        llvm::Value* boxed = box(value);
+        llvm::BasicBlock* error_block = newBlock("typeerror");
+        llvm::BasicBlock* number_block = newBlock("number");
+        builder.CreateCondBr(isNumber(boxed), number_block, error_block);
+
+        builder.SetInsertPoint(error_block);
+        builder.CreateCall(typeError(), {errorMessage(message)});
+        builder.CreateUnreachable();
+
+        builder.SetInsertPoint(number_block);
+        return builder.CreateBitCast(boxed, numberType(), "unboxtmp");
+    }
+
+    auto truthy(Typed value) -> llvm::Value* {
+        switch (value.type) {
+        case StaticType::number:
+            return builder.getTrue();
+        case StaticType::boolean:
+            return value.value;
+        default:
+            return builder.CreateAnd(
+                builder.CreateICmpNE(value.value, builder.getInt64(boxing::nil_bits)),
+                builder.CreateICmpNE(value.value, builder.getInt64(boxing::false_bits)), "truthy"
+            );
+        }
+    }
+
+    auto compare(llvm::CmpInst::Predicate predicate, Typed lhs, Typed rhs, std::string_view message) -> Typed {
+        llvm::Value* x = toNumber(lhs, message);
+        llvm::Value* y = toNumber(rhs, message);
+        return Typed{builder.CreateFCmp(predicate, x, y, "cmptmp"), StaticType::boolean};
+    }
+
+    auto arithmetic(llvm::Instruction::BinaryOps op, Typed lhs, Typed rhs, std::string_view message) -> Typed {
+        llvm::Value* x = toNumber(lhs, message);
+        llvm::Value* y = toNumber(rhs, message);
+        return Typed{builder.CreateBinOp(op, x, y, "arithtmp"), StaticType::number};
+    }
+
+    // adds numbers inline, and leaves concatenations and type errors to the runtime
+    auto add(Typed lhs, Typed rhs) -> Typed {
+        if (lhs.type == StaticType::number && rhs.type == StaticType::number)
+            return Typed{builder.CreateFAdd(lhs.value, rhs.value, "addtmp"), StaticType::number};
+
+        llvm::Value* x = box(lhs);
+        llvm::Value* y = box(rhs);
+        llvm::BasicBlock* numbers_block = newBlock("addnumbers");
+        llvm::BasicBlock* runtime_block = newBlock("addruntime");
+        llvm::BasicBlock* merge_block = newBlock("endadd");
+        builder.CreateCondBr(builder.CreateAnd(isNumber(x), isNumber(y)), numbers_block, runtime_block);
+
+        builder.SetInsertPoint(numbers_block);
+        llvm::Value* sum = builder.CreateFAdd(
+            builder.CreateBitCast(x, numberType()), builder.CreateBitCast(y, numberType()), "addtmp"
+        );
+        llvm::Value* boxed_sum = box(Typed{sum, StaticType::number});
+        builder.CreateBr(merge_block);
+
+        builder.SetInsertPoint(runtime_block);
+        llvm::Function* runtime_add = runtimeFunction("lox_add", boxedType(), {boxedType(), boxedType()});
+        llvm::Value* other = builder.CreateCall(runtime_add, {x, y}, "addtmp");
+        builder.CreateBr(merge_block);
+
+        builder.SetInsertPoint(merge_block);
+        llvm::PHINode* result = builder.CreatePHI(boxedType(), 2, "addtmp");
+        result->addIncoming(boxed_sum, numbers_block);
+        result->addIncoming(other, runtime_block);
+        return Typed{result, StaticType::boxed};
+    }
+
+    auto equal(Typed lhs, Typed rhs) -> llvm::Value* {
+        if (lhs.type == StaticType::number && rhs.type == StaticType::number)
+            return builder.CreateFCmpOEQ(lhs.value, rhs.value, "eqtmp");
+        if (lhs.type == StaticType::boolean && rhs.type == StaticType::boolean)
+            return builder.CreateICmpEQ(lhs.value, rhs.value, "eqtmp");
+        if (lhs.type != StaticType::boxed && rhs.type != StaticType::boxed)
+            return builder.getFalse();
+
+        llvm::Function* runtime_equal = runtimeFunction("lox_equal", builder.getInt1Ty(), {boxedType(), boxedType()});
+        return builder.CreateCall(runtime_equal, {box(lhs), box(rhs)}, "eqtmp");
+    }
+
+    // both short circuit to a bool, like the tree walking interpreter
+    auto logical(const BinaryExpr& node) -> Typed {
+        bool is_and = node.op.getType() == AND;
+        llvm::Value* lhs = truthy(utils::visit(*this, node.lhs));
+        llvm::BasicBlock* lhs_block = builder.GetInsertBlock();
+
+        llvm::BasicBlock* rhs_block = newBlock("rhs");
+        llvm::BasicBlock* merge_block = newBlock("endlogic");
+        if (is_and)
+            builder.CreateCondBr(lhs, rhs_block, merge_block);
+        else
+            builder.CreateCondBr(lhs, merge_block, rhs_block);
+
+        builder.SetInsertPoint(rhs_block);
+        llvm::Value* rhs = truthy(utils::visit(*this, node.rhs));
+        llvm::BasicBlock* rhs_end = builder.GetInsertBlock();
+        builder.CreateBr(merge_block);
+
+        builder.SetInsertPoint(merge_block);
+        llvm::PHINode* result = builder.CreatePHI(builder.getInt1Ty(), 2, "logictmp");
+        result->addIncoming(builder.getInt1(!is_and), lhs_block);
+        result->addIncoming(rhs, rhs_end);
+        return Typed{result, StaticType::boolean};
+    }
+
+    auto load(const Variable& variable, const persistent_string<>* identifier) -> Typed {
+        auto name = std::string_view(*identifier);
+        if (variable.numeric)
+            return Typed{builder.CreateLoad(numberType(), variable.address, name), StaticType::number};
+        return Typed{builder.CreateLoad(boxedType(), variable.address, name), StaticType::boxed};
+    }
+
+    void store(const Variable& variable, Typed value) {
+        if (variable.numeric)
+            builder.CreateStore(toNumber(value, "bad value for a numeric local"), variable.address);
+        else
+            builder.CreateStore(box(value), variable.address);
+    }
+
+    auto newBlock(std::string_view name) -> llvm::BasicBlock* {
+        return llvm::BasicBlock::Create(*context, name, functions.back().function);
+    }
+
+    void branchTo(llvm::BasicBlock* block) {
+        if (builder.GetInsertBlock()->getTerminator() == nullptr)
+            builder.CreateBr(block);
+    }
+
+    void returnNil() {
+        if (builder.GetInsertBlock()->getTerminator() == nullptr)
+            builder.CreateRet(nil().value);
+    }
+
+    void runPipeline(Stage stage, llvm::OptimizationLevel level) {
+        machine->setOptLevel(static_cast<llvm::CodeGenOptLevel>(level.getSpeedupLevel()));
+
+        llvm::LoopAnalysisManager lam;
+        llvm::FunctionAnalysisManager fam;
+        llvm::CGSCCAnalysisManager cgam;
+        llvm::ModuleAnalysisManager mam;
+        llvm::PassBuilder pass_builder(machine.get());
+        pass_builder.registerModuleAnalyses(mam);
+        pass_builder.registerCGSCCAnalyses(cgam);
+        pass_builder.registerFunctionAnalyses(fam);
+        pass_builder.registerLoopAnalyses(lam);
+        pass_builder.crossRegisterProxies(lam, fam, cgam, mam);
+
+        llvm::ModulePassManager mpm;
+        if (level == llvm::OptimizationLevel::O0)
+            mpm = pass_builder.buildO0DefaultPipeline(level, stage == Stage::pre_link);
+        else if (stage == Stage::pre_link)
+            mpm = pass_builder.buildLTOPreLinkDefaultPipeline(level);
+        else if (stage == Stage::post_link)
+            mpm = pass_builder.buildLTODefaultPipeline(level, nullptr);
+        else
+            mpm = pass_builder.buildPerModuleDefaultPipeline(level);
+        mpm.run(*module, mam);
+    }
+
+    // a generator for the target of this one, so the units link into its module
+    auto makeUnitGenerator() const -> std::unique_ptr<IRGenerator> {
+        std::unique_ptr<IRGenerator> generator;
+        if constexpr (std::same_as<Resolver, void>)
+            generator = std::make_unique<IRGenerator>();
+        else
+            generator = std::make_unique<IRGenerator>(adhoc.resolver);
+        if (target != CodeTarget::host)
+            generator->setTarget(target);
+        return generator;
+    }
+
+    // runs on the thread of a worker, until finish() stops it and nothing is left to generate
+    void work(Worker& worker, std::stop_token stop) {
+        while (true) {
+            Task task;
+            {
+                std::unique_lock lock(mutex);
+                if (!queued.wait(lock, stop, [this] { return !tasks.empty(); }))
+                    return;
+
+                task = tasks.front();
+                tasks.pop_front();
+            }
+
+            if (worker.error != nullptr)
+                continue;
+            try {
+                worker.units.push_back(compileUnit(task));
+            } catch (...) {
+                // anything escaping the thread would terminate the program, finish() rethrows it instead
+                worker.error = std::current_exception();
+            }
+        }
+    }
+
+    // only reads what does not change once parallelize() returned, so workers can call it
+    auto compileUnit(const Task& task) const -> CodeCache::Bitcode {
+        const FunDecl& declaration = *task.declaration;
+        uint64_t key = 0;
+        if (cache != nullptr) {
+            key = cacheKey(task);
+            if (std::optional<CodeCache::Bitcode> cached = cache->load(key); cached.has_value())
+                return std::move(cached.value());
+        }
+
+        std::unique_ptr<IRGenerator> generator = makeUnitGenerator();
+        if (task.clock.has_value())
+            generator->declareFunction("clock", task.clock.value());
+        generator->compileFunction(declaration.identifier, declaration.args, declaration.body, declaration.line);
+
+        // the unit only defines the function, and refers to everything else
+        generator->functions.front().function->eraseFromParent();
+        generator->functions.clear();
+        generator->runPipeline(Stage::pre_link, unit_optimization);
+
+        CodeCache::Bitcode bitcode;
+        llvm::raw_svector_ostream stream(bitcode);
+        llvm::WriteBitcodeToFile(*generator->module, stream);
+        if (cache != nullptr)
+            cache->store(key, bitcode);
+        return bitcode;
+    }
+
+    // the fingerprint of the function, along with everything else its unit depends on
+    auto cacheKey(const Task& task) const -> uint64_t {
+        uint64_t fingerprint;
+        if constexpr (std::same_as<Resolver, void>)
+            fingerprint = Fingerprinter<Payload, Indirection, ptr_variant>{}(*task.declaration);
+        else
+            fingerprint = Fingerprinter<Payload, Indirection, ptr_variant, Resolver>{adhoc.resolver}(*task.declaration);
+
+        // the optimizer tunes the code to the machine it is generated for
+        string options = std::format(
+            "{} {} {} {} {} {} {} {}", cache_version, LLVM_VERSION_STRING, machine->getTargetTriple().str(),
+            machine->getTargetCPU().str(), machine->getTargetFeatureString().str(), unit_optimization.getSpeedupLevel(),
+            unit_optimization.getSizeLevel(), task.clock.has_value() ? static_cast<int64_t>(task.clock.value()) : -1
+        );
+        return utils::MurmurHash64A(options.data(), static_cast<int>(options.size()), fingerprint);
+    }
+
+    void linkUnits() {
+        std::vector<std::unique_ptr<Worker>> finished = std::move(workers);
+        for (const std::unique_ptr<Worker>& worker : finished)
+            worker->thread.request_stop();
+        for (const std::unique_ptr<Worker>& worker : finished) {
+            worker->thread.join();
+            if (worker->error != nullptr)
+                std::rethrow_exception(worker->error);
+            std::ranges::move(worker->units, std::back_inserter(units));
+        }
+
+        for (const CodeCache::Bitcode& unit : units) {
+            llvm::StringRef bitcode(unit.data(), unit.size());
+            llvm::Expected<std::unique_ptr<llvm::Module>> unit_module =
+                llvm::parseBitcodeFile(llvm::MemoryBufferRef(bitcode, "unit"), *context);
+            if (!unit_module)
+                throw std::runtime_error(llvm::toString(unit_module.takeError()));
+
+            // the linker would only report these through the diagnostics of the context, which exit
+            for (const llvm::Function& function : unit_module.get()->functions()) {
+                const llvm::Function* other = module->getFunction(function.getName());
+                if (other == nullptr)
+                    continue;
+                if (other->arg_size() != function.arg_size())
+                    throw std::runtime_error("wrong number of arguments for function " + function.getName().str());
+                if (!other->isDeclaration() && !function.isDeclaration())
+                    throw std::runtime_error("the JIT cannot redeclare function " + function.getName().str());
+            }
+
+            if (llvm::Linker::linkModules(*module, std::move(unit_module.get())))
+                throw std::runtime_error("could not link the units of the module");
+            linked = true;
+        }
+        units.clear();
+    }
+
+    // describes the functions in DWARF, for debuggers and the jitdumps of perf, which have no other way to tell their
+    // lines. Statements keep no positions, so all code of a function is at the line of its declaration, and the
+    // top-level code at the first one
+    void addDebugInfo() {
+        module->addModuleFlag(llvm::Module::Warning, "Debug Info Version", llvm::DEBUG_METADATA_VERSION);
+        module->addModuleFlag(llvm::Module::Warning, "Dwarf Version", 4);
+
+        llvm::DIBuilder debug_info(*module);
+        std::filesystem::path path(source_path);
+        llvm::DIFile* file = debug_info.createFile(path.filename().string(), path.parent_path().string());
+        llvm::DICompileUnit* unit = debug_info.createCompileUnit(llvm::dwarf::DW_LANG_C, file, "loxxy", false, "", 0);
+        llvm::DISubroutineType* type = debug_info.createSubroutineType(debug_info.getOrCreateTypeArray({}));
+
+        for (llvm::Function& function : module->functions()) {
+            if (function.isDeclaration())
+                continue;
+            auto found = lines.find(function.getName().str());
+            unsigned line = found != lines.end() ? static_cast<unsigned>(found->second) : 1;
+
+            llvm::DISubprogram* subprogram = debug_info.createFunction(
+                unit, function.getName(), "", file, line, type, line, llvm::DINode::FlagZero,
+                llvm::DISubprogram::SPFlagDefinition
+            );
+            function.setSubprogram(subprogram);
+            llvm::DILocation* location = llvm::DILocation::get(*context, line, 0, subprogram);
+            for (llvm::BasicBlock& block : function)
+                for (llvm::Instruction& instruction : block)
+                    instruction.setDebugLoc(location);
+        }
+        debug_info.finalize();
+    }
+
+    void verify(llvm::Function& function) {
+        if (llvm::verifyFunction(function, &llvm::errs()))
+            throw std::runtime_error("generated invalid IR for " + function.getName().str());
+    }
+
+    auto runtimeFunction(std::string_view name, llvm::Type* result, std::vector<llvm::Type*> parameters)
+        -> llvm::Function* {
+        llvm::FunctionType* type = llvm::FunctionType::get(result, parameters, false);
+        return llvm::cast<llvm::Function>(module->getOrInsertFunction(name, type).getCallee());
+    }
+
+    auto typeError() -> llvm::Function* {
+        llvm::Function* function = runtimeFunction("lox_type_error", builder.getVoidTy(), {ptrType()});
+        function->setDoesNotReturn();
+        return function;
+    }
+
+    auto errorMessage(std::string_view message) -> llvm::Constant* {
+        llvm::Constant*& constant = messages[message];
+        if (constant == nullptr)
+            constant = builder.CreateGlobalStringPtr(message, "message");
+        return constant;
+    }
+
+    // functions may be called before they are declared, the first call declares them
+    auto declareFunction(std::string_view name, size_t arity) -> llvm::Function* {
+        llvm::Function* function = module->getFunction(name);
+        if (function == nullptr) {
+            std::vector<llvm::Type*> parameters(arity, boxedType());
+            llvm::FunctionType* type = llvm::FunctionType::get(boxedType(), parameters, false);
+            return llvm::Function::Create(type, llvm::Function::ExternalLinkage, name, *module);
+        }
+
+        if (function->arg_size() != arity)
+            throw std::runtime_error(string("wrong number of arguments for function ") + string(name));
+        return function;
+    }
+
+    // top-level declarations outside of blocks are globals, everything else lives in an alloca of its function
+    auto declare(const persistent_string<>* identifier, bool numeric) -> Variable {
+        FunctionContext& function = functions.back();
+        if (function.scopes.empty())
+            return Variable{global(identifier)};
+
+        Variable& local = function.scopes.back()[identifier];
+        if (local.address == nullptr || local.numeric != numeric) {
+            llvm::BasicBlock& entry = function.function->getEntryBlock();
+            llvm::IRBuilder<> entry_builder(&entry, entry.begin());
+            llvm::Type* type = numeric ? numberType() : boxedType();
+            local = Variable{entry_builder.CreateAlloca(type, nullptr, std::string_view(*identifier)), numeric};
+        }
+        return local;
+    }
+
+    auto address(const persistent_string<>* identifier) -> Variable {
+        for (size_t depth = 0; depth < functions.size(); depth++) {
+            const FunctionContext& function = functions[functions.size() - 1 - depth];
+            for (const auto& scope : function.scopes | std::ranges::views::reverse) {
+                auto it = scope.find(identifier);
+                if (it == scope.end())
+                    continue;
+
+                if (depth > 0)
+                    throw std::runtime_error("closures are not supported by the JIT");
+                return it->second;
+            }
+        }
+
+        return Variable{global(identifier)};
+    }
+
+    // named apart from functions, a Lox identifier cannot contain a dot
+    auto global(const persistent_string<>* identifier) -> llvm::GlobalVariable* {
+        llvm::GlobalVariable*& variable = globals[identifier];
+        if (variable == nullptr) {
+            // only declared, so that the units can refer to the ones of this module. finish() defines them
+            variable = new llvm::GlobalVariable(
+                *module, boxedType(), false, llvm::GlobalValue::ExternalLinkage, nullptr,
+                "global." + string(std::string_view(*identifier))
+            );
+        }
+        return variable;
+    }
+
+    // owns the context and the module once run() handed them over, so it has to be destroyed last
+    std::unique_ptr<LoxJit> jit;
+    std::unique_ptr<llvm::LLVMContext> context = std::make_unique<llvm::LLVMContext>();
+    llvm::IRBuilder<> builder{*context};
+    std::unique_ptr<llvm::Module> module = std::make_unique<llvm::Module>("loxxy", *context);
+    // the function being generated last, the top-level code first
+    std::vector<FunctionContext> functions;
+    std::map<const persistent_string<>*, llvm::GlobalVariable*> globals;
+    std::map<const persistent_string<>*, llvm::GlobalVariable*> strings;
+    std::map<std::string_view, llvm::Constant*> messages;
+    // of the declarations of the functions, by their names in the module
+    std::map<string, int> lines;
+    string source_path = "script.lox";
+    std::unique_ptr<llvm::TargetMachine> machine;
+    CodeTarget target = CodeTarget::host;
 
     Adhoc adhoc;
+
+    // whether functions of the top-level code are generated in units
+    bool apart = false;
+    llvm::OptimizationLevel unit_optimization = llvm::OptimizationLevel::O0;
+    const CodeCache* cache = nullptr;
+    // declarations of the functions the units define
+    std::set<const llvm::Function*> offloaded;
+    // units generated on this thread
+    std::vector<CodeCache::Bitcode> units;
+    bool linked = false;
+    std::mutex mutex;
+    std::condition_variable_any queued;
+    std::deque<Task> tasks;
+    // declared last, so their threads are joined before anything they use is destroyed
+    std::vector<std::unique_ptr<Worker>> workers;
 };
 
 } // namespace loxxy
@@ -70,6 +70,24 @@ struct ASTPrinter : IndirectVisitor<ASTPrinter<Payload, Indirection, ptr_variant
         stream << " ) ) ";
     }
 
+    void operator()(const GetExpr& node) {
+        stream << "GET_EXPR ( ";
+        visit(*this, node.object);
+        stream << " . " << *node.name << " ) ";
+    }
+
+    void operator()(const SetExpr& node) {
+        stream << "SET_EXPR ( ";
+        visit(*this, node.object);
+        stream << " . " << *node.name << " = ";
+        visit(*this, node.value);
+        stream << " ) ";
+    }
+
+    void operator()(const ThisExpr& node) { stream << "this"; }
+
+    void operator()(const SuperExpr& node) { stream << "super." << *node.method; }
+
     void operator()(const PrintStmt& node) {
         stream << "PRINT ( ";
         visit(*this, node.expr);
@@ -144,6 +162,21 @@ struct ASTPrinter : IndirectVisitor<ASTPrinter<Payload, Indirection, ptr_variant
         stream << " ) ";
     }
 
+    void operator()(const ClassDecl& node) {
+        stream << "CLASS_DECL " << *node.identifier;
+        if (node.superclass.has_value()) {
+            stream << " < ";
+            visit(*this, node.superclass.value());
+        }
+        stream << " {\n";
+
+        for (const auto& method : node.methods) {
+            visit(*this, method);
+            stream << "\n";
+        }
+        stream << "}";
+    }
+
 private:
     std::ostream& stream;
 };
@@ -0,0 +1,304 @@
+module;
+#include "loxxy/ast.hpp"
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <utility>
+#include <vector>
+
+export module ast.resolver;
+import ast;
+import utils.stupid_type_traits;
+import utils.string_store;
+import utils.variant;
+
+using utils::IndirectVisitor;
+
+export namespace loxxy {
+
+// Where a GetExpr or SetExpr found its property the last time, valid as long as the object has the same shape.
+struct PropertyCache {
+    enum Kind : uint8_t { field, method, new_field };
+
+    uint32_t shape = Shape::no_id;
+    // index into the fields of the instance, or the methods of its class
+    uint32_t index = 0;
+    Kind kind = field;
+};
+
+// What a BinaryExpr or UnaryExpr learned about its operands while the interpreter quickens. A node first counts down
+// its warm-up, noting whether the operands were ever anything but numbers. If they never were, it switches to a
+// handler specialized for its operator on numbers, which only checks the operand tags. A guard miss drops the node to
+// the generic path for good.
+struct TypeFeedback {
+    enum Handler : uint8_t {
+        warming,
+        generic,
+        add_numbers,
+        subtract_numbers,
+        multiply_numbers,
+        divide_numbers,
+        greater_numbers,
+        greater_equal_numbers,
+        less_numbers,
+        less_equal_numbers,
+        equal_numbers,
+        not_equal_numbers,
+        negate_number,
+    };
+
+    static constexpr uint8_t warmup_evaluations = 8;
+
+    Handler handler = warming;
+    uint8_t warmup = warmup_evaluations;
+    bool mixed = false;
+};
+
+struct SlotPayload {
+    static constexpr uint32_t global = std::numeric_limits<uint32_t>::max();
+
+    // VarExpr, AssignExpr, VarDecl, FunDecl, ClassDecl: number of function frames between the use and the declaration
+    // of the identifier, or `global` if it has to be looked up by name at runtime. ThisExpr, SuperExpr: the frame of
+    // the method they refer to
+    uint32_t depth = global;
+    // index of the variable within that frame. ThisExpr, SuperExpr: the slot of the receiver, followed by the one of
+    // the class that declared the method
+    uint32_t slot = 0;
+    // FunDecl: number of slots a call allocates, BlockStmt: number of slots the enclosing frame needs to hold it
+    uint32_t frame_size = 0;
+    // ReturnStmt: the returned call may replace the current frame instead of nesting inside it
+    bool tail_call = false;
+    // BinaryExpr, UnaryExpr: filled in by the interpreter when quickening
+    mutable TypeFeedback feedback;
+    // GetExpr, SetExpr: filled in by the interpreter as it runs
+    mutable PropertyCache cache;
+};
+
+template <typename T>
+concept SlotResolved = std::derived_from<T, SlotPayload>;
+
+// Annotates every variable reference with the frame and slot it lives in. All blocks of a function share the
+// function's frame, so block scoping only decides which slots can be reused. The top level acts as the outermost
+// function, whose frame holds the locals of top-level blocks. Declarations outside of any block or function are
+// globals.
+template <typename Payload, typename Indirection, bool ptr_variant, typename Resolver = void>
+    requires(SlotResolved<Payload>)
+struct SlotResolver
+    : IndirectVisitor<SlotResolver<Payload, Indirection, ptr_variant, Resolver>, Resolver, Indirection> {
+    USING_FAMILY(Payload, Indirection, ptr_variant);
+    using Self = SlotResolver<Payload, Indirection, ptr_variant, Resolver>;
+    using Parent = IndirectVisitor<Self, Resolver, Indirection>;
+    using Parent::operator();
+
+    using Adhoc = utils::Adhoc<Resolver, Indirection>;
+
+    template <typename... Args>
+    SlotResolver(Args&&... args) : adhoc(std::forward<Args>(args)...) {}
+
+    void operator()(ExpressionStmt& node) { utils::visit(*this, node.expr); }
+
+    void operator()(PrintStmt& node) { utils::visit(*this, node.expr); }
+
+    void operator()(VarDecl& node) {
+        if (node.expr.has_value())
+            utils::visit(*this, node.expr.value());
+
+        declare(node.identifier, node.payload);
+    }
+
+    void operator()(FunDecl& node) {
+        bool method = std::exchange(declaring_method, false);
+        if (!method)
+            declare(node.identifier, node.payload);
+        functions.back().declares_functions = true;
+
+        functions.emplace_back();
+        for (const persistent_string<>* arg : node.args)
+            push_local(arg);
+
+        // hidden slots a call of the method fills with the receiver and the class that declared the method
+        if (method) {
+            functions.back().receiver_slot = static_cast<uint32_t>(node.args.size());
+            push_local(nullptr);
+            push_local(nullptr);
+        }
+
+        for (auto& stmt : node.body)
+            utils::visit(*this, stmt);
+
+        FunctionScope& scope = functions.back();
+        node.payload.frame_size = scope.frame_size;
+        // a closure declared in this function could still need the frame after the tail call replaced it
+        if (!scope.declares_functions) {
+            for (Payload* tail_call : scope.tail_calls)
+                tail_call->tail_call = true;
+        }
+        functions.pop_back();
+    }
+
+    void operator()(ClassDecl& node) {
+        if (node.superclass.has_value())
+            utils::visit(*this, node.superclass.value());
+
+        declare(node.identifier, node.payload);
+        for (auto& method : node.methods) {
+            declaring_method = true;
+            utils::visit(*this, method);
+        }
+    }
+
+    void operator()(BlockStmt& node) {
+        functions.back().block_starts.push_back(functions.back().locals.size());
+        bool declared_before = std::exchange(functions.back().declares_functions, false);
+
+        for (auto& stmt : node.statements)
+            utils::visit(*this, stmt);
+
+        FunctionScope& scope = functions.back();
+        node.payload.frame_size = scope.frame_size;
+        // a function declared in the block can still read its locals once the block ended, so their slots stay taken
+        // instead of going to the blocks that follow
+        if (scope.declares_functions)
+            std::fill(scope.locals.begin() + scope.block_starts.back(), scope.locals.end(), nullptr);
+        else
+            scope.locals.resize(scope.block_starts.back());
+        scope.declares_functions |= declared_before;
+        scope.block_starts.pop_back();
+    }
+
+    void operator()(IfStmt& node) {
+        utils::visit(*this, node.condition);
+        utils::visit(*this, node.then_branch);
+        if (node.else_branch.has_value())
+            utils::visit(*this, node.else_branch.value());
+    }
+
+    void operator()(WhileStmt& node) {
+        utils::visit(*this, node.condition);
+        utils::visit(*this, node.body);
+    }
+
+    void operator()(ReturnStmt& node) {
+        utils::visit(*this, node.expr);
+
+        auto is_call = adhoc.make_visitor(
+            [](const CallExpr&) { return true; }, []<typename T>(const T&) { return false; }
+        );
+        if (functions.size() > 1 && utils::visit(is_call, node.expr))
+            functions.back().tail_calls.push_back(&node.payload);
+    }
+
+    void operator()(BinaryExpr& node) {
+        utils::visit(*this, node.lhs);
+        utils::visit(*this, node.rhs);
+    }
+
+    void operator()(GroupingExpr& node) { utils::visit(*this, node.expr); }
+
+    void operator()(UnaryExpr& node) { utils::visit(*this, node.expr); }
+
+    void operator()(VarExpr& node) { resolve(node.identifier, node.payload); }
+
+    void operator()(AssignExpr& node) {
+        utils::visit(*this, node.expr);
+        resolve(node.identifier, node.payload);
+    }
+
+    void operator()(CallExpr& node) {
+        utils::visit(*this, node.callee);
+        for (auto& arg : node.arguments)
+            utils::visit(*this, arg);
+    }
+
+    void operator()(GetExpr& node) { utils::visit(*this, node.object); }
+
+    void operator()(SetExpr& node) {
+        utils::visit(*this, node.object);
+        utils::visit(*this, node.value);
+    }
+
+    void operator()(ThisExpr& node) { resolveReceiver(node.payload); }
+
+    void operator()(SuperExpr& node) { resolveReceiver(node.payload); }
+
+    template <LiteralSTN T>
+    void operator()(T&) {}
+
+private:
+    struct FunctionScope {
+        std::vector<const persistent_string<>*> locals;
+        std::vector<size_t> block_starts;
+        uint32_t frame_size = 0;
+        std::vector<Payload*> tail_calls;
+        // functions were declared in the innermost block so far, or in the function once its blocks ended
+        bool declares_functions = false;
+        // set for methods
+        std::optional<uint32_t> receiver_slot;
+    };
+
+    void push_local(const persistent_string<>* identifier) {
+        FunctionScope& scope = functions.back();
+        scope.locals.push_back(identifier);
+        scope.frame_size = std::max(scope.frame_size, static_cast<uint32_t>(scope.locals.size()));
+    }
+
+    void declare(const persistent_string<>* identifier, Payload& payload) {
+        FunctionScope& scope = functions.back();
+        if (functions.size() == 1 && scope.block_starts.empty()) {
+            payload.depth = SlotPayload::global;
+            return;
+        }
+
+        size_t block_start = scope.block_starts.empty() ? 0 : scope.block_starts.back();
+        auto it = std::find(scope.locals.begin() + block_start, scope.locals.end(), identifier);
+        if (it == scope.locals.end()) {
+            push_local(identifier);
+            it = scope.locals.end() - 1;
+        }
+
+        payload.depth = 0;
+        payload.slot = it - scope.locals.begin();
+    }
+
+    void resolve(const persistent_string<>* identifier, Payload& payload) {
+        for (size_t depth = 0; depth < functions.size(); depth++) {
+            const FunctionScope& scope = functions[functions.size() - 1 - depth];
+            for (size_t slot = scope.locals.size(); slot-- > 0;) {
+                if (scope.locals[slot] != identifier)
+                    continue;
+
+                payload.depth = depth;
+                payload.slot = slot;
+                return;
+            }
+        }
+
+        payload.depth = SlotPayload::global;
+    }
+
+    // the receiver of the innermost method, which closures declared inside it capture like any variable. Outside of
+    // methods the payload stays `global`, which the interpreter reports
+    void resolveReceiver(Payload& payload) {
+        for (size_t depth = 0; depth < functions.size(); depth++) {
+            const FunctionScope& scope = functions[functions.size() - 1 - depth];
+            if (!scope.receiver_slot.has_value())
+                continue;
+
+            payload.depth = depth;
+            payload.slot = scope.receiver_slot.value();
+            return;
+        }
+
+        payload.depth = SlotPayload::global;
+    }
+
+    std::vector<FunctionScope> functions{1};
+    // the next FunDecl is a method of a ClassDecl
+    bool declaring_method = false;
+    Adhoc adhoc;
+};
+
+} // namespace loxxy
@@ -1,15 +1,23 @@
 module;
 
+#include <algorithm>
 #include <array>
+#include <bit>
+#include <charconv>
+#include <cmath>
 #include <concepts>
 #include <cstddef>
+#include <cstdint>
 #include <cstring>
 #include <filesystem>
 #include <fstream>
-#include <functional>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <optional>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <type_traits>
 #include <utility>
 #include <vector>
@@ -19,6 +27,9 @@ module;
 export module lexer;
 
 import ast;
+import utils.generic_stream;
+import utils.scan;
+import utils.source;
 import utils.string_store;
 
 using namespace utils;
@@ -37,6 +48,59 @@ struct CompileTimeInit {
     byte* bang_equal;
 };
 
+// in the order of their token types, from AND on
+inline constexpr std::array<std::string_view, loxxy::WHILE - loxxy::AND + 1> keywords{
+    "and", "class", "else", "false", "for", "fun", "if", "nil", "or", "print", "return", "super", "this", "true", "var",
+    "while"
+};
+
+inline constexpr size_t min_keyword_length = std::ranges::min(keywords, {}, &std::string_view::size).size();
+inline constexpr size_t max_keyword_length = std::ranges::max(keywords, {}, &std::string_view::size).size();
+
+// Keywords are told apart by their first two characters and their length. Multiplying those by the seed and keeping
+// the top bits gives each one a slot of its own, for the first seed from the golden ratio on that does; a lexeme is a
+// keyword if and only if it is the one in its slot.
+inline constexpr int keyword_slot_bits = 5;
+
+constexpr auto keywordHash(std::string_view lexeme, uint32_t seed) -> size_t {
+    uint32_t key = static_cast<unsigned char>(lexeme[0]) << 16 | static_cast<unsigned char>(lexeme[1]) << 8 |
+                   static_cast<uint32_t>(lexeme.size());
+    return (key * seed) >> (32 - keyword_slot_bits);
+}
+
+inline constexpr uint32_t keyword_seed = [] {
+    for (uint32_t seed = 0x9e3779b1;; seed += 2) {
+        std::array<bool, 1 << keyword_slot_bits> taken{};
+        bool collides = false;
+        for (std::string_view keyword : keywords) {
+            collides |= taken[keywordHash(keyword, seed)];
+            taken[keywordHash(keyword, seed)] = true;
+        }
+        if (!collides)
+            return seed;
+    }
+}();
+
+// the index of the keyword in each slot, or -1
+inline constexpr std::array<int8_t, 1 << keyword_slot_bits> keyword_slots = [] {
+    std::array<int8_t, 1 << keyword_slot_bits> slots;
+    slots.fill(-1);
+    for (size_t i = 0; i < keywords.size(); i++)
+        slots[keywordHash(keywords[i], keyword_seed)] = static_cast<int8_t>(i);
+    return slots;
+}();
+
+// the index of the keyword, or -1 for an identifier
+constexpr auto keywordIndex(std::string_view lexeme) -> int {
+    if (lexeme.size() < min_keyword_length || lexeme.size() > max_keyword_length)
+        return -1;
+    int index = keyword_slots[keywordHash(lexeme, keyword_seed)];
+    return index >= 0 && keywords[index] == lexeme ? index : -1;
+}
+
+static_assert(keywordIndex("while") == loxxy::WHILE - loxxy::AND && keywordIndex("fun") == loxxy::FUN - loxxy::AND);
+static_assert(keywordIndex("classy") == -1 && keywordIndex("whale") == -1 && keywordIndex("x") == -1);
+
 static auto getInitialIdStore() -> CompileTimeInit {
     CompileTimeInit init;
 
@@ -91,31 +155,20 @@ static auto getInitialIdStore() -> CompileTimeInit {
     }
     ptr += init.simple_space;
 
-    const char* keywords[]{"and", "class", "else",   "false", "for",  "fun",  "if",  "nil",
-                           "or",  "print", "return", "super", "this", "true", "var", "while"};
-    size_t max_len = 0;
-    init.n_ids = 0;
+    init.n_ids = keywords.size();
     init.start_ids = ptr;
-    for (const char* keyword : keywords) {
-        size_t len = std::char_traits<char>::length(keyword);
-        init.n_ids++;
-        if (len > max_len)
-            max_len = len;
-    }
     size_t space_per_keyword = 1;
     init.id_space_exponent = 0;
-    while (space_per_keyword < max_len + sizeof(persistent_string<char>) ||
+    while (space_per_keyword < max_keyword_length + sizeof(persistent_string<char>) ||
            space_per_keyword < alignof(persistent_string<char>)) {
         space_per_keyword <<= 1;
         init.id_space_exponent++;
     }
 
-    for (const char* keyword : keywords) {
-        size_t len = std::char_traits<char>::length(keyword);
-
+    for (std::string_view keyword : keywords) {
         auto str = persistent_string<char>::construct_at(ptr);
-        str->len = len;
-        for (int i = 0; i < len; i++) {
+        str->len = keyword.size();
+        for (int i = 0; i < keyword.size(); i++) {
             str->chars[i] = keyword[i];
         }
         ptr += space_per_keyword;
@@ -126,6 +179,50 @@ static auto getInitialIdStore() -> CompileTimeInit {
 
 enum LiteralFormat { DEC, HEX, BIN, OCT };
 
+// what a character can be part of, one bit per class
+enum CharClass : uint8_t {
+    ALPHA = 1 << 0,
+    DEC_DIGIT = 1 << 1,
+    HEX_DIGIT = 1 << 2,
+    OCT_DIGIT = 1 << 3,
+    BIN_DIGIT = 1 << 4,
+};
+
+inline constexpr std::array<uint8_t, 256> char_classes = [] {
+    std::array<uint8_t, 256> classes{};
+    for (int c = 'a'; c <= 'z'; c++)
+        classes[c] |= ALPHA;
+    for (int c = 'A'; c <= 'Z'; c++)
+        classes[c] |= ALPHA;
+    classes['_'] |= ALPHA;
+    for (int c = '0'; c <= '9'; c++)
+        classes[c] |= DEC_DIGIT | HEX_DIGIT | (c <= '7' ? OCT_DIGIT : 0) | (c <= '1' ? BIN_DIGIT : 0);
+    for (int c = 'a'; c <= 'f'; c++)
+        classes[c] |= HEX_DIGIT;
+    for (int c = 'A'; c <= 'F'; c++)
+        classes[c] |= HEX_DIGIT;
+    return classes;
+}();
+
+constexpr auto hasClass(char c, uint8_t char_class) -> bool {
+    return (char_classes[static_cast<unsigned char>(c)] & char_class) != 0;
+}
+
+template <LiteralFormat format>
+inline constexpr uint8_t digit_class =
+    format == DEC ? DEC_DIGIT : format == HEX ? HEX_DIGIT : format == OCT ? OCT_DIGIT : BIN_DIGIT;
+
+template <LiteralFormat format>
+inline constexpr int base = format == DEC ? 10 : format == HEX ? 16 : format == OCT ? 8 : 2;
+
+// a source whose characters the lexer can scan in place, like a mapped_source
+template <typename T>
+concept ContiguousSource = requires(T& source, const char* to) {
+    { source.cursor() } -> std::same_as<const char*>;
+    { source.limit() } -> std::same_as<const char*>;
+    source.advance(to);
+};
+
 static const CompileTimeInit init = getInitialIdStore();
 
 export namespace loxxy {
@@ -137,21 +234,20 @@ public:
     template <typename istream_ref, typename ostream_ref>
     Loxxer(istream_ref&& file, ostream_ref&& sink, size_t line = 0, size_t column = 0)
         : file(std::forward<istream_ref>(file)), sink(std::forward<ostream_ref>(sink)), line(line), column(column) {
-        initStoreAndTable();
+        initStores();
     }
 
     template <typename ostream_ref>
     Loxxer(const std::filesystem::path& filepath, ostream_ref&& sink)
-        requires(std::same_as<istream, std::ifstream>)
+        requires(std::same_as<istream, mapped_source>)
         : file(filepath), sink(std::forward<ostream_ref>(sink)), line(0), column(0) {
-        initStoreAndTable();
+        initStores();
     }
 
     auto addBuiltin(std::string_view sv) -> const persistent_string<>* {
         lex_store.reset_recording();
         lex_store.recordString(sv);
-        const persistent_string<>* ptr = lex_store.finish_recording();
-        addToTableIfNotExists(ptr);
+        const persistent_string<>* ptr = addToTableIfNotExists(lex_store.finish_recording());
         lex_store.start_recording();
         return ptr;
     }
@@ -187,16 +283,15 @@ public:
     }
 
 private:
-    void initStoreAndTable() {
-        const size_t incr = 1 << init.id_space_exponent;
-
-        for (size_t i = 0; i < init.n_ids; i++) {
-            auto* str_ptr = reinterpret_cast<persistent_string<char>*>(&init.start_ids[i * incr]);
-            table.insert(*str_ptr, str_ptr);
-        }
+    void initStores() {
         lex_store.start_recording();
         string_store.start_recording();
     }
+
+    static auto keywordString(int keyword) -> const persistent_string<char>* {
+        return reinterpret_cast<const persistent_string<char>*>(&init.start_ids[keyword << init.id_space_exponent]);
+    }
+
     void error(std::string_view message) {
         std::cerr << "[line " << line << ":" << column << "] "
                   << "Error: " << message << std::endl;
@@ -208,40 +303,93 @@ private:
         file.get();
         return true;
     }
-    void addToken(TokenType type, const persistent_string<char>* lexeme, Literal literal = Literal()) {
-        sink.emplace(Token(type, lexeme, literal, line, column));
+    void addToken(TokenType type, const persistent_string<char>* lexeme) {
+        sink.emplace(Token(type, lexeme, line, column));
     }
 
-    static auto isAlpha(char c) -> bool { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_'; }
+    void addToken(TokenType type, Literal literal) {
+        sink.emplace(Token(type, literal, line, column));
+    }
 
-    static auto isDigit(char c) -> bool { return c >= '0' && c <= '9'; }
+    static auto isAlpha(char c) -> bool { return hasClass(c, ALPHA); }
 
-    static auto isHexDigit(char c) -> bool { return isDigit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'); }
+    static auto isDigit(char c) -> bool { return hasClass(c, DEC_DIGIT); }
 
-    static auto isOctDigit(char c) -> bool { return c >= '0' && c <= '7'; }
+    static auto isHexDigit(char c) -> bool { return hasClass(c, HEX_DIGIT); }
 
-    static auto isBinDigit(char c) -> bool { return c == '0' || c == '1'; }
+    static auto isAlphaNumeric(char c) -> bool { return hasClass(c, ALPHA | DEC_DIGIT); }
 
-    static auto isAlphaNumeric(char c) -> bool { return isAlpha(c) || isDigit(c); }
+    // consumes characters while `in_run` holds for them, handing them to `consume` in pieces. A contiguous source
+    // hands them over as whole runs, found by `scanner` with the vector instructions of the CPU; any other one a
+    // character at a time
+    template <typename Predicate, typename Scanner, typename Consumer>
+    void consumeWhile(Predicate in_run, Scanner scanner, Consumer consume) {
+        if constexpr (ContiguousSource<std::remove_cvref_t<istream>>) {
+            while (true) {
+                const char* start = file.cursor();
+                const char* end = file.limit();
+                const char* p = scanner(start, end);
 
-    static auto parseNumber(LiteralFormat format, std::string_view str) -> double {
-        double base;
-        switch (format) {
-        case DEC:
-            base = 10;
-            break;
-        case HEX:
-            base = 16;
-            break;
-        case BIN:
-            base = 2;
-            break;
-        case OCT:
-            base = 8;
-            break;
+                consume(std::string_view(start, p));
+                file.advance(p);
+                // the run may go on in the next chunk
+                if (p != end || file.eof())
+                    return;
+            }
+        } else {
+            while (!file.eof() && in_run(file.peek())) {
+                char c = file.get();
+                consume(std::string_view(&c, 1));
+            }
         }
-        double mult = base;
-        double d = 0;
+    }
+
+    // for runs no vector scanner knows, scanned one character at a time in any source
+    template <typename Predicate, typename Consumer>
+    void consumeWhile(Predicate in_run, Consumer consume) {
+        auto scanner = [&in_run](const char* p, const char* end) {
+            while (p != end && in_run(*p))
+                p++;
+            return p;
+        };
+        consumeWhile(in_run, scanner, consume);
+    }
+
+    // to the end of the line
+    void skipLine() {
+        consumeWhile([](char c) { return c != '\n'; }, scan.line, [](std::string_view) {});
+    }
+
+    static auto digitValue(char c) -> uint64_t {
+        if (c >= 'a')
+            return c - 'a' + 10;
+        if (c >= 'A')
+            return c - 'A' + 10;
+        return c - '0';
+    }
+
+    // digits with at most one point, which from_chars rounds correctly without copying them
+    template <LiteralFormat format>
+        requires(format == DEC)
+    static auto parseNumber(std::string_view str) -> double {
+        double value = 0;
+        auto [end, error] = std::from_chars(str.data(), str.data() + str.size(), value, std::chars_format::fixed);
+        // from_chars leaves the value alone then, while strtod overflowed to infinity and underflowed to zero
+        if (error == std::errc::result_out_of_range)
+            return str.find_first_not_of('0') < str.find('.') ? std::numeric_limits<double>::infinity() : 0;
+        return value;
+    }
+
+    // Bases that are powers of two need no rounding but the final one: the digits are shifted into an integer, and
+    // those that do not fit are only remembered as a sticky bit below the 53 that a double keeps.
+    template <LiteralFormat format>
+        requires(format != DEC)
+    static auto parseNumber(std::string_view str) -> double {
+        constexpr int bits_per_digit = std::countr_zero(static_cast<unsigned>(base<format>));
+
+        uint64_t mantissa = 0;
+        int exponent = 0;
+        bool sticky = false;
         bool after_decimal_point = false;
         for (char c : str) {
             if (c == '.') {
@@ -249,23 +397,16 @@ private:
                 continue;
             }
 
-            double digit;
-            if (c >= 'A' && c <= 'F')
-                digit = c - 'A' + 10;
-            else if (c >= 'a' && c <= 'f')
-                digit = c - 'a' + 10;
-            else
-                digit = c - '0';
-
-            if (!after_decimal_point) {
-                d *= mult;
-                d += digit;
+            if (std::countl_zero(mantissa) >= bits_per_digit) {
+                mantissa = mantissa << bits_per_digit | digitValue(c);
+                exponent -= after_decimal_point ? bits_per_digit : 0;
             } else {
-                d += digit / mult;
-                mult *= base;
+                sticky |= c != '0';
+                exponent += after_decimal_point ? 0 : bits_per_digit;
             }
         }
-        return d;
+
+        return std::ldexp(static_cast<double>(mantissa | sticky), exponent);
     }
 
     auto addToTableIfNotExists(const persistent_string<char>* str) -> const persistent_string<char>* {
@@ -274,6 +415,8 @@ private:
             return it.value();
 
         table.insert(*str, str);
+        // the string lives in one of our own stores
+        const_cast<persistent_string<char>*>(str)->id = next_id++;
         return str;
     }
 
@@ -303,88 +446,73 @@ private:
 
     void addIdentifier(char start) {
         lex_store.recordChar(start);
+        consumeWhile(isAlphaNumeric, scan.identifier, [this](std::string_view run) { lex_store.recordString(run); });
 
-        while (!file.eof() && isAlphaNumeric(file.peek()))
-            lex_store.recordChar(file.get());
-
-        const persistent_string<char>* id = resolveLexStoreRecording();
-
-        TokenType type;
-        if (reinterpret_cast<const byte*>(id) >= init.lex_store.begin() &&
-            reinterpret_cast<const byte*>(id) < init.lex_store.end()) {
-            size_t offset = reinterpret_cast<const byte*>(id) - init.start_ids;
-            type = static_cast<TokenType>(AND + (offset >> init.id_space_exponent));
+        // keywords are never looked up in the table, only identifiers are interned
+        int keyword = keywordIndex(std::string_view(*lex_store.peek_recording()));
+        if (keyword >= 0) {
+            lex_store.reset_recording();
+            addToken(static_cast<TokenType>(AND + keyword), keywordString(keyword));
         } else
-            type = IDENTIFIER;
-
-        addToken(type, id);
+            addToken(IDENTIFIER, resolveLexStoreRecording());
     }
 
     void addIntegralLiteral(char start) {
-        const persistent_string<char>* lexeme = lex_store.peek_recording();
-
-        size_tt number_start = lexeme->len;
+        size_tt number_start = lex_store.peek_recording()->len;
         lex_store.recordChar(start);
-        LiteralFormat format = DEC;
-
-        std::function<bool(char)> filter = isDigit;
-        if (start == '0') {
-            if (match('x')) {
-                format = HEX;
-                lex_store.recordChar('x');
-                number_start = lexeme->len;
-                filter = isHexDigit;
-            } else if (match('b')) {
-                format = BIN;
-                lex_store.recordChar('b');
-                number_start = lexeme->len;
-                filter = isBinDigit;
-            } else if (match('o')) {
-                format = OCT;
-                lex_store.recordChar('o');
-                number_start = lexeme->len;
-                filter = isOctDigit;
-            }
-        }
 
-        if (format != DEC && !filter(file.peek())) {
+        if (start == '0' && match('x')) {
+            lex_store.recordChar('x');
+            addNumber<HEX>(number_start + 2);
+        } else if (start == '0' && match('b')) {
+            lex_store.recordChar('b');
+            addNumber<BIN>(number_start + 2);
+        } else if (start == '0' && match('o')) {
+            lex_store.recordChar('o');
+            addNumber<OCT>(number_start + 2);
+        } else
+            addNumber<DEC>(number_start);
+    }
+
+    // the rest of a number literal, whose digits start at number_start in the recording
+    template <LiteralFormat format>
+    void addNumber(size_tt number_start) {
+        auto record = [this](std::string_view run) { lex_store.recordString(run); };
+
+        if (format != DEC && !hasClass(file.peek(), digit_class<format>)) {
             error("missing digit");
             return;
         }
 
         bool floating_point = false;
-        while (!file.eof() && (filter(file.peek()) || file.peek() == '.')) {
-            if (file.peek() == '.' && floating_point)
-                break;
-            if (file.peek() == '.')
-                floating_point = true;
-
-            lex_store.recordChar(file.get());
-        }
+        auto in_number = [&floating_point](char c) {
+            if (c != '.')
+                return hasClass(c, digit_class<format>);
+            // a second point is not part of the number
+            return !std::exchange(floating_point, true);
+        };
+        consumeWhile(in_number, record);
 
         while (!file.eof() && isHexDigit(file.peek())) {
             lex_store.recordChar(file.get());
             error("invalid digit");
         }
 
-        size_tt number_end = lexeme->len;
-
-        while (!file.eof() && isAlphaNumeric(file.peek())) {
-            lex_store.recordChar(file.get());
-        }
+        size_tt number_end = lex_store.peek_recording()->len;
 
-        std::string_view number_string(&lexeme->chars[number_start], number_end - number_start);
-        Literal literal = parseNumber(format, number_string);
+        consumeWhile(isAlphaNumeric, scan.identifier, record);
 
-        lexeme = resolveLexStoreRecording();
+        // recording may have moved the lexeme
+        std::string_view number_string(&lex_store.peek_recording()->chars[number_start], number_end - number_start);
+        Literal literal = parseNumber<format>(number_string);
+        // the token keeps only the value
+        lex_store.reset_recording();
 
-        addToken(NUMBER, lexeme, literal);
+        addToken(NUMBER, literal);
     }
 
     auto escapeSequence() -> char {
-        lex_store.recordChar('\\');
         char c = file.get();
-        lex_store.recordChar(c);
 
         switch (c) {
         case 'n':
@@ -403,25 +531,24 @@ private:
         }
     }
 
+    // only the contents are recorded, the token keeps no lexeme
     void addStringLiteral() {
-        lex_store.recordChar('"');
         while (!file.eof() && file.peek() != '"') {
             if (match('\\'))
                 string_store.recordChar(escapeSequence());
             else {
-                string_store.recordChar(file.peek());
-                lex_store.recordChar(file.get());
+                consumeWhile(
+                    [](char c) { return c != '"' && c != '\\'; }, scan.string_body,
+                    [this](std::string_view run) { string_store.recordString(run); }
+                );
             }
         }
         if (file.eof()) {
             error("unterminated string literal");
         }
-        lex_store.recordChar(file.get());
-
-        const persistent_string<char>* lexeme = resolveLexStoreRecording();
-        const persistent_string<char>* string = resolveStringStoreRecording();
+        file.get();
 
-        addToken(STRING, lexeme, string);
+        addToken(STRING, Literal(resolveStringStoreRecording()));
     }
 
     void scanToken() {
@@ -433,6 +560,11 @@ private:
             return;
         case ' ':
         case '\t':
+            // the rest of the run at once, every blank is a column
+            consumeWhile(
+                [](char c) { return c == ' ' || c == '\t'; }, scan.blanks,
+                [this](std::string_view run) { column += run.size(); }
+            );
             break;
         case '{':
             addToken(LEFT_BRACE, reinterpret_cast<persistent_string<char>*>(&init.start_simple[c * init.simple_space]));
@@ -467,14 +599,7 @@ private:
             break;
         case '/':
             if (match('/')) {
-                std::string comment;
-                comment.reserve(32);
-                comment.append("//");
-
-                while (!file.eof() && '\n' != file.peek())
-                    file.get();
-
-                // addToken(COMMENT, std::move(comment));
+                skipLine();
                 break;
             }
 
@@ -522,6 +647,7 @@ private:
         column++;
     }
     istream file;
+    char_scanners scan = char_scanners_for_cpu();
 
     ostream sink;
     size_t line;
@@ -530,6 +656,7 @@ private:
     bool hadError = false;
 
     tsl::htrie_map<char, const persistent_string<char>*> table;
+    size_tt next_id = 0;
 
     persistent_string_store<char> lex_store;
     persistent_string_store<char> string_store;
@@ -539,6 +666,226 @@ template <typename istream_ref, typename ostream_ref>
 Loxxer(istream_ref&& file, ostream_ref&& sink, size_t line = 0, size_t column = 0) -> Loxxer<istream_ref, ostream_ref>;
 
 template <typename ostream_ref>
-Loxxer(const std::filesystem::path& filepath, ostream_ref&& sink) -> Loxxer<std::ifstream, ostream_ref>;
+Loxxer(const std::filesystem::path& filepath, ostream_ref&& sink) -> Loxxer<mapped_source, ostream_ref>;
+
+// Lexes a source that is in memory whole with a Loxxer per chunk, on as many threads, and hands on the same tokens as a
+// single Loxxer would, in order, with the same lines and columns.
+//
+// Chunks start after a newline outside of string literals, which only a scan from the start of the source can tell
+// apart from one inside. So the source is first cut into pieces after any newline, and each piece is scanned in
+// parallel twice, as if it started inside a string and as if it did not; the scans of the pieces before tell which
+// one was right. Each chunk then gets lexed with its own string stores and table. Its strings are reconciled with one
+// table while handing on its tokens: strings are copied into the stores of the ParallelLoxxer the first time some
+// content is seen, in the order a single Loxxer would have seen them, so they get the same ids.
+template <typename ostream>
+class ParallelLoxxer {
+    using ChunkLexer = Loxxer<mapped_source, generic_stream<std::vector, Token>&>;
+    // the reconciled string for each string of a chunk, by its id in the chunk
+    using Canonical = std::vector<const persistent_string<char>*>;
+
+public:
+    // smaller sources are not worth another thread
+    static constexpr size_t min_chunk_size = 1 << 16;
+
+    template <typename ostream_ref>
+    ParallelLoxxer(
+        std::string_view source, ostream_ref&& sink, unsigned threads = std::thread::hardware_concurrency()
+    )
+        : source(source), sink(std::forward<ostream_ref>(sink)), threads(std::max(threads, 1u)) {
+        strings.start_recording();
+    }
+
+    auto addBuiltin(std::string_view sv) -> const persistent_string<>* {
+        return intern(sv);
+    }
+
+    auto scanTokens() -> bool {
+        std::vector<Chunk> chunks = split();
+
+        std::vector<std::jthread> workers;
+        workers.reserve(chunks.size());
+        for (size_t i = 0; i < chunks.size(); i++) {
+            size_t end = i + 1 < chunks.size() ? chunks[i + 1].begin : source.size();
+            workers.emplace_back([&chunk = chunks[i], text = source.substr(chunks[i].begin, end - chunks[i].begin)] {
+                // dense code has about a token every four characters, growing the buffer is most of the cost otherwise
+                chunk.tokens.v.reserve(text.size() / 4);
+                chunk.lexer = std::make_unique<ChunkLexer>(mapped_source::borrowing(text), chunk.tokens, chunk.line, 0);
+                chunk.had_error = chunk.lexer->scanTokens();
+            });
+        }
+
+        // the tokens of a chunk are handed on as soon as it and the ones before are done
+        bool had_error = false;
+        for (size_t i = 0; i < chunks.size(); i++) {
+            workers[i].join();
+            Chunk& chunk = chunks[i];
+            had_error |= chunk.had_error;
+
+            Canonical canonical;
+            for (const Token& token : chunk.tokens.v) {
+                if (token.getType() == END_OF_FILE && i + 1 < chunks.size())
+                    continue;
+
+                if (token.getType() == NUMBER)
+                    sink.emplace(token);
+                else if (token.getType() == STRING) {
+                    Literal string = reconcile(canonical, token.getLiteral().string);
+                    sink.emplace(Token(STRING, string, token.getLine(), token.getColumn()));
+                } else {
+                    const persistent_string<char>* lexeme = reconcile(canonical, &token.getLexeme());
+                    sink.emplace(Token(token.getType(), lexeme, token.getLine(), token.getColumn()));
+                }
+            }
+            chunk.tokens.v = {};
+            chunk.lexer.reset();
+        }
+
+        return had_error;
+    }
+
+private:
+    struct Chunk {
+        size_t begin;
+        size_t line;
+        generic_stream<std::vector, Token> tokens;
+        std::unique_ptr<ChunkLexer> lexer;
+        bool had_error = false;
+    };
+
+    // what a piece of source does to the state of the lexer, given whether it starts inside a string literal
+    struct PieceScan {
+        // the offset after its first newline outside of strings, if there is one
+        std::optional<size_t> boundary;
+        // newlines outside of strings, the lines the lexer counts
+        size_t lines = 0;
+        bool ends_in_string = false;
+    };
+
+    // The chunks, at most one per thread. Pieces start after a newline, so they cannot start inside a comment or a
+    // two-character token.
+    auto split() const -> std::vector<Chunk> {
+        size_t n = std::clamp<size_t>(source.size() / min_chunk_size, 1, threads);
+        std::vector<size_t> pieces{0};
+        for (size_t i = 1; i < n; i++) {
+            size_t newline = source.find('\n', std::max(source.size() * i / n, pieces.back()));
+            if (newline == std::string_view::npos || newline + 1 == source.size())
+                break;
+            pieces.push_back(newline + 1);
+        }
+
+        // the first piece starts outside of a string for sure
+        std::vector<std::array<PieceScan, 2>> scans(pieces.size());
+        {
+            std::vector<std::jthread> scanners;
+            for (size_t i = 0; i < pieces.size(); i++) {
+                scanners.emplace_back([this, &pieces, &scans, i] {
+                    size_t end = i + 1 < pieces.size() ? pieces[i + 1] : source.size();
+                    std::string_view piece = source.substr(pieces[i], end - pieces[i]);
+                    scans[i][false] = scanPiece(piece, false);
+                    if (i > 0)
+                        scans[i][true] = scanPiece(piece, true);
+                });
+            }
+        }
+
+        std::vector<Chunk> chunks(1);
+        chunks[0].begin = 0;
+        chunks[0].line = 0;
+        size_t line = 0;
+        bool in_string = false;
+        for (size_t i = 0; i < pieces.size(); i++) {
+            const PieceScan& scan = scans[i][in_string];
+            // a piece all inside of a string stays with the chunk before
+            if (i > 0 && scan.boundary.has_value()) {
+                Chunk& chunk = chunks.emplace_back();
+                chunk.begin = pieces[i] + scan.boundary.value();
+                chunk.line = line + 1;
+            }
+            line += scan.lines;
+            in_string = scan.ends_in_string;
+        }
+        // a chunk that would start at the end has no tokens, its END_OF_FILE is the one of the chunk before
+        if (chunks.size() > 1 && chunks.back().begin == source.size())
+            chunks.pop_back();
+
+        return chunks;
+    }
+
+    // follows string literals and comments through a piece, the way the lexer would
+    static auto scanPiece(std::string_view piece, bool in_string) -> PieceScan {
+        const char_scanners& scan = char_scanners_for_cpu();
+        PieceScan result;
+        const char* p = piece.data();
+        const char* end = p + piece.size();
+        while (p != end) {
+            if (in_string) {
+                p = scan.string_body(p, end);
+                if (p == end)
+                    break;
+                // an escape sequence takes the next character, whatever it is
+                if (*p == '\\')
+                    p += end - p >= 2 ? 2 : 1;
+                else {
+                    in_string = false;
+                    p++;
+                }
+                continue;
+            }
+
+            char c = *p++;
+            if (c == '"')
+                in_string = true;
+            else if (c == '/' && p != end && *p == '/')
+                p = scan.line(p, end);
+            else if (c == '\n') {
+                if (!result.boundary.has_value())
+                    result.boundary = p - piece.data();
+                result.lines++;
+            }
+        }
+        result.ends_in_string = in_string;
+        return result;
+    }
+
+    auto reconcile(Canonical& canonical, const persistent_string<char>* str) -> const persistent_string<char>* {
+        // keywords and the lexemes of operators are the same in every lexer
+        if (reinterpret_cast<const byte*>(str) >= init.lex_store.begin() &&
+            reinterpret_cast<const byte*>(str) < init.lex_store.end())
+            return str;
+
+        if (str->id >= canonical.size())
+            canonical.resize(str->id + 1);
+        if (canonical[str->id] == nullptr)
+            canonical[str->id] = intern(std::string_view(*str));
+        return canonical[str->id];
+    }
+
+    auto intern(std::string_view sv) -> const persistent_string<char>* {
+        auto it = table.find(sv);
+        if (it != table.end())
+            return it.value();
+
+        strings.recordString(sv);
+        const persistent_string<char>* str = strings.finish_recording();
+        strings.start_recording();
+        table.insert(sv, str);
+        const_cast<persistent_string<char>*>(str)->id = next_id++;
+        return str;
+    }
+
+    std::string_view source;
+    ostream sink;
+    unsigned threads;
+
+    tsl::htrie_map<char, const persistent_string<char>*> table;
+    size_tt next_id = 0;
+    // the strings of all tokens but the ones of keywords and operators
+    persistent_string_store<char> strings;
+};
+
+template <typename ostream_ref>
+ParallelLoxxer(
+    std::string_view source, ostream_ref&& sink, unsigned threads = std::thread::hardware_concurrency()
+) -> ParallelLoxxer<ostream_ref>;
 
 } // namespace loxxy
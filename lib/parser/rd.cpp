@@ -179,8 +179,10 @@ private:
             try {
                 if (match(VAR))
                     return var_declaration();
-                if (match(FUN))
-                    return fun_declaration();
+                if (optional<Token> fun = match(FUN))
+                    return fun_declaration(fun->getLine() + 1);
+                if (match(CLASS))
+                    return class_declaration();
 
                 return statement();
             } catch (ParseError& err) { synchronize(); }
@@ -189,7 +191,7 @@ private:
         return std::nullopt;
     }
 
-    auto fun_declaration() -> StmtPointer {
+    auto fun_declaration(int line) -> StmtPointer {
         Token identifier = expect(IDENTIFIER);
         expect(LEFT_PAREN);
 
@@ -205,7 +207,26 @@ private:
         expect(RIGHT_PAREN);
         expect(LEFT_BRACE);
 
-        return make_node<FunDecl>(&identifier.getLexeme(), std::move(args), block());
+        return make_node<FunDecl>(&identifier.getLexeme(), std::move(args), block(), line);
+    }
+
+    auto class_declaration() -> StmtPointer {
+        Token identifier = expect(IDENTIFIER);
+
+        std::optional<ExprPointer> superclass;
+        if (match(LESS))
+            superclass = make_node<VarExpr>(&expect(IDENTIFIER).getLexeme());
+
+        expect(LEFT_BRACE);
+        ScopeGuard guard{scope_level};
+
+        // methods are declared like functions, without the `fun` keyword
+        std::vector<StmtPointer> methods;
+        while (!check(RIGHT_BRACE, END_OF_FILE))
+            methods.push_back(fun_declaration(stream.peek().getLine() + 1));
+        expect(RIGHT_BRACE);
+
+        return make_node<ClassDecl>(&identifier.getLexeme(), std::move(superclass), std::move(methods));
     }
 
     auto var_declaration() -> StmtPointer {
@@ -375,6 +396,20 @@ private:
             if (assign_target != nullptr)
                 return make_node<AssignExpr>(assign_target, std::move(value));
 
+            // a property access on the left becomes a store into the same object
+            auto getSetTarget = adhoc.make_visitor(
+                [](GetExpr& node) { return std::optional{std::pair{std::move(node.object), node.name}}; },
+                []<typename T>(const T& node) -> optional<std::pair<ExprPointer, const persistent_string<>*>> {
+                    return std::nullopt;
+                }
+            );
+
+            auto set_target = utils::visit(getSetTarget, node);
+            if (set_target.has_value()) {
+                auto [object, name] = std::move(set_target.value());
+                return make_node<SetExpr>(std::move(object), name, std::move(value));
+            }
+
             error(op.value(), "Invalid assignment target");
         }
         return node;
@@ -472,7 +507,9 @@ private:
             if (match(LEFT_PAREN)) {
                 ScopeGuard guard{scope_level};
                 node = finishCall(std::move(node));
-            } else
+            } else if (match(DOT))
+                node = make_node<GetExpr>(std::move(node), &expect(IDENTIFIER).getLexeme());
+            else
                 break;
         }
 
@@ -494,7 +531,8 @@ private:
     }
 
     auto primary() -> ExprPointer {
-        optional<Token> token = match(FALSE, TRUE, NIL, NUMBER, STRING, LEFT_PAREN, END_OF_FILE, IDENTIFIER);
+        optional<Token> token =
+            match(FALSE, TRUE, NIL, NUMBER, STRING, LEFT_PAREN, END_OF_FILE, IDENTIFIER, THIS, SUPER);
 
         if (!token)
             throw error(stream.peek(), "Expected primary expression");
@@ -517,6 +555,11 @@ private:
                 return make_node<StringExpr>(token->getLiteral().string);
             case IDENTIFIER:
                 return make_node<VarExpr>(&token->getLexeme());
+            case THIS:
+                return make_node<ThisExpr>();
+            case SUPER:
+                expect(DOT);
+                return make_node<SuperExpr>(&expect(IDENTIFIER).getLexeme());
             case LEFT_PAREN:
                 ScopeGuard guard{scope_level};
                 ExprPointer node = expression();
@@ -0,0 +1,107 @@
+module;
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string_view>
+
+export module runtime;
+
+// Layout of the values natively compiled code works with: the one of the interpreters' NanBoxedValue. Doubles are
+// stored as is, everything else hides in the payload bits of a quiet NaN that arithmetic never produces.
+export namespace loxxy::boxing {
+
+constexpr uint64_t sign = uint64_t{1} << 63;
+constexpr uint64_t qnan = 0x7ffc000000000000;
+constexpr uint64_t nil_bits = qnan | 1;
+constexpr uint64_t false_bits = qnan | 2;
+constexpr uint64_t true_bits = qnan | 3;
+constexpr uint64_t pointer_tag = sign | qnan;
+constexpr int kind_shift = 48;
+constexpr uint64_t pointer_mask = (uint64_t{1} << kind_shift) - 1;
+constexpr uint64_t kind_mask = uint64_t{3} << kind_shift;
+// strings are the pointers of kind 0
+constexpr uint64_t string_tag = pointer_tag;
+// the NaN every NaN produced by arithmetic is collapsed to
+constexpr uint64_t canonical_nan = 0x7ff8000000000000;
+
+// what a string value points to. Literals are constants of the compiled code, concatenations allocate
+struct String {
+    uint64_t length;
+    const char* chars;
+};
+
+auto is_number(uint64_t value) -> bool { return (value & qnan) != qnan; }
+
+auto is_string(uint64_t value) -> bool { return (value & (pointer_tag | kind_mask)) == string_tag; }
+
+auto as_string(uint64_t value) -> std::string_view {
+    const auto* string = reinterpret_cast<const String*>(value & pointer_mask);
+    return {string->chars, string->length};
+}
+
+} // namespace loxxy::boxing
+
+using namespace loxxy::boxing;
+
+// Functions that natively compiled Lox code calls into, for whatever is too big to inline. They have C linkage, so the
+// JIT and the linker can find them by name.
+export extern "C" {
+
+void lox_print(uint64_t value) {
+    if (is_number(value))
+        std::cout << std::bit_cast<double>(value) << std::endl;
+    else if (value == nil_bits)
+        std::cout << "nil" << std::endl;
+    else if (value == true_bits || value == false_bits)
+        std::cout << (value == true_bits ? "true" : "false") << std::endl;
+    else
+        std::cout << as_string(value) << std::endl;
+}
+
+// a runtime error ends the program, like an uncaught one does in the interpreters
+[[noreturn]] void lox_type_error(const char* message) {
+    std::cout << std::flush;
+    std::cerr << "TypeError: " << message << std::endl;
+    std::exit(70);
+}
+
+// the slow path of `+`, once the operands are not both numbers. Concatenations are never freed, compiled code does not
+// count references
+auto lox_add(uint64_t lhs, uint64_t rhs) -> uint64_t {
+    if (is_number(lhs) && is_number(rhs)) {
+        double sum = std::bit_cast<double>(lhs) + std::bit_cast<double>(rhs);
+        return sum != sum ? canonical_nan : std::bit_cast<uint64_t>(sum);
+    }
+    if (!is_string(lhs) || !is_string(rhs))
+        lox_type_error("bad operands for addition");
+
+    std::string_view x = as_string(lhs);
+    std::string_view y = as_string(rhs);
+    auto* string = static_cast<String*>(std::malloc(sizeof(String) + x.size() + y.size()));
+    auto* chars = reinterpret_cast<char*>(string + 1);
+    std::memcpy(chars, x.data(), x.size());
+    std::memcpy(chars + x.size(), y.data(), y.size());
+    *string = String{x.size() + y.size(), chars};
+
+    return string_tag | reinterpret_cast<uintptr_t>(string);
+}
+
+auto lox_equal(uint64_t lhs, uint64_t rhs) -> bool {
+    if (is_number(lhs) || is_number(rhs))
+        return is_number(lhs) && is_number(rhs) && std::bit_cast<double>(lhs) == std::bit_cast<double>(rhs);
+    if (is_string(lhs) && is_string(rhs))
+        return as_string(lhs) == as_string(rhs);
+
+    return lhs == rhs;
+}
+
+// seconds since the first call, like the clock builtin of the interpreters
+auto lox_clock() -> double {
+    const static auto t0 = std::chrono::high_resolution_clock::now();
+    auto t = std::chrono::high_resolution_clock::now();
+    return static_cast<double>((t - t0).count()) / 1000000000;
+}
+}
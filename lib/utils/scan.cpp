@@ -0,0 +1,182 @@
+module;
+#include <bit>
+#include <cstdint>
+#include <initializer_list>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define LOXXY_X86 1
+#endif
+
+export module utils.scan;
+
+// Kernels that find where a run of characters ends, 16 or 32 of them at a time. Each one returns the first character
+// in [p, end) that does not belong to its run, or end. Only whole vectors before end are loaded, the rest is scanned
+// one character at a time.
+namespace utils {
+
+enum class run { identifier, blank, line, string_body };
+
+constexpr auto in_run(run kind, char c) -> bool {
+    switch (kind) {
+    case run::identifier:
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+    case run::blank:
+        return c == ' ' || c == '\t';
+    case run::line:
+        return c != '\n';
+    case run::string_body:
+        return c != '"' && c != '\\';
+    }
+    return false;
+}
+
+template <run kind>
+auto scan_scalar(const char* p, const char* end) -> const char* {
+    while (p != end && in_run(kind, *p))
+        p++;
+    return p;
+}
+
+#ifdef LOXXY_X86
+// SSE2 has no unsigned byte comparison, so a range [lo, lo + n) is shifted to start at the smallest signed byte
+template <char lo, int n>
+auto in_range_sse2(__m128i v) -> __m128i {
+    __m128i shifted = _mm_add_epi8(v, _mm_set1_epi8(static_cast<char>(-128 - lo)));
+    return _mm_cmplt_epi8(shifted, _mm_set1_epi8(static_cast<char>(-128 + n)));
+}
+
+template <run kind>
+auto scan_sse2(const char* p, const char* end) -> const char* {
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        uint32_t stops;
+        if constexpr (kind == run::identifier) {
+            // setting the case bit maps upper case letters, and only them, onto lower case ones
+            __m128i letter = in_range_sse2<'a', 26>(_mm_or_si128(v, _mm_set1_epi8(0x20)));
+            __m128i digit = in_range_sse2<'0', 10>(v);
+            __m128i underscore = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+            stops = ~_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(letter, digit), underscore)) & 0xffff;
+        } else if constexpr (kind == run::blank) {
+            __m128i space = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+            __m128i blank = _mm_or_si128(space, _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+            stops = ~_mm_movemask_epi8(blank) & 0xffff;
+        } else if constexpr (kind == run::line) {
+            stops = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+        } else {
+            __m128i quote = _mm_cmpeq_epi8(v, _mm_set1_epi8('"'));
+            __m128i backslash = _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'));
+            stops = _mm_movemask_epi8(_mm_or_si128(quote, backslash));
+        }
+
+        if (stops != 0)
+            return p + std::countr_zero(stops);
+    }
+    return scan_scalar<kind>(p, end);
+}
+
+// the SSE2 kernel on twice the width. Compiled for AVX2 whatever the flags of the build, and only called if the CPU
+// has it
+template <char lo, int n>
+[[gnu::target("avx2")]] auto in_range_avx2(__m256i v) -> __m256i {
+    __m256i shifted = _mm256_add_epi8(v, _mm256_set1_epi8(static_cast<char>(-128 - lo)));
+    return _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(-128 + n)), shifted);
+}
+
+template <run kind>
+[[gnu::target("avx2")]] auto scan_avx2(const char* p, const char* end) -> const char* {
+    for (; end - p >= 32; p += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        uint32_t stops;
+        if constexpr (kind == run::identifier) {
+            __m256i letter = in_range_avx2<'a', 26>(_mm256_or_si256(v, _mm256_set1_epi8(0x20)));
+            __m256i digit = in_range_avx2<'0', 10>(v);
+            __m256i underscore = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+            __m256i identifier = _mm256_or_si256(_mm256_or_si256(letter, digit), underscore);
+            stops = ~static_cast<uint32_t>(_mm256_movemask_epi8(identifier));
+        } else if constexpr (kind == run::blank) {
+            __m256i space = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+            __m256i blank = _mm256_or_si256(space, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')));
+            stops = ~static_cast<uint32_t>(_mm256_movemask_epi8(blank));
+        } else if constexpr (kind == run::line) {
+            stops = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))));
+        } else {
+            __m256i quote = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'));
+            __m256i backslash = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'));
+            stops = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(quote, backslash)));
+        }
+
+        if (stops != 0)
+            return p + std::countr_zero(stops);
+    }
+    return scan_sse2<kind>(p, end);
+}
+#endif
+
+} // namespace utils
+
+export namespace utils {
+
+enum class simd_level { scalar, sse2, avx2 };
+
+auto supports(simd_level level) -> bool {
+    switch (level) {
+    case simd_level::scalar:
+        return true;
+#ifdef LOXXY_X86
+    case simd_level::sse2:
+        return __builtin_cpu_supports("sse2");
+    case simd_level::avx2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+auto best_simd_level() -> simd_level {
+    for (simd_level level : {simd_level::avx2, simd_level::sse2}) {
+        if (supports(level))
+            return level;
+    }
+    return simd_level::scalar;
+}
+
+// The lexer's scanners for one instruction set, each returning the end of the run that starts at p.
+struct char_scanners {
+    using scanner = auto (*)(const char* p, const char* end) -> const char*;
+
+    // [a-zA-Z0-9_]*
+    scanner identifier;
+    // spaces and tabs
+    scanner blanks;
+    // up to the next newline
+    scanner line;
+    // up to the next quote or backslash
+    scanner string_body;
+};
+
+// the level has to be supported
+auto char_scanners_for(simd_level level) -> char_scanners {
+    switch (level) {
+#ifdef LOXXY_X86
+    case simd_level::avx2:
+        return {scan_avx2<run::identifier>, scan_avx2<run::blank>, scan_avx2<run::line>, scan_avx2<run::string_body>};
+    case simd_level::sse2:
+        return {scan_sse2<run::identifier>, scan_sse2<run::blank>, scan_sse2<run::line>, scan_sse2<run::string_body>};
+#endif
+    default:
+        return {
+            scan_scalar<run::identifier>, scan_scalar<run::blank>, scan_scalar<run::line>,
+            scan_scalar<run::string_body>
+        };
+    }
+}
+
+// the best scanners of the CPU running the program, chosen on first use
+auto char_scanners_for_cpu() -> const char_scanners& {
+    static const char_scanners scanners = char_scanners_for(best_simd_level());
+    return scanners;
+}
+
+} // namespace utils
@@ -0,0 +1,167 @@
+module;
+#include <cerrno>
+#include <cstddef>
+#include <filesystem>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+export module utils.source;
+
+export namespace utils {
+
+// Input of the lexer as one contiguous range of characters, so that it can scan with pointers instead of going through
+// a stream for every character. Regular files are mapped into memory whole. Anything else, like stdin or a pipe, is
+// read in chunks as the lexer gets to the end of the previous one, so the REPL still sees lines as they are typed;
+// a chunk replaces the previous one, tokens never point into the source.
+//
+// get(), peek() and eof() follow generic_stream, so the lexer can use either: eof() is true once everything was
+// consumed, and reading past the end gives '\0'. A source that could not be opened is empty and fail().
+class mapped_source {
+public:
+    static constexpr size_t chunk_size = 1 << 16;
+
+    explicit mapped_source(const std::filesystem::path& path) : fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC)) {
+        if (fd < 0) {
+            failed = true;
+            return;
+        }
+
+        struct stat info;
+        if (::fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+            void* address = ::mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (address != MAP_FAILED) {
+                ::madvise(address, info.st_size, MADV_SEQUENTIAL);
+                mapping = static_cast<const char*>(address);
+                mapping_size = info.st_size;
+                first = pos = mapping;
+                last = mapping + mapping_size;
+                close();
+                return;
+            }
+        }
+        // not mappable, read as it comes
+        reading = true;
+    }
+
+    // a copy of the string, read as if it was a file
+    static auto from_string(std::string_view contents) -> mapped_source {
+        mapped_source source;
+        source.buffer.assign(contents.begin(), contents.end());
+        source.first = source.pos = source.buffer.data();
+        source.last = source.first + source.buffer.size();
+        return source;
+    }
+
+    // the characters themselves, which have to outlive the source
+    static auto borrowing(std::string_view contents) -> mapped_source {
+        mapped_source source;
+        source.first = source.pos = contents.data();
+        source.last = source.first + contents.size();
+        return source;
+    }
+
+    mapped_source(mapped_source&& other) noexcept { swap(other); }
+
+    auto operator=(mapped_source&& other) noexcept -> mapped_source& {
+        mapped_source moved(std::move(other));
+        swap(moved);
+        return *this;
+    }
+
+    ~mapped_source() {
+        if (mapping != nullptr)
+            ::munmap(const_cast<char*>(mapping), mapping_size);
+        close();
+    }
+
+    auto get() -> char { return pos != last || refill() ? *pos++ : '\0'; }
+
+    auto peek() -> char { return pos != last || refill() ? *pos : '\0'; }
+
+    auto eof() -> bool { return pos == last && !refill(); }
+
+    auto fail() const -> bool { return failed; }
+
+    // the characters available without reading more, from cursor() to limit(). Once they are consumed with
+    // advance(limit()), eof() reads the next chunk, if any
+    auto cursor() const -> const char* { return pos; }
+
+    auto limit() const -> const char* { return last; }
+
+    void advance(const char* to) { pos = to; }
+
+    // whether all of the source is in memory, so that contents() has it
+    auto in_memory() const -> bool { return !reading; }
+
+    // everything, for sources that are in memory whole. Moving the source does not move its characters
+    auto contents() const -> std::string_view { return {first, static_cast<size_t>(last - first)}; }
+
+    // back to the first character, for sources that are in memory whole
+    void reset() { pos = first; }
+
+private:
+    mapped_source() = default;
+
+    auto refill() -> bool {
+        if (!reading)
+            return false;
+
+        buffer.resize(chunk_size);
+        ssize_t n;
+        do
+            n = ::read(fd, buffer.data(), buffer.size());
+        while (n < 0 && errno == EINTR);
+
+        if (n <= 0) {
+            failed = n < 0;
+            reading = false;
+            buffer.clear();
+            first = pos = last = nullptr;
+            close();
+            return false;
+        }
+
+        first = pos = buffer.data();
+        last = first + n;
+        return true;
+    }
+
+    void close() {
+        if (fd >= 0)
+            ::close(fd);
+        fd = -1;
+    }
+
+    void swap(mapped_source& other) noexcept {
+        std::swap(fd, other.fd);
+        std::swap(mapping, other.mapping);
+        std::swap(mapping_size, other.mapping_size);
+        // the data of a vector stays where it is when the vector is swapped
+        std::swap(buffer, other.buffer);
+        std::swap(first, other.first);
+        std::swap(pos, other.pos);
+        std::swap(last, other.last);
+        std::swap(reading, other.reading);
+        std::swap(failed, other.failed);
+    }
+
+    int fd = -1;
+    const char* mapping = nullptr;
+    size_t mapping_size = 0;
+    std::vector<char> buffer;
+
+    const char* first = nullptr;
+    const char* pos = nullptr;
+    const char* last = nullptr;
+    // whether more can be read from fd
+    bool reading = false;
+    bool failed = false;
+};
+
+} // namespace utils
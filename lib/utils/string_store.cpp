@@ -44,6 +44,7 @@ public:
     auto copy_to(void* ptr) -> persistent_string<char_t>* requires(std::is_copy_constructible_v<char_t>) {
         persistent_string<char_t>* str = construct_at(ptr);
         str->len = len;
+        str->id = id;
         if constexpr (std::is_trivially_copyable_v<char_t>)
             std::memcpy(str->chars, chars, sizeof(char_t) * len);
         else {
@@ -57,6 +58,7 @@ public:
     auto move_to(void* ptr) -> persistent_string<char_t>* requires(std::is_move_constructible_v<char_t>) {
         persistent_string<char_t>* str = construct_at(ptr);
         str->len = len;
+        str->id = id;
         if constexpr (std::is_trivially_move_constructible_v<char_t>)
             std::memcpy(str->chars, chars, sizeof(char_t) * len);
         else {
@@ -94,7 +96,11 @@ public:
         ostream << std::basic_string_view<char_t>(string);
         return ostream;
     }
+    static constexpr size_tt no_id = std::numeric_limits<size_tt>::max();
+
     size_tt len;
+    // dense index handed out by the table that interned the string, for tables keyed by identifier
+    size_tt id = no_id;
     char_t chars[];
 };
 
@@ -137,13 +137,41 @@ constexpr ALWAYS_INLINE auto extract_visitable(Visitor&& visitor, Arg&& wrapped_
     return std::forward<Arg>(wrapped_var).get_visitable(visitor.resolver);
 }
 
+// Types that implement their own dispatch instead of being a variant, e.g. a NaN-boxed value. They provide
+// visit(visitor), holds<T>() and get<T>() members.
+template <typename T>
+concept CustomVisitable = requires { typename std::remove_cvref_t<T>::custom_visitable; };
+
 template <typename Visitor, typename... Args>
+    requires((!CustomVisitable<Args>) && ...)
 constexpr ALWAYS_INLINE auto visit(Visitor&& visitor, Args&&... args) -> decltype(auto) {
     return SOURCE::visit(
         std::forward<Visitor>(visitor), extract_visitable(std::forward<Visitor>(visitor), std::forward<Args>(args))...
     );
 }
 
+template <typename Visitor, CustomVisitable Arg>
+constexpr ALWAYS_INLINE auto visit(Visitor&& visitor, Arg&& arg) -> decltype(auto) {
+    return std::forward<Arg>(arg).visit(std::forward<Visitor>(visitor));
+}
+
+template <typename Visitor, CustomVisitable Lhs, CustomVisitable Rhs>
+constexpr ALWAYS_INLINE auto visit(Visitor&& visitor, Lhs&& lhs, Rhs&& rhs) -> decltype(auto) {
+    return lhs.visit([&visitor, &rhs](auto&& l) {
+        return rhs.visit([&visitor, &l](auto&& r) { return visitor(l, r); });
+    });
+}
+
+template <typename T, CustomVisitable Arg>
+constexpr ALWAYS_INLINE auto holds_alternative(Arg&& arg) -> bool {
+    return arg.template holds<T>();
+}
+
+template <typename T, CustomVisitable Arg>
+constexpr ALWAYS_INLINE auto get(Arg&& arg) -> decltype(auto) {
+    return arg.template get<T>();
+}
+
 template <typename T, typename Arg>
     requires(IsVar<Arg> || IsWrappedVar<Arg>)
 constexpr ALWAYS_INLINE auto holds_alternative(Arg&& arg) -> bool {
@@ -0,0 +1,348 @@
+module;
+#include "loxxy/opcodes.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <span>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+export module vm;
+import ast;
+import ast.bytecode;
+import utils.string_store;
+import utils.variant;
+
+using utils::persistent_string;
+
+#if defined(__GNUC__) || defined(__clang__)
+#define COMPUTED_GOTO
+#endif
+
+export namespace loxxy {
+
+struct StackOverflow : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+// Executes chunks produced by the Compiler. Frames are laid out like in the tree walking interpreter in slot mode:
+// a function's slots start at its first argument, followed by its temporaries.
+class VM {
+public:
+    explicit VM(const persistent_string<>* clock_id, size_t stack_size = 1 << 16) : stack(stack_size) {
+        globals.define(clock_id, &clock_builtin);
+    }
+
+    void addBuiltin(const persistent_string<>* identifier, Value&& value) {
+        globals.define(identifier, std::move(value));
+    }
+
+    void run(const Chunk& script) {
+        if (script.frame_size + script.max_stack > stack.size())
+            throw StackOverflow("script does not fit on the stack");
+
+        frames.clear();
+        frames.push_back(Frame{&script, script.code.data(), stack.data(), 0, 0, 0});
+        execute();
+    }
+
+private:
+    struct Frame {
+        const Chunk* chunk;
+        const uint8_t* ip;
+        Value* base;
+        // frame of the function the callee was declared in, and the generation that frame had at the time
+        uint32_t static_link;
+        uint32_t link_generation;
+        uint32_t generation;
+    };
+
+    void execute() {
+        Frame* frame = &frames.back();
+        const Chunk* chunk = frame->chunk;
+        const uint8_t* ip = frame->ip;
+        Value* base = frame->base;
+        Value* sp = base + chunk->frame_size;
+        Value* const stack_end = stack.data() + stack.size();
+
+#define READ_OPERAND() (ip += sizeof(Operand), read_operand(ip - sizeof(Operand)))
+#define NUMERIC_BINARY(Visitor, op)                                                                                    \
+    if (utils::holds_alternative<double>(sp[-2]) && utils::holds_alternative<double>(sp[-1]))                          \
+        sp[-2] = Value{utils::get<double>(sp[-2]) op utils::get<double>(sp[-1])};                                     \
+    else                                                                                                               \
+        sp[-2] = Value{utils::visit(Visitor{}, sp[-2], sp[-1])};                                                       \
+    sp--;
+
+#ifdef COMPUTED_GOTO
+        static const void* const dispatch_table[] = {
+#define X(name, operands, effect) &&op_##name,
+            LOXXY_OPCODES(X)
+#undef X
+        };
+#define CASE(name) op_##name:
+#define DISPATCH() goto* dispatch_table[*ip++]
+        DISPATCH();
+#else
+#define CASE(name) case static_cast<uint8_t>(OpCode::name):
+#define DISPATCH() continue
+        while (true) {
+            switch (*ip++) {
+#endif
+
+        CASE(CONSTANT) {
+            *sp++ = chunk->constants[READ_OPERAND()];
+            DISPATCH();
+        }
+        CASE(NIL) {
+            *sp++ = Value{nullptr};
+            DISPATCH();
+        }
+        CASE(TRUE) {
+            *sp++ = Value{true};
+            DISPATCH();
+        }
+        CASE(FALSE) {
+            *sp++ = Value{false};
+            DISPATCH();
+        }
+        CASE(POP) {
+            sp--;
+            DISPATCH();
+        }
+        CASE(GET_LOCAL) {
+            *sp = base[READ_OPERAND()];
+            sp++;
+            DISPATCH();
+        }
+        CASE(SET_LOCAL) {
+            base[READ_OPERAND()] = sp[-1];
+            DISPATCH();
+        }
+        CASE(DEFINE_LOCAL) {
+            base[READ_OPERAND()] = std::move(*--sp);
+            DISPATCH();
+        }
+        CASE(GET_OUTER) {
+            Operand depth = READ_OPERAND();
+            *sp = outer(depth, READ_OPERAND());
+            sp++;
+            DISPATCH();
+        }
+        CASE(SET_OUTER) {
+            Operand depth = READ_OPERAND();
+            outer(depth, READ_OPERAND()) = sp[-1];
+            DISPATCH();
+        }
+        CASE(GET_GLOBAL) {
+            Operand id = READ_OPERAND();
+            Value* global = globals.find(id);
+            if (global == nullptr)
+                undefined(*chunk, id);
+
+            *sp++ = *global;
+            DISPATCH();
+        }
+        CASE(SET_GLOBAL) {
+            Operand id = READ_OPERAND();
+            Value* global = globals.find(id);
+            if (global == nullptr)
+                undefined(*chunk, id);
+
+            *global = sp[-1];
+            DISPATCH();
+        }
+        CASE(DEFINE_GLOBAL) {
+            globals.define(READ_OPERAND(), std::move(*--sp));
+            DISPATCH();
+        }
+        CASE(EQUAL) {
+            sp[-2] = Value{utils::visit(Equals{}, sp[-2], sp[-1])};
+            sp--;
+            DISPATCH();
+        }
+        CASE(NOT_EQUAL) {
+            sp[-2] = Value{!utils::visit(Equals{}, sp[-2], sp[-1])};
+            sp--;
+            DISPATCH();
+        }
+        CASE(GREATER) {
+            NUMERIC_BINARY(Greater, >);
+            DISPATCH();
+        }
+        CASE(GREATER_EQUAL) {
+            NUMERIC_BINARY(GreaterEq, >=);
+            DISPATCH();
+        }
+        CASE(LESS) {
+            NUMERIC_BINARY(Less, <);
+            DISPATCH();
+        }
+        CASE(LESS_EQUAL) {
+            NUMERIC_BINARY(LessEq, <=);
+            DISPATCH();
+        }
+        CASE(ADD) {
+            NUMERIC_BINARY(Plus, +);
+            DISPATCH();
+        }
+        CASE(SUBTRACT) {
+            NUMERIC_BINARY(Minus, -);
+            DISPATCH();
+        }
+        CASE(MULTIPLY) {
+            NUMERIC_BINARY(Times, *);
+            DISPATCH();
+        }
+        CASE(DIVIDE) {
+            NUMERIC_BINARY(Divide, /);
+            DISPATCH();
+        }
+        CASE(NOT) {
+            sp[-1] = Value{utils::visit(Not{}, sp[-1])};
+            DISPATCH();
+        }
+        CASE(NEGATE) {
+            sp[-1] = Value{utils::visit(Minus{}, sp[-1])};
+            DISPATCH();
+        }
+        CASE(TRUTHY) {
+            sp[-1] = Value{truthy(sp[-1])};
+            DISPATCH();
+        }
+        CASE(PRINT) {
+            std::cout << *--sp << std::endl;
+            DISPATCH();
+        }
+        CASE(JUMP) {
+            ip = chunk->code.data() + READ_OPERAND();
+            DISPATCH();
+        }
+        CASE(JUMP_IF_FALSE) {
+            Operand target = READ_OPERAND();
+            if (!truthy(*--sp))
+                ip = chunk->code.data() + target;
+            DISPATCH();
+        }
+        CASE(JUMP_IF_TRUE) {
+            Operand target = READ_OPERAND();
+            if (truthy(*--sp))
+                ip = chunk->code.data() + target;
+            DISPATCH();
+        }
+        CASE(CLOSURE) {
+            const Chunk* function = chunk->functions[READ_OPERAND()];
+            *sp++ = Value{LoxCallable{
+                .descriptor = &function->descriptor,
+                .static_link = static_cast<uint32_t>(frames.size() - 1),
+                .generation = frame->generation,
+            }};
+            DISPATCH();
+        }
+        CASE(CALL) {
+            Operand n_args = READ_OPERAND();
+            Value* callee = sp - n_args - 1;
+
+            if (utils::holds_alternative<const BuiltinCallable*>(*callee)) {
+                const BuiltinCallable* fn = utils::get<const BuiltinCallable*>(*callee);
+                if (n_args != fn->arity) {
+                    std::stringstream error_msg;
+                    error_msg << "got " << n_args << " arguments, for builtin function '" << fn->name
+                              << "' with arity " << fn->arity;
+                    throw WrongNumberOfArguments(error_msg.str());
+                }
+
+                *callee = fn->fn(std::span<Value>(callee + 1, n_args));
+                sp = callee + 1;
+                DISPATCH();
+            }
+
+            if (!utils::holds_alternative<LoxCallable>(*callee))
+                throw NotCallable("bad callee");
+
+            const LoxCallable& fn = utils::get<LoxCallable>(*callee);
+            const FunctionDescriptor* descriptor = fn.descriptor;
+            if (descriptor->arg_names.size() != n_args) {
+                std::stringstream error_msg;
+                error_msg << "function expects " << descriptor->arg_names.size() << " arguments, but got " << n_args
+                          << ".";
+                throw WrongNumberOfArguments(error_msg.str());
+            }
+
+            auto* function = static_cast<const Chunk*>(descriptor->body);
+            Value* new_base = callee + 1;
+            if (new_base + descriptor->frame_size + function->max_stack > stack_end)
+                throw StackOverflow("call stack exhausted");
+
+            for (; sp < new_base + descriptor->frame_size; sp++)
+                *sp = Value{nullptr};
+
+            frame->ip = ip;
+            frames.push_back(Frame{function, function->code.data(), new_base, fn.static_link, fn.generation,
+                                   next_generation++});
+            frame = &frames.back();
+            chunk = function;
+            ip = chunk->code.data();
+            base = new_base;
+            DISPATCH();
+        }
+        CASE(RETURN) {
+            Value result = std::move(*--sp);
+            if (frames.size() == 1)
+                return;
+
+            Value* callee = base - 1;
+            frames.pop_back();
+            frame = &frames.back();
+            chunk = frame->chunk;
+            ip = frame->ip;
+            base = frame->base;
+
+            *callee = std::move(result);
+            sp = callee + 1;
+            DISPATCH();
+        }
+
+#ifndef COMPUTED_GOTO
+            }
+        }
+#endif
+
+#undef DISPATCH
+#undef CASE
+#undef NUMERIC_BINARY
+#undef READ_OPERAND
+    }
+
+    auto outer(uint32_t depth, uint32_t slot) -> Value& {
+        const Frame* frame = &frames.back();
+        for (; depth > 0; depth--) {
+            if (frame->static_link >= frames.size() || frames[frame->static_link].generation != frame->link_generation)
+                throw UndefinedVariable("closure outlived the function it captures variables from");
+
+            frame = &frames[frame->static_link];
+        }
+
+        return frame->base[slot];
+    }
+
+    [[noreturn]] static void undefined(const Chunk& chunk, Operand id) {
+        auto name = std::find_if(chunk.names.begin(), chunk.names.end(), [id](const persistent_string<>* name) {
+            return name->id == id;
+        });
+
+        std::string error{};
+        error.append(**name);
+        error.append(" not defined");
+        throw UndefinedVariable(error);
+    }
+
+    std::vector<Value> stack;
+    std::vector<Frame> frames;
+    Globals globals;
+    uint32_t next_generation = 1;
+};
+
+} // namespace loxxy
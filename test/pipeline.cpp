@@ -0,0 +1,95 @@
+module;
+#include <cstdint>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+export module test.pipeline;
+import parser.rd;
+import lexer;
+import ast;
+import ast.boxed_node_builder;
+import ast.folder;
+import ast.resolver;
+import utils.generic_stream;
+import utils.source;
+import utils.string_store;
+import utils.variant;
+
+export namespace loxxy {
+
+// how far down the front end of lox a Program goes
+enum class Stage : uint8_t { parsed, folded, resolved };
+
+// A Lox program taken through the front end the way lox takes it, for the tests of the passes and backends after it.
+// The statements refer to strings of the lexer, so the program keeps the lexer alive as long as them.
+template <typename Payload = empty>
+struct Program {
+    using FunDecl = typename Family<Payload, UniquePtrIndirection, true>::FunDecl;
+    using Tokens = utils::generic_stream<std::vector, Token>;
+
+    explicit Program(std::string_view source, Stage stage = SlotResolved<Payload> ? Stage::resolved : Stage::parsed)
+        : lexer(utils::mapped_source::from_string(source), tokens), clock(lexer.addBuiltin("clock")) {
+        lexer.scanTokens();
+
+        Parser parser(tokens, BoxedNodeBuilder<Payload>{});
+        statements = std::move(parser.parse().statements);
+
+        if (stage >= Stage::folded) {
+            ConstantFolder<Payload, UniquePtrIndirection, true, BoxedNodeBuilder<Payload>> folder{
+                BoxedNodeBuilder<Payload>{}
+            };
+            statements = folder.copy(statements);
+        }
+
+        if constexpr (SlotResolved<Payload>) {
+            if (stage == Stage::resolved) {
+                SlotResolver<Payload, UniquePtrIndirection, true> resolver;
+                for (auto& stmt : statements)
+                    utils::visit(resolver, stmt);
+            }
+        }
+    }
+
+    Program(const Program&) = delete;
+    auto operator=(const Program&) -> Program& = delete;
+
+    // the function declared last as `name` at the top level, or nullptr
+    auto function(std::string_view name) const -> const FunDecl* {
+        utils::Adhoc<void, UniquePtrIndirection> adhoc;
+        auto as_function = adhoc.make_visitor(
+            [](const FunDecl& node) { return &node; }, []<typename T>(const T&) -> const FunDecl* { return nullptr; }
+        );
+        const FunDecl* function = nullptr;
+        for (const auto& stmt : statements) {
+            const FunDecl* declared = utils::visit(as_function, stmt);
+            if (declared != nullptr && std::string_view(*declared->identifier) == name)
+                function = declared;
+        }
+        return function;
+    }
+
+    Tokens tokens;
+    Loxxer<utils::mapped_source, Tokens&> lexer;
+    // the builtin interpreters are made with
+    const persistent_string<>* clock;
+    std::vector<StmtPointer<Payload, UniquePtrIndirection, true>> statements;
+};
+
+// what is printed to std::cout while it lives, which is restored when a test throws as well
+class CapturedOutput {
+public:
+    CapturedOutput() : previous(std::cout.rdbuf(output.rdbuf())) {}
+    ~CapturedOutput() { std::cout.rdbuf(previous); }
+
+    auto str() const -> std::string { return output.str(); }
+
+private:
+    std::stringstream output;
+    std::streambuf* previous;
+};
+
+} // namespace loxxy
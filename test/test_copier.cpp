@@ -0,0 +1,132 @@
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+import ast;
+import ast.boxed_node_builder;
+import ast.copier;
+import ast.folder;
+import ast.printer;
+import test.pipeline;
+
+using namespace loxxy;
+
+// a program using every kind of node
+constexpr std::string_view all_nodes = R"(
+var a = -(1 + 2) * 3;
+var s = "s";
+print !true == nil;
+fun f(x) {
+    if (x > 0) { return f(x - 1); } else print x;
+    while (a < 10) a = a + 1;
+    return x;
+}
+class A { get() { return this.x; } }
+class B < A {
+    init() { this.x = 1; }
+    get() { return super.get() or false; }
+}
+B().get();
+)";
+
+// the statements of the source after a pass, as the ASTPrinter prints them
+auto print(std::string_view source, auto pass) -> std::string {
+    Program program(source, Stage::parsed);
+    std::stringstream printed;
+    for (const auto& stmt : program.statements)
+        printed << pass(stmt) << "\n";
+    return printed.str();
+}
+
+auto fold(std::string_view source) -> std::string {
+    ConstantFolder<empty, UniquePtrIndirection, true, BoxedNodeBuilder<>> folder{BoxedNodeBuilder<>{}};
+    return print(source, [&](const auto& stmt) { return folder.copy(stmt); });
+}
+
+auto copy(std::string_view source) -> std::string {
+    ASTCopier<empty, UniquePtrIndirection, true, BoxedNodeBuilder<>> copier{BoxedNodeBuilder<>{}};
+    return print(source, [&](const auto& stmt) { return copier.copy(stmt); });
+}
+
+auto parse(std::string_view source) -> std::string {
+    return print(source, [](const auto& stmt) -> const auto& { return stmt; });
+}
+
+TEST(CopierTest, AllNodes) {
+    EXPECT_EQ(copy(all_nodes), parse(all_nodes));
+}
+
+TEST(CopierTest, PayloadChange) {
+    Program program(all_nodes, Stage::parsed);
+    ASTCopier<empty, UniquePtrIndirection, true, BoxedNodeBuilder<SlotPayload>> copier{
+        BoxedNodeBuilder<SlotPayload>{}
+    };
+    NodeCounter<empty, UniquePtrIndirection, true> count_parsed;
+    NodeCounter<SlotPayload, UniquePtrIndirection, true> count_copied;
+    for (const auto& stmt : program.statements) {
+        std::stringstream parsed;
+        std::stringstream copied;
+        auto copy = copier.copy(stmt);
+        parsed << stmt;
+        copied << copy;
+        EXPECT_EQ(copied.str(), parsed.str());
+        EXPECT_EQ(count_copied.count(copy), count_parsed.count(stmt));
+    }
+}
+
+TEST(FolderTest, Arithmetic) {
+    EXPECT_EQ(fold("print 1 + 2 * 3;"), parse("print 7;"));
+    EXPECT_EQ(fold("print -(4 - 6) / 2;"), parse("print 1;"));
+    EXPECT_EQ(fold("print (1 + 2) < 4 == !false;"), parse("print true;"));
+    EXPECT_EQ(fold("print 1 != nil;"), parse("print true;"));
+}
+
+// constant subexpressions fold, while the ones depending on a variable stay
+TEST(FolderTest, Partial) {
+    EXPECT_EQ(fold("print x * (2 + 3);"), parse("print x * 5;"));
+    EXPECT_EQ(fold("print x + 0;"), parse("print x + 0;"));
+    EXPECT_EQ(fold("f(1 + 1, -(2));"), "EXPR_STMT ( CALL_EXPR ( f( 2 , -2 ) )  ) \n");
+}
+
+TEST(FolderTest, ShortCircuit) {
+    EXPECT_EQ(fold("print false and f();"), parse("print false;"));
+    EXPECT_EQ(fold("print 1 or f();"), parse("print true;"));
+    EXPECT_EQ(fold("print nil or 0;"), parse("print true;"));
+    EXPECT_EQ(fold("print true and nil;"), parse("print false;"));
+    EXPECT_EQ(fold("print true and f();"), parse("print true and f();"));
+    EXPECT_EQ(fold("print x or true;"), parse("print x or true;"));
+}
+
+TEST(FolderTest, UnfoldedWhenThrowing) {
+    EXPECT_EQ(fold("print 1 + nil;"), parse("print 1 + nil;"));
+    EXPECT_EQ(fold("print -\"a\";"), parse("print -\"a\";"));
+    EXPECT_EQ(fold("print true < 1;"), parse("print true < 1;"));
+    EXPECT_EQ(fold("print (1 + 1) * \"a\";"), parse("print 2 * \"a\";"));
+}
+
+// concatenated strings have no literal to fold into
+TEST(FolderTest, StringConcatenation) {
+    EXPECT_EQ(fold("print \"a\" + \"b\";"), parse("print \"a\" + \"b\";"));
+    EXPECT_EQ(fold("print \"a\" == \"a\";"), parse("print true;"));
+}
+
+TEST(FolderTest, If) {
+    EXPECT_EQ(fold("if (1 < 2) print 1; else print 2;"), parse("print 1;"));
+    EXPECT_EQ(fold("if (nil) print 1; else { print 2; }"), parse("{ print 2; }"));
+    EXPECT_EQ(fold("if (false) print 1;"), parse("{}"));
+    EXPECT_EQ(fold("if (x) print 1 + 1;"), parse("if (x) print 2;"));
+}
+
+TEST(FolderTest, While) {
+    EXPECT_EQ(fold("while (1 > 2) print 1;"), parse("{}"));
+    EXPECT_EQ(fold("while (true) print 1 + 1;"), parse("while (true) print 2;"));
+    EXPECT_EQ(fold("for (var i = 0; false; i = i + 1) print i;"), parse("{ var i = 0; {} }"));
+}
+
+TEST(FolderTest, InsideFunctionsAndClasses) {
+    EXPECT_EQ(
+        fold("fun f() { if (false) return 1; return 2 * 3; } class A { m() { return this.x + (1 - 1); } }"),
+        parse("fun f() { {} return 6; } class A { m() { return this.x + 0; } }")
+    );
+}
@@ -0,0 +1,68 @@
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <string_view>
+
+import ast;
+import ast.fingerprint;
+import test.pipeline;
+
+using namespace loxxy;
+
+// the fingerprint of the function declared as `name` in the source, lexed with strings of its own
+auto fingerprint(std::string_view source, std::string_view name = "f") -> uint64_t {
+    Program program(source);
+    const auto* function = program.function(name);
+    if (function == nullptr) {
+        ADD_FAILURE() << "no function " << name;
+        return 0;
+    }
+    return Fingerprinter<empty, UniquePtrIndirection, true>{}(*function);
+}
+
+constexpr std::string_view declaration = "fun f(a, b) { var s = \"x\"; if (a < b) return s; return a - b; }";
+
+TEST(FingerprintTest, SameFunctionSameFingerprint) {
+    EXPECT_EQ(fingerprint(declaration), fingerprint(declaration));
+}
+
+TEST(FingerprintTest, MovedFunction) {
+    uint64_t moved = fingerprint(
+        "var before = 1;\n"
+        "fun g() { return before; }\n"
+        "\n"
+        "    fun f(a, b) {\n"
+        "        var s = \"x\";\n"
+        "        if (a < b)\n"
+        "            return s;\n"
+        "        return a - b;\n"
+        "    }\n"
+        "print before;"
+    );
+    EXPECT_EQ(moved, fingerprint(declaration));
+}
+
+TEST(FingerprintTest, ChangedBody) {
+    uint64_t original = fingerprint(declaration);
+    EXPECT_NE(fingerprint("fun f(a, b) { var s = \"x\"; if (a < b) return s; return b - a; }"), original);
+    EXPECT_NE(fingerprint("fun f(a, b) { var s = \"x\"; if (a < b) return s; return a + b; }"), original);
+    EXPECT_NE(fingerprint("fun f(a, b) { var s = \"y\"; if (a < b) return s; return a - b; }"), original);
+    EXPECT_NE(fingerprint("fun f(a, b) { var s = \"x\"; if (a <= b) return s; return a - b; }"), original);
+    EXPECT_NE(fingerprint("fun f(a, b) { var s = \"x\"; if (a < b) return s; return a - b; a; }"), original);
+    EXPECT_NE(fingerprint("fun f(a, b) { var s = \"x\"; if (a < b) { return s; } return a - b; }"), original);
+}
+
+TEST(FingerprintTest, ChangedSignature) {
+    uint64_t original = fingerprint(declaration);
+    EXPECT_NE(fingerprint("fun f(b, a) { var s = \"x\"; if (a < b) return s; return a - b; }"), original);
+    EXPECT_NE(fingerprint("fun f(a, b, c) { var s = \"x\"; if (a < b) return s; return a - b; }"), original);
+    EXPECT_NE(fingerprint("fun h(a, b) { var s = \"x\"; if (a < b) return s; return a - b; }", "h"), original);
+}
+
+// leaves like nil and this have no words of their own to hash
+TEST(FingerprintTest, Literals) {
+    EXPECT_NE(fingerprint("fun f() { return 1; }"), fingerprint("fun f() { return 2; }"));
+    EXPECT_NE(fingerprint("fun f() { return nil; }"), fingerprint("fun f() { return false; }"));
+    EXPECT_NE(fingerprint("fun f() { return true; }"), fingerprint("fun f() { return false; }"));
+    EXPECT_NE(fingerprint("fun f() { return \"1\"; }"), fingerprint("fun f() { return 1; }"));
+    EXPECT_EQ(fingerprint("fun f() { return nil; }"), fingerprint("fun f() { return nil; }"));
+}
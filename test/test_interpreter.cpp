@@ -0,0 +1,320 @@
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+import ast;
+import ast.interpreter;
+import ast.resolver;
+import test.pipeline;
+import utils.variant;
+
+using namespace loxxy;
+
+using Nodes = Family<SlotPayload, UniquePtrIndirection, true>;
+
+// what the program prints when run the way lox runs it, or with `lox --quicken`
+auto run(const Program<SlotPayload>& program, bool quickening = false) -> std::string {
+    Interpreter<SlotPayload, UniquePtrIndirection, true> interpreter{program.clock};
+    if (quickening)
+        interpreter.enableQuickening();
+
+    CapturedOutput output;
+    for (const auto& stmt : program.statements)
+        utils::visit(interpreter, stmt);
+    return output.str();
+}
+
+auto interpret(std::string_view source) -> std::string {
+    return run(Program<SlotPayload>(source));
+}
+
+// what the binary or unary node returned at the end of the function learned so far
+auto feedbackOf(const Program<SlotPayload>& program, std::string_view function) -> TypeFeedback {
+    utils::Adhoc<void, UniquePtrIndirection> adhoc;
+    auto of_operator = adhoc.make_visitor(
+        [](const Nodes::BinaryExpr& node) { return node.payload.feedback; },
+        [](const Nodes::UnaryExpr& node) { return node.payload.feedback; },
+        []<typename T>(const T&) -> TypeFeedback { throw std::invalid_argument("no operator returned"); }
+    );
+    auto of_return = adhoc.make_visitor(
+        [&](const Nodes::ReturnStmt& node) { return utils::visit(of_operator, node.expr); },
+        []<typename T>(const T&) -> TypeFeedback { throw std::invalid_argument("no return at the end"); }
+    );
+    return utils::visit(of_return, program.function(function)->body.back());
+}
+
+// a loop calling f with the arguments n times
+auto calls(std::string_view args, int n) -> std::string {
+    return "for (var i = 0; i < " + std::to_string(n) + "; i = i + 1) f(" + std::string(args) + ");";
+}
+
+constexpr int warmup = TypeFeedback::warmup_evaluations;
+
+TEST(InterpreterTest, Arithmetic) {
+    EXPECT_EQ(interpret("var a = 2; print a * 3 + 1;"), "7\n");
+}
+
+TEST(InterpreterTest, Fields) {
+    EXPECT_EQ(
+        interpret("class A {} var a = A(); a.x = 1; a.y = 2; a.x = a.x + a.y; print a.x; print a.y;"), "3\n2\n"
+    );
+}
+
+TEST(InterpreterTest, UndefinedField) {
+    EXPECT_THROW(interpret("class A {} print A().x;"), UndefinedProperty);
+}
+
+TEST(InterpreterTest, FieldsOnlyOnInstances) {
+    EXPECT_THROW(interpret("var a = 1; a.x = 2;"), TypeError);
+}
+
+TEST(InterpreterTest, Methods) {
+    EXPECT_EQ(
+        interpret("class Counter { init() { this.n = 0; } add(k) { this.n = this.n + k; return this; } }"
+                  "print Counter().add(2).add(3).n;"),
+        "5\n"
+    );
+}
+
+TEST(InterpreterTest, FieldShadowsMethod) {
+    EXPECT_EQ(
+        interpret("class A { m() { return \"method\"; } }"
+                  "fun f() { return \"field\"; }"
+                  "var a = A(); print a.m(); a.m = f; print a.m(); print A().m();"),
+        "method\nfield\nmethod\n"
+    );
+}
+
+// the GetExpr in getx caches where x is for the shape it saw last
+TEST(InterpreterTest, PropertyCacheMiss) {
+    EXPECT_EQ(
+        interpret("class A { init(x) { this.x = x; } }"
+                  "class B { init(x) { this.y = 0; this.x = x; } }"
+                  "fun getx(o) { return o.x; }"
+                  "print getx(A(1)); print getx(A(2)); print getx(B(3)); print getx(A(4));"),
+        "1\n2\n3\n4\n"
+    );
+}
+
+TEST(InterpreterTest, SetCacheMiss) {
+    EXPECT_EQ(
+        interpret("class A {} fun setx(o, x) { o.x = x; return o; }"
+                  "var a = A(); var b = A(); b.y = 0;"
+                  "setx(a, 1); setx(a, 2); setx(b, 3); setx(A(), 4);"
+                  "print a.x; print b.x; print b.y;"),
+        "2\n3\n0\n"
+    );
+}
+
+TEST(InterpreterTest, InitArity) {
+    EXPECT_EQ(interpret("class A { init(a, b) { this.s = a + b; } } print A(1, 2).s;"), "3\n");
+    EXPECT_THROW(interpret("class A { init(a, b) {} } A(1);"), WrongNumberOfArguments);
+    EXPECT_THROW(interpret("class A {} A(1);"), WrongNumberOfArguments);
+}
+
+TEST(InterpreterTest, InheritedMethod) {
+    EXPECT_EQ(interpret("class A { name() { return \"A\"; } } class B < A {} print B().name();"), "A\n");
+}
+
+// super in a method refers to the superclass of the class declaring the method, not of the instance
+TEST(InterpreterTest, SuperThroughHolder) {
+    EXPECT_EQ(
+        interpret("class A { f() { return \"A\"; } }"
+                  "class B < A { f() { return \"B\" + super.f(); } }"
+                  "class C < B {}"
+                  "class D < C { f() { return \"D\" + super.f(); } }"
+                  "print C().f(); print D().f();"),
+        "BA\nDBA\n"
+    );
+}
+
+TEST(InterpreterTest, SuperWithoutSuperclass) {
+    EXPECT_THROW(interpret("class A { f() { return super.f(); } } A().f();"), TypeError);
+}
+
+TEST(InterpreterTest, BoundMethod) {
+    EXPECT_EQ(
+        interpret("class A { init(x) { this.x = x; } get() { return this.x; } }"
+                  "var a = A(1); var get = a.get; a.x = 2;"
+                  "class Box {} var box = Box(); box.f = A(3).get;"
+                  "print get(); print box.f();"),
+        "2\n3\n"
+    );
+}
+
+TEST(InterpreterTest, BoundMethodOutlivesCall) {
+    EXPECT_EQ(
+        interpret("class A { init(x) { this.x = x; } get() { return this.x; } }"
+                  "fun make(x) { return A(x).get; }"
+                  "var get = make(4); print get();"),
+        "4\n"
+    );
+}
+
+TEST(InterpreterTest, ThisOutsideMethod) {
+    EXPECT_THROW(interpret("print this;"), UndefinedVariable);
+}
+
+TEST(ResolverTest, Shadowing) {
+    EXPECT_EQ(
+        interpret("var a = \"global\"; { var a = \"outer\"; { var a = \"inner\"; print a; } print a; } print a;"),
+        "inner\nouter\nglobal\n"
+    );
+}
+
+TEST(ResolverTest, Closures) {
+    EXPECT_EQ(
+        interpret("fun outer(x) { var y = 2; fun inner(z) { x = x + 1; return x + y + z; } return inner(3); }"
+                  "print outer(1);"),
+        "7\n"
+    );
+}
+
+// blocks that follow each other take the same slots
+TEST(ResolverTest, SiblingBlocks) {
+    EXPECT_EQ(
+        interpret("fun f() { { var a = 1; print a; } { var b; print b; var c = 3; print c; } } f();"), "1\nnil\n3\n"
+    );
+}
+
+// a function keeps reading the locals of the block it was declared in after the block ended
+TEST(ResolverTest, ClosureDeclaredInBlock) {
+    EXPECT_EQ(interpret("var f; { var a = 1; fun g() { print a; } f = g; } { var b = 2; f(); }"), "1\n");
+    EXPECT_EQ(
+        interpret("fun h() { var f; { var a = 1; { fun g() { return a; } f = g; } } var b = 2; return f(); }"
+                  "print h();"),
+        "1\n"
+    );
+}
+
+TEST(ResolverTest, ClosureOutlivingItsFrame) {
+    EXPECT_THROW(
+        interpret("fun make() { var i = 0; fun count() { i = i + 1; return i; } return count; } make()();"),
+        UndefinedVariable
+    );
+}
+
+// deep enough to overflow the native stack if every call nested
+TEST(TailCallTest, SelfRecursion) {
+    EXPECT_EQ(
+        interpret("fun count(n) { if (n == 0) return \"done\"; return count(n - 1); } print count(1000000);"), "done\n"
+    );
+}
+
+TEST(TailCallTest, Accumulator) {
+    EXPECT_EQ(
+        interpret("fun sum(n, acc) { if (n == 0) return acc; return sum(n - 1, acc + 1); } print sum(1000000, 0);"),
+        "1e+06\n"
+    );
+}
+
+TEST(TailCallTest, MutualRecursion) {
+    EXPECT_EQ(
+        interpret("fun even(n) { if (n == 0) return true; return odd(n - 1); }"
+                  "fun odd(n) { if (n == 0) return false; return even(n - 1); }"
+                  "print even(1000001);"),
+        "false\n"
+    );
+}
+
+TEST(TailCallTest, FromBlocksAndLoops) {
+    EXPECT_EQ(
+        interpret("fun f(n) { while (true) { { var m = n - 1; if (n == 0) return \"while\"; return f(m); } } }"
+                  "fun g(n) { for (var i = 0; i < 10; i = i + 1) { if (n == 0) return \"for\"; return g(n - 1); } }"
+                  "print f(1000000); print g(1000000);"),
+        "while\nfor\n"
+    );
+}
+
+TEST(TailCallTest, Method) {
+    EXPECT_EQ(
+        interpret("class C { init(tag) { this.tag = tag; }"
+                  "count(n) { if (n == 0) return this.tag; return this.count(n - 1); } }"
+                  "print C(\"method\").count(1000000);"),
+        "method\n"
+    );
+}
+
+TEST(TailCallTest, StoredBoundMethod) {
+    EXPECT_EQ(
+        interpret("class C { count(n) { if (n == 0) return \"bound\"; return next(n - 1); } }"
+                  "var next = C().count; print next(1000000);"),
+        "bound\n"
+    );
+}
+
+TEST(TailCallTest, Class) {
+    EXPECT_EQ(
+        interpret("class P { init(x) { this.x = x; } } fun make(x) { return P(x + 1); } print make(2).x;"), "3\n"
+    );
+}
+
+TEST(TailCallTest, CallerFrameIntact) {
+    EXPECT_EQ(
+        interpret("fun g(n) { if (n == 0) return 0; return g(n - 1); }"
+                  "fun h() { var a = 1; var b = g(10); return a + b; }"
+                  "print h();"),
+        "1\n"
+    );
+}
+
+TEST(TailCallTest, Arity) {
+    EXPECT_THROW(interpret("fun f(a) { return a; } fun g() { return f(1, 2); } g();"), WrongNumberOfArguments);
+}
+
+// a function declaring closures keeps its frame, which the closures read from
+TEST(TailCallTest, NotFromFunctionsDeclaringClosures) {
+    EXPECT_EQ(
+        interpret("fun apply(f) { return f(); }"
+                  "fun outer(n) { fun get() { return n; } return apply(get); }"
+                  "print outer(7);"),
+        "7\n"
+    );
+}
+
+TEST(QuickeningTest, SpecializesAfterWarmup) {
+    Program<SlotPayload> warming("fun f(a, b) { return a + b; }" + calls("i, 1", warmup - 1));
+    run(warming, true);
+    EXPECT_EQ(feedbackOf(warming, "f").handler, TypeFeedback::warming);
+
+    Program<SlotPayload> warm("fun f(a, b) { return a + b; }" + calls("i, 1", warmup) + "print f(2, 3);");
+    EXPECT_EQ(run(warm, true), "5\n");
+    EXPECT_EQ(feedbackOf(warm, "f").handler, TypeFeedback::add_numbers);
+}
+
+// the node keeps working on the operands that missed, and never specializes again
+TEST(QuickeningTest, GuardMissIsFinal) {
+    Program<SlotPayload> program(
+        "fun f(a, b) { return a == b; }" + calls("i, 1", warmup) + "print f(\"a\", \"a\");" + calls("i, 1", warmup) +
+        "print f(2, 2);"
+    );
+    EXPECT_EQ(run(program, true), "true\ntrue\n");
+    EXPECT_EQ(feedbackOf(program, "f").handler, TypeFeedback::generic);
+}
+
+TEST(QuickeningTest, MixedDuringWarmup) {
+    Program<SlotPayload> program("fun f(a, b) { return a + b; } print f(\"a\", \"b\");" + calls("i, 1", warmup));
+    EXPECT_EQ(run(program, true), "ab\n");
+    EXPECT_EQ(feedbackOf(program, "f").handler, TypeFeedback::generic);
+}
+
+// only negation has a handler on numbers
+TEST(QuickeningTest, Unary) {
+    Program<SlotPayload> negate("fun f(x) { return -x; }" + calls("i", warmup) + "print f(2);");
+    EXPECT_EQ(run(negate, true), "-2\n");
+    EXPECT_EQ(feedbackOf(negate, "f").handler, TypeFeedback::negate_number);
+
+    Program<SlotPayload> invert("fun f(x) { return !x; }" + calls("i", warmup) + "print f(0);");
+    EXPECT_EQ(run(invert, true), "false\n");
+    EXPECT_EQ(feedbackOf(invert, "f").handler, TypeFeedback::generic);
+}
+
+TEST(QuickeningTest, SameResults) {
+    constexpr std::string_view source =
+        "fun fib(n) { if (n < 2) return n; return fib(n - 1) + fib(n - 2); } print fib(15);"
+        "fun f(a, b) { return a + b; } var s = \"\";"
+        "for (var i = 0; i < 20; i = i + 1) { if (i == 10) s = f(s, \"x\"); print f(i, i / 4); print -i <= 2 * -i; }"
+        "print s; print f(s, \"y\"); print nil == 0; print 1 != \"1\";";
+    EXPECT_EQ(run(Program<SlotPayload>(source), true), run(Program<SlotPayload>(source)));
+}
@@ -1,14 +1,29 @@
 
+#include <filesystem>
+#include <fstream>
 #include <gtest/gtest.h>
+#include <limits>
 #include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 import lexer;
 import utils.generic_stream;
+import utils.source;
+import utils.string_store;
 import ast;
 
 using namespace loxxy;
 
+// the type, the lexeme or literal and the position of a token
+auto text(const Token& token) -> std::string {
+    std::stringstream ss;
+    ss << token;
+    return ss.str();
+}
+
 TEST(LoxxerTest, SingleCharTokens) {
     std::stringstream ss("(){},.-+;/*");
     utils::generic_stream<std::vector, Token> token_stream;
@@ -92,6 +107,39 @@ TEST(LoxxerTest, Identifiers) {
     }
 }
 
+TEST(LoxxerTest, KeywordLookalikes) {
+    std::stringstream ss("an andy classes els fals fo fur funny i ni o prin returns supe thi tru va whale While _var");
+    utils::generic_stream<std::vector, Token> token_stream;
+    Loxxer loxxer(std::move(ss), token_stream);
+
+    loxxer.scanTokens();
+
+    auto& tokens = token_stream.v;
+    EXPECT_EQ(tokens.size(), 21);
+    EXPECT_EQ(tokens.back().getType(), TokenType::END_OF_FILE);
+    tokens.pop_back();
+    for (const Token& token : tokens) {
+        EXPECT_EQ(token.getType(), TokenType::IDENTIFIER) << token.getLexeme();
+    }
+}
+
+TEST(LoxxerTest, IdentifierIds) {
+    std::stringstream ss("blib blab blib var blub blab");
+    utils::generic_stream<std::vector, Token> token_stream;
+    Loxxer loxxer(std::move(ss), token_stream);
+
+    loxxer.scanTokens();
+
+    const auto& tokens = token_stream.v;
+    EXPECT_EQ(tokens.size(), 7);
+    EXPECT_EQ(tokens[0].getLexeme().id, 0);
+    EXPECT_EQ(tokens[1].getLexeme().id, 1);
+    EXPECT_EQ(tokens[2].getLexeme().id, 0);
+    EXPECT_EQ(tokens[3].getLexeme().id, utils::persistent_string<>::no_id);
+    EXPECT_EQ(tokens[4].getLexeme().id, 2);
+    EXPECT_EQ(tokens[5].getLexeme().id, 1);
+}
+
 TEST(LoxxerTest, StringLiterals) {
     std::stringstream ss("\"blib\"\"blab\"\"blub\"\"blibblab\"\"slurp\"");
     utils::generic_stream<std::vector, Token> token_stream;
@@ -122,5 +170,158 @@ TEST(LoxxerTest, NumberLiterals) {
     for (const Token& token : tokens) {
         EXPECT_EQ(token.getType(), TokenType::NUMBER);
     }
+}
+
+TEST(LoxxerTest, NumberValues) {
+    std::stringstream ss("0.1 0.3 2.675 9007199254740993 123456789012345678901234.5 0x1f 0xA.8 0b101 0o17 007");
+    utils::generic_stream<std::vector, Token> token_stream;
+    Loxxer loxxer(std::move(ss), token_stream);
+
+    loxxer.scanTokens();
+
+    const auto& tokens = token_stream.v;
+    ASSERT_EQ(tokens.size(), 11);
+    // correctly rounded, like the compiler rounds the same literals
+    EXPECT_EQ(tokens[0].getLiteral().number, 0.1);
+    EXPECT_EQ(tokens[1].getLiteral().number, 0.3);
+    EXPECT_EQ(tokens[2].getLiteral().number, 2.675);
+    EXPECT_EQ(tokens[3].getLiteral().number, 9007199254740993.0);
+    EXPECT_EQ(tokens[4].getLiteral().number, 123456789012345678901234.5);
+    EXPECT_EQ(tokens[5].getLiteral().number, 31);
+    EXPECT_EQ(tokens[6].getLiteral().number, 10.5);
+    EXPECT_EQ(tokens[7].getLiteral().number, 5);
+    EXPECT_EQ(tokens[8].getLiteral().number, 15);
+    EXPECT_EQ(tokens[9].getLiteral().number, 7);
+}
+
+TEST(LoxxerTest, NumbersOutOfRange) {
+    std::stringstream ss(std::string(400, '9') + " 0." + std::string(400, '0') + "1");
+    utils::generic_stream<std::vector, Token> token_stream;
+    Loxxer loxxer(std::move(ss), token_stream);
+
+    loxxer.scanTokens();
+
+    const auto& tokens = token_stream.v;
+    ASSERT_EQ(tokens.size(), 3);
+    EXPECT_EQ(tokens[0].getLiteral().number, std::numeric_limits<double>::infinity());
+    EXPECT_EQ(tokens[1].getLiteral().number, 0);
+}
+
+TEST(LoxxerTest, MappedSource) {
+    std::string_view source = "var s = \"a\\tb\\\"c\"; // comment\nfun f(x1) { return x1 + 0x1f; }\nprint s; // last";
+    utils::generic_stream<std::vector, Token> streamed_tokens;
+    Loxxer streamed(std::stringstream(std::string(source)), streamed_tokens);
+    utils::generic_stream<std::vector, Token> mapped_tokens;
+    Loxxer mapped(utils::mapped_source::from_string(source), mapped_tokens);
+
+    streamed.scanTokens();
+    mapped.scanTokens();
+
+    const auto& expected = streamed_tokens.v;
+    const auto& tokens = mapped_tokens.v;
+    ASSERT_EQ(tokens.size(), expected.size());
+    EXPECT_EQ(tokens.back().getType(), TokenType::END_OF_FILE);
+    for (size_t i = 0; i < tokens.size(); i++) {
+        ASSERT_EQ(tokens[i].getType(), expected[i].getType());
+        EXPECT_EQ(text(tokens[i]), text(expected[i]));
+        EXPECT_EQ(tokens[i].getLine(), expected[i].getLine());
+    }
+    EXPECT_EQ(tokens[3].getType(), TokenType::STRING);
+    EXPECT_EQ(std::string_view(*tokens[3].getLiteral().string), "a\tb\"c");
+}
+
+TEST(LoxxerTest, TokenBuffer) {
+    std::string_view source = "var s = \"str\" + 2.5;\nprint s;";
+    utils::generic_stream<std::vector, Token> token_stream;
+    Loxxer loxxer(std::stringstream(std::string(source)), token_stream);
+    TokenBuffer token_buffer;
+    Loxxer buffered(std::stringstream(std::string(source)), token_buffer);
+
+    loxxer.scanTokens();
+    buffered.scanTokens();
+
+    static_assert(sizeof(Token) == 16);
+    const auto& expected = token_stream.v;
+    ASSERT_EQ(token_buffer.size(), expected.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+        EXPECT_EQ(token_buffer.peek().getType(), expected[i].getType());
+        EXPECT_EQ(text(token_buffer.get()), text(expected[i]));
+    }
+    EXPECT_TRUE(token_buffer.eof());
+    token_buffer.reset();
+    EXPECT_EQ(token_buffer.get().getType(), TokenType::VAR);
+    EXPECT_EQ(token_buffer.get().getLexeme().id, expected[1].getLexeme().id);
+    EXPECT_EQ(token_buffer.get().getType(), TokenType::EQUAL);
+    EXPECT_EQ(std::string_view(*token_buffer.get().getLiteral().string), "str");
+    token_buffer.get();
+    EXPECT_EQ(token_buffer.get().getLiteral().number, 2.5);
+}
 
-}
\ No newline at end of file
+TEST(LoxxerTest, MappedFile) {
+    const std::filesystem::path path = std::filesystem::temp_directory_path() / "loxxy_test_lexer_mapped_file.lox";
+    std::ofstream(path) << "print 1 + 2;";
+    utils::generic_stream<std::vector, Token> token_stream;
+    Loxxer loxxer(path, token_stream);
+
+    loxxer.scanTokens();
+    std::filesystem::remove(path);
+
+    const auto& tokens = token_stream.v;
+    ASSERT_EQ(tokens.size(), 6);
+    EXPECT_EQ(tokens[0].getType(), TokenType::PRINT);
+    EXPECT_EQ(tokens[1].getType(), TokenType::NUMBER);
+    EXPECT_EQ(tokens[2].getType(), TokenType::PLUS);
+    EXPECT_EQ(tokens[3].getType(), TokenType::NUMBER);
+    EXPECT_EQ(tokens[4].getType(), TokenType::SEMICOLON);
+    EXPECT_EQ(tokens[5].getType(), TokenType::END_OF_FILE);
+}
+
+TEST(LoxxerTest, MissingFile) {
+    utils::mapped_source source(std::filesystem::path("/nonexistent/loxxy.lox"));
+    EXPECT_TRUE(source.fail());
+    EXPECT_TRUE(source.eof());
+}
+
+TEST(LoxxerTest, ParallelLexing) {
+    // strings over several lines, some of them longer than a chunk, and comments with quotes
+    std::string source;
+    for (int i = 0; i < 20000; i++) {
+        source += "var v" + std::to_string(i % 97) + " = \"line\n" + std::to_string(i) + " // not a \\\" comment\";\n";
+        source += "fun f(a, b) { return a + b * 0x1f; } // \"not a string\n";
+        if (i % 5000 == 0)
+            source += "print \"" + std::string(100000, '\n') + "\";\n";
+    }
+    utils::generic_stream<std::vector, Token> expected_tokens;
+    Loxxer sequential(utils::mapped_source::from_string(source), expected_tokens);
+    const utils::persistent_string<>* expected_clock = sequential.addBuiltin("clock");
+    utils::generic_stream<std::vector, Token> token_stream;
+    ParallelLoxxer parallel(source, token_stream, 4);
+    const utils::persistent_string<>* clock = parallel.addBuiltin("clock");
+
+    EXPECT_FALSE(sequential.scanTokens());
+    EXPECT_FALSE(parallel.scanTokens());
+
+    EXPECT_EQ(clock->id, expected_clock->id);
+    const auto& expected = expected_tokens.v;
+    const auto& tokens = token_stream.v;
+    ASSERT_EQ(tokens.size(), expected.size());
+    std::unordered_map<std::string_view, const utils::persistent_string<>*> interned;
+    for (size_t i = 0; i < tokens.size(); i++) {
+        ASSERT_EQ(tokens[i].getType(), expected[i].getType()) << i;
+        EXPECT_EQ(text(tokens[i]), text(expected[i])) << i;
+        EXPECT_EQ(tokens[i].getLine(), expected[i].getLine()) << i;
+        EXPECT_EQ(tokens[i].getColumn(), expected[i].getColumn()) << i;
+        if (tokens[i].getType() == TokenType::NUMBER)
+            continue;
+
+        const utils::persistent_string<>* string = tokens[i].getType() == TokenType::STRING
+                                                       ? tokens[i].getLiteral().string
+                                                       : &tokens[i].getLexeme();
+        const utils::persistent_string<>* expected_string = expected[i].getType() == TokenType::STRING
+                                                                ? expected[i].getLiteral().string
+                                                                : &expected[i].getLexeme();
+        EXPECT_EQ(string->id, expected_string->id) << i;
+        // one string per content
+        EXPECT_EQ(interned.try_emplace(std::string_view(*string), string).first->second, string) << i;
+    }
+}
@@ -0,0 +1,419 @@
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/ExecutionEngine/JITEventListener.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Passes/OptimizationLevel.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <iterator>
+#include <map>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <stdlib.h>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <vector>
+
+import ast;
+import ast.interpreter;
+import ast.llvm;
+import ast.resolver;
+import test.pipeline;
+import utils.variant;
+
+using namespace loxxy;
+
+// what the program prints when run the way `loxc --jit --jobs=<jobs>` runs it
+auto jit(std::string_view source, unsigned jobs = 0) -> std::string {
+    Program program(source, Stage::folded);
+    IRGenerator<empty, UniquePtrIndirection, true> ir_gen;
+    ir_gen.parallelize(jobs, llvm::OptimizationLevel::O2);
+    for (const auto& stmt : program.statements)
+        utils::visit(ir_gen, stmt);
+    ir_gen.finish();
+    ir_gen.optimize(llvm::OptimizationLevel::O2);
+
+    CapturedOutput output;
+    ir_gen.run();
+    return output.str();
+}
+
+// the error generating the program reports
+auto jitError(std::string_view source, unsigned jobs) -> std::string {
+    Program program(source, Stage::folded);
+    IRGenerator<empty, UniquePtrIndirection, true> ir_gen;
+    ir_gen.parallelize(jobs, llvm::OptimizationLevel::O2);
+    try {
+        for (const auto& stmt : program.statements)
+            utils::visit(ir_gen, stmt);
+        ir_gen.finish();
+    } catch (const std::runtime_error& e) {
+        return e.what();
+    }
+    return "";
+}
+
+// what the tree interpreter prints for it
+auto interpret(std::string_view source) -> std::string {
+    Program<SlotPayload> program(source);
+    Interpreter<SlotPayload, UniquePtrIndirection, true> interpreter{program.clock};
+
+    CapturedOutput output;
+    for (const auto& stmt : program.statements)
+        utils::visit(interpreter, stmt);
+    return output.str();
+}
+
+// the locals of the function f that NumericLocals keeps unboxed
+auto numericLocals(std::string_view source) -> std::set<std::string> {
+    Program program(source, Stage::folded);
+    const auto* function = program.function("f");
+    NumericLocals<empty, UniquePtrIndirection, true> numeric;
+
+    std::set<std::string> names;
+    for (const auto* local : numeric.find(function->args, function->body))
+        names.emplace(std::string_view(*local->identifier));
+    return names;
+}
+
+TEST(JitTest, Strings) {
+    constexpr std::string_view source = R"(
+var a = "foo";
+var b = a + "bar";
+print b;
+print a + "" + a;
+fun greet(name) { return "hello " + name; }
+print greet(b);
+)";
+    EXPECT_EQ(jit(source), "foobar\nfoofoo\nhello foobar\n");
+    EXPECT_EQ(jit(source), interpret(source));
+}
+
+TEST(JitTest, Equality) {
+    constexpr std::string_view source = R"(
+fun same(a, b) { return a == b; }
+print same(1, 1);
+print same(1, 2);
+print same("ab", "a" + "b");
+print same("a", "b");
+print same(nil, nil);
+print same(nil, false);
+print same(0, false);
+print same(1, "1");
+print same(true, true);
+print 1 != nil;
+)";
+    EXPECT_EQ(jit(source), "true\nfalse\ntrue\nfalse\ntrue\nfalse\nfalse\nfalse\ntrue\ntrue\n");
+    EXPECT_EQ(jit(source), interpret(source));
+}
+
+TEST(JitTest, NilAndBooleans) {
+    constexpr std::string_view source = R"(
+fun nothing() {}
+fun negate(x) { return !x; }
+var unset;
+print nil;
+print unset;
+print nothing();
+print true;
+print 1 < 2;
+print negate(nil);
+print negate(0);
+print negate("");
+print nil or "or";
+print 1 and nil;
+)";
+    EXPECT_EQ(jit(source), "nil\nnil\nnil\ntrue\ntrue\ntrue\nfalse\nfalse\ntrue\nfalse\n");
+    EXPECT_EQ(jit(source), interpret(source));
+}
+
+// locals stay numbers until something else is assigned to them, or to a local they were initialized from
+TEST(JitTest, NumericLocals) {
+    EXPECT_EQ(
+        numericLocals("fun f(p) { var a = 1; var b = a * 2; var c = p; var d = 1; d = nil; var e = \"s\";"
+                      "while (a < 10) a = a + 1; return b; }"),
+        (std::set<std::string>{"a", "b"})
+    );
+    EXPECT_EQ(numericLocals("fun f() { var x = 1; var y = x; x = nil; return y; }"), std::set<std::string>{});
+
+    constexpr std::string_view source = R"(
+fun sum(n) { var s = 0; for (var i = 0; i < n; i = i + 1) s = s + i; return s; }
+fun mixed() { var a = 1; var b = a; a = "x"; print b; return a + "y"; }
+print sum(100);
+print mixed();
+)";
+    EXPECT_EQ(jit(source), "4950\n1\nxy\n");
+    EXPECT_EQ(jit(source), interpret(source));
+}
+
+// a type error ends the program with the status of the interpreters, after what it printed before
+TEST(JitTest, TypeErrorExits) {
+    EXPECT_EXIT(jit("print 1; print 1 + nil;"), ::testing::ExitedWithCode(70), "TypeError: bad operands for addition");
+    EXPECT_EXIT(jit("fun f(x) { return -x; } f(\"a\");"), ::testing::ExitedWithCode(70), "TypeError");
+}
+
+// the units generate the functions of the top-level code, calling each other and the globals, as the parse thread does
+TEST(JitTest, Parallel) {
+    constexpr std::string_view source = R"(
+var scale = 2;
+fun fib(n) { if (n < 2) return n; return fib(n - 1) + fib(n - 2); }
+fun scaled(n) { return scale * fib(n); }
+fun greet(name) { return "hello " + name; }
+fun isEven(n) { if (n == 0) return true; return isOdd(n - 1); }
+fun isOdd(n) { if (n == 0) return false; return isEven(n - 1); }
+fun later() { return late; }
+var late = "late";
+print scaled(10);
+scale = 3;
+print scaled(10);
+print greet("units");
+print isEven(10);
+print later();
+{
+    fun local() { return fib(5); }
+    print local();
+}
+)";
+    std::string expected = jit(source);
+    EXPECT_EQ(expected, "110\n165\nhello units\ntrue\nlate\n5\n");
+    EXPECT_EQ(jit(source, 1), expected);
+    EXPECT_EQ(jit(source, 2), expected);
+    EXPECT_EQ(jit(source, 4), expected);
+}
+
+// whichever units the functions end up on, the errors are the ones of the parse thread
+TEST(JitTest, ParallelErrors) {
+    for (unsigned jobs : {0, 1, 2, 4}) {
+        EXPECT_EQ(
+            jitError("fun f() { return g(1, 2); } fun h() {} fun g(a) { return a; }", jobs),
+            "wrong number of arguments for function g"
+        ) << jobs;
+        EXPECT_EQ(
+            jitError("fun f() { return 1; } fun g() { return f(); } fun f() { return 2; }", jobs),
+            "the JIT cannot redeclare function f"
+        ) << jobs;
+        EXPECT_EQ(
+            jitError("{ fun f() { return 1; } } fun f() { return 2; }", jobs), "the JIT cannot redeclare function f"
+        ) << jobs;
+        EXPECT_EQ(jitError("fun f() { return 1; } print f(1);", jobs), "wrong number of arguments for function f")
+            << jobs;
+    }
+}
+
+// a cache in a directory of its own, removed after the test
+class CodeCacheTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        std::string pattern = (std::filesystem::temp_directory_path() / "loxxy-cache-XXXXXX").string();
+        ASSERT_NE(mkdtemp(pattern.data()), nullptr);
+        directory = pattern;
+    }
+
+    void TearDown() override { std::filesystem::remove_all(directory); }
+
+    // generates the program the way loxc does, with the functions it declares compiled through the cache
+    void compile(
+        std::string_view source, const CodeCache& cache, llvm::OptimizationLevel level = llvm::OptimizationLevel::O0,
+        CodeTarget target = CodeTarget::host
+    ) {
+        Program program(source, Stage::folded);
+        IRGenerator<empty, UniquePtrIndirection, true> ir_gen;
+        ir_gen.setTarget(target);
+        ir_gen.parallelize(0, level, &cache);
+        for (const auto& stmt : program.statements)
+            utils::visit(ir_gen, stmt);
+        ir_gen.finish();
+    }
+
+    std::filesystem::path directory;
+};
+
+TEST_F(CodeCacheTest, StoreAndLoad) {
+    CodeCache cache(directory);
+    EXPECT_FALSE(cache.load(1).has_value());
+    EXPECT_EQ(cache.getMisses(), 1);
+    EXPECT_EQ(cache.getHits(), 0);
+
+    llvm::LLVMContext context;
+    llvm::Module module("unit", context);
+    CodeCache::Bitcode bitcode;
+    llvm::raw_svector_ostream stream(bitcode);
+    llvm::WriteBitcodeToFile(module, stream);
+    cache.store(1, bitcode);
+
+    std::optional<CodeCache::Bitcode> loaded = cache.load(1);
+    ASSERT_TRUE(loaded.has_value());
+    EXPECT_EQ(std::string_view(loaded->data(), loaded->size()), std::string_view(bitcode.data(), bitcode.size()));
+    EXPECT_EQ(cache.getHits(), 1);
+    EXPECT_EQ(cache.getMisses(), 1);
+}
+
+// files that are not bitcode, like one left half written by a compiler that crashed, are not loaded
+TEST_F(CodeCacheTest, NotBitcode) {
+    CodeCache cache(directory);
+    CodeCache::Bitcode garbage;
+    garbage.append({'n', 'o', 't', ' ', 'b', 'c'});
+    cache.store(2, garbage);
+
+    EXPECT_FALSE(cache.load(2).has_value());
+    EXPECT_EQ(cache.getMisses(), 1);
+    EXPECT_EQ(cache.getHits(), 0);
+}
+
+TEST_F(CodeCacheTest, CompiledFunctions) {
+    constexpr std::string_view program = "fun f(n) { return n * 2; }\n"
+                                         "fun g(n) { if (n < 1) return 0; return g(n - 1) + f(n); }\n"
+                                         "print g(10);\n";
+    {
+        CodeCache cache(directory);
+        compile(program, cache);
+        EXPECT_EQ(cache.getHits(), 0);
+        EXPECT_EQ(cache.getMisses(), 2);
+    }
+    {
+        CodeCache cache(directory);
+        compile(program, cache);
+        EXPECT_EQ(cache.getHits(), 2);
+        EXPECT_EQ(cache.getMisses(), 0);
+    }
+
+    // g only moved, f changed
+    {
+        CodeCache cache(directory);
+        compile(
+            "var unused = 1;\n"
+            "\n"
+            "fun f(n) { return n * 3; }\n"
+            "fun g(n) {\n"
+            "    if (n < 1) return 0;\n"
+            "    return g(n - 1) + f(n);\n"
+            "}\n"
+            "print g(10);\n",
+            cache
+        );
+        EXPECT_EQ(cache.getHits(), 1);
+        EXPECT_EQ(cache.getMisses(), 1);
+    }
+}
+
+// code optimized at another level, or for another machine, is compiled again
+TEST_F(CodeCacheTest, OptionsOfTheUnits) {
+    constexpr std::string_view program = "fun f(n) { return n + 1; } print f(1);";
+    CodeCache cache(directory);
+    compile(program, cache, llvm::OptimizationLevel::O0);
+    compile(program, cache, llvm::OptimizationLevel::O2);
+    compile(program, cache, llvm::OptimizationLevel::O2);
+    EXPECT_EQ(cache.getMisses(), 2);
+    EXPECT_EQ(cache.getHits(), 1);
+
+    compile(program, cache, llvm::OptimizationLevel::O2, CodeTarget::generic);
+    EXPECT_EQ(cache.getMisses(), 3);
+}
+
+// runs the program the way `loxc -O0 --jit` runs it, telling perf about the code
+void runProfiled(std::string_view source, PerfSupport perf) {
+    Program program(source, Stage::folded);
+    IRGenerator<empty, UniquePtrIndirection, true> ir_gen;
+    for (const auto& stmt : program.statements)
+        utils::visit(ir_gen, stmt);
+    ir_gen.finish();
+
+    CapturedOutput output;
+    ir_gen.run(perf);
+}
+
+constexpr std::string_view profiled = "fun square(x) {\n"
+                                      "    return x * x;\n"
+                                      "}\n"
+                                      "\n"
+                                      "fun sum(n) { return square(n) + square(n + 1); }\n"
+                                      "print sum(2);\n";
+
+// the names in the perf map of this process, with the lines of the functions
+TEST(PerfTest, PerfMap) {
+    runProfiled(profiled, PerfSupport{.map = true});
+
+    std::set<std::string> names;
+    std::ifstream map(std::format("/tmp/perf-{}.map", getpid()));
+    for (std::string address, size, name; map >> address >> size >> name;)
+        names.insert(name);
+    EXPECT_TRUE(names.contains("square:1"));
+    EXPECT_TRUE(names.contains("sum:5"));
+    EXPECT_TRUE(names.contains("script.main:1"));
+}
+
+template <typename T>
+auto read(const std::vector<char>& dump, size_t offset) -> T {
+    T value;
+    std::memcpy(&value, dump.data() + offset, sizeof(T));
+    return value;
+}
+
+// the lines of the code loaded under each name, from the records of a jitdump
+auto linesOfJitdump(const std::filesystem::path& path) -> std::map<std::string, std::set<int32_t>> {
+    std::ifstream file(path, std::ios::binary);
+    std::vector<char> dump{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+
+    constexpr uint32_t code_load = 0;
+    constexpr uint32_t debug_info = 2;
+    // the lines of a code address come before the code loaded there
+    std::map<uint64_t, std::set<int32_t>> lines_at;
+    std::map<std::string, std::set<int32_t>> lines;
+    // past the header, every record starts with its id, its size and a timestamp
+    for (size_t record = read<uint32_t>(dump, 8); record + 16 <= dump.size();) {
+        auto id = read<uint32_t>(dump, record);
+        auto size = read<uint32_t>(dump, record + 4);
+        if (size < 16 || record + size > dump.size())
+            break;
+
+        if (id == debug_info) {
+            auto address = read<uint64_t>(dump, record + 16);
+            auto entries = read<uint64_t>(dump, record + 24);
+            size_t entry = record + 32;
+            for (uint64_t i = 0; i < entries; i++) {
+                lines_at[address].insert(read<int32_t>(dump, entry + 8));
+                // past the address, the line, the discriminator and the name of the file
+                entry += 16 + std::strlen(dump.data() + entry + 16) + 1;
+            }
+        } else if (id == code_load) {
+            auto address = read<uint64_t>(dump, record + 32);
+            lines[std::string(dump.data() + record + 56)] = lines_at[address];
+        }
+        record += size;
+    }
+    return lines;
+}
+
+TEST(PerfTest, Jitdump) {
+    std::string directory = (std::filesystem::temp_directory_path() / "loxxy-jitdump-XXXXXX").string();
+    ASSERT_NE(mkdtemp(directory.data()), nullptr);
+    // read by the listener of LLVM once, when it is first created
+    setenv("JITDUMPDIR", directory.c_str(), 1);
+    if (llvm::JITEventListener::createPerfJITEventListener() == nullptr) {
+        std::filesystem::remove_all(directory);
+        GTEST_SKIP() << "this LLVM was built without jitdump support";
+    }
+
+    runProfiled(profiled, PerfSupport{.jitdump = true});
+
+    std::optional<std::filesystem::path> path;
+    for (const auto& file : std::filesystem::recursive_directory_iterator(directory))
+        if (file.path().filename() == std::format("jit-{}.dump", getpid()))
+            path = file.path();
+    ASSERT_TRUE(path.has_value());
+
+    std::map<std::string, std::set<int32_t>> lines = linesOfJitdump(path.value());
+    std::filesystem::remove_all(directory);
+    EXPECT_TRUE(lines["square"].contains(1));
+    EXPECT_FALSE(lines["square"].contains(5));
+    EXPECT_TRUE(lines["sum"].contains(5));
+    EXPECT_TRUE(lines["script.main"].contains(1));
+}
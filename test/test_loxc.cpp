@@ -0,0 +1,62 @@
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+
+struct Run {
+    std::string output;
+    int status = -1;
+};
+
+// what the shell command writes to stdout, and its wait status
+auto run(const std::string& command) -> Run {
+    Run result;
+    FILE* pipe = popen(command.c_str(), "r");
+    if (pipe == nullptr)
+        return result;
+
+    char buffer[256];
+    for (size_t n; (n = std::fread(buffer, 1, sizeof(buffer), pipe)) > 0;)
+        result.output.append(buffer, n);
+    result.status = pclose(pipe);
+    return result;
+}
+
+// what the executable that `loxc --emit-exe` makes of the source prints, linked through cxx if it is not empty
+auto compileAndRun(std::string_view source, const std::string& cxx = "") -> std::string {
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / ("test_loxc_" + std::to_string(getpid()));
+    std::filesystem::create_directories(dir);
+    std::ofstream(dir / "program.lox") << source;
+
+    std::string env = cxx.empty() ? "" : "CXX='" + cxx + "' ";
+    Run compiled = run(
+        env + LOXC + " --emit-exe=" + (dir / "program").string() + " " + (dir / "program.lox").string() + " 2>&1"
+    );
+    EXPECT_EQ(compiled.status, 0) << compiled.output;
+    EXPECT_TRUE(std::filesystem::exists(dir / "program")) << compiled.output;
+
+    Run program = run((dir / "program").string());
+    EXPECT_EQ(program.status, 0);
+    std::filesystem::remove_all(dir);
+    return program.output;
+}
+
+constexpr std::string_view program = R"(
+fun square(x) { return x * x; }
+var sum = 0;
+for (var i = 1; i <= 3; i = i + 1) sum = sum + square(i);
+print sum;
+print "done";
+)";
+
+TEST(LoxcTest, EmitExecutable) {
+    EXPECT_EQ(compileAndRun(program), "14\ndone\n");
+}
+
+// $CXX may start with a launcher, like ccache
+TEST(LoxcTest, CxxWithLauncher) {
+    EXPECT_EQ(compileAndRun(program, "env c++"), "14\ndone\n");
+}
@@ -0,0 +1,143 @@
+#include <chrono>
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+import ast;
+import ast.interpreter;
+import ast.profiler;
+import ast.resolver;
+import test.pipeline;
+import utils.variant;
+
+using namespace loxxy;
+
+constexpr std::string_view fib = "fun fib(n) { if (n < 2) return n; return fib(n - 1) + fib(n - 2); }";
+
+struct Profile {
+    std::string report;
+    std::string folded;
+};
+
+auto profileOf(CallProfiler& profiler) -> Profile {
+    profiler.finish();
+    std::stringstream report;
+    std::stringstream folded;
+    profiler.report(report);
+    profiler.writeFoldedStacks(folded);
+    return Profile{report.str(), folded.str()};
+}
+
+// what `lox --profile` reports about the program
+auto profile(std::string_view source) -> Profile {
+    Program<SlotPayload> program(source);
+    Interpreter<SlotPayload, UniquePtrIndirection, true, void, CallProfiler> interpreter{program.clock};
+
+    CapturedOutput output;
+    for (const auto& stmt : program.statements)
+        utils::visit(interpreter, stmt);
+    return profileOf(interpreter.getProfiler());
+}
+
+struct Row {
+    uint64_t calls = 0;
+    double inclusive = 0;
+    double exclusive = 0;
+};
+
+// the line of the function in the table of the report
+auto row(const Profile& profile, std::string_view function) -> Row {
+    std::stringstream report(profile.report);
+    for (std::string line; std::getline(report, line) && !line.empty();) {
+        if (!line.ends_with("  " + std::string(function)))
+            continue;
+        Row row;
+        std::stringstream(line) >> row.calls >> row.inclusive >> row.exclusive;
+        return row;
+    }
+    ADD_FAILURE() << "no row of " << function << " in\n" << profile.report;
+    return Row{};
+}
+
+// how often the caller called the callee, from the edges of the report
+auto calls(const Profile& profile, std::string_view caller, std::string_view callee) -> uint64_t {
+    std::string edge = "  " + std::string(caller) + " -> " + std::string(callee);
+    std::stringstream report(profile.report);
+    for (std::string line; std::getline(report, line);) {
+        uint64_t calls = 0;
+        if (line.ends_with(edge) && std::stringstream(line) >> calls)
+            return calls;
+    }
+    return 0;
+}
+
+TEST(CallProfilerTest, CallCounts) {
+    Profile profile = ::profile(std::string(fib) + "fun twice() { fib(5); fib(5); } twice(); fib(10);");
+    EXPECT_EQ(row(profile, "twice").calls, 1);
+    // fib(5) is 15 calls of fib, fib(10) 177
+    EXPECT_EQ(row(profile, "fib").calls, 2 * 15 + 177);
+}
+
+TEST(CallProfilerTest, Edges) {
+    Profile profile = ::profile(std::string(fib) + "fun twice() { fib(5); fib(5); } twice(); fib(10);");
+    EXPECT_EQ(calls(profile, "<script>", "twice"), 1);
+    EXPECT_EQ(calls(profile, "<script>", "fib"), 1);
+    EXPECT_EQ(calls(profile, "twice", "fib"), 2);
+    EXPECT_EQ(calls(profile, "fib", "fib"), 2 * 14 + 176);
+    EXPECT_EQ(calls(profile, "fib", "twice"), 0);
+}
+
+// one line per distinct stack, the deepest fib(4) makes being four calls of fib
+TEST(CallProfilerTest, FoldedStacks) {
+    Profile profile = ::profile(std::string(fib) + "fib(4);");
+    std::vector<std::string> stacks;
+    std::stringstream folded(profile.folded);
+    for (std::string line; std::getline(folded, line);) {
+        size_t space = line.rfind(' ');
+        ASSERT_NE(space, std::string::npos) << line;
+        EXPECT_GE(std::stoll(line.substr(space + 1)), 0) << line;
+        stacks.push_back(line.substr(0, space));
+    }
+    std::vector<std::string> expected{"<script>", "<script>;fib", "<script>;fib;fib", "<script>;fib;fib;fib",
+                                      "<script>;fib;fib;fib;fib"};
+    EXPECT_EQ(stacks, expected);
+}
+
+// the time of a recursive call is inside the one of the outer call already, so it is not added again
+TEST(CallProfilerTest, InclusiveTimeOfRecursion) {
+    using namespace std::chrono_literals;
+    Program<SlotPayload> program("fun f() {} fun g() {}");
+    const auto* f_decl = program.function("f");
+    const auto* g_decl = program.function("g");
+    FunctionDescriptor f{f_decl->identifier, f_decl->args, &f_decl->body, 0};
+    FunctionDescriptor g{g_decl->identifier, g_decl->args, &g_decl->body, 0};
+
+    CallProfiler profiler;
+    // f -> g -> f, every activation sleeping 20ms itself
+    profiler.enter(&f);
+    std::this_thread::sleep_for(20ms);
+    profiler.enter(&g);
+    std::this_thread::sleep_for(20ms);
+    profiler.enter(&f);
+    std::this_thread::sleep_for(20ms);
+    profiler.leave();
+    profiler.leave();
+    profiler.leave();
+    Profile profile = profileOf(profiler);
+
+    Row f_row = row(profile, "f");
+    EXPECT_EQ(f_row.calls, 2);
+    EXPECT_GE(f_row.inclusive, 60);
+    // counting the inner f again would give 80ms
+    EXPECT_LT(f_row.inclusive, 75);
+    EXPECT_GE(f_row.exclusive, 40);
+    EXPECT_LT(f_row.exclusive, f_row.inclusive);
+
+    Row g_row = row(profile, "g");
+    EXPECT_GE(g_row.inclusive, 40);
+    EXPECT_LT(g_row.inclusive, f_row.inclusive);
+}
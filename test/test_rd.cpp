@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+import ast;
+import ast.printer;
+import test.pipeline;
+
+using namespace loxxy;
+
+// the statements of the source as the ASTPrinter prints them, one per line
+auto parse(std::string_view source) -> std::string {
+    Program program(source);
+    std::stringstream printed;
+    for (const auto& stmt : program.statements)
+        printed << stmt << "\n";
+    return printed.str();
+}
+
+TEST(ParserTest, ClassDeclaration) {
+    std::string expected = "CLASS_DECL A {\n"
+                           "FUN_DECL init ( x ) {\n"
+                           "EXPR_STMT ( SET_EXPR ( this . x = x )  ) \n"
+                           "}\n"
+                           "FUN_DECL get (  ) {\n"
+                           "RETURN ( GET_EXPR ( this . x )  ) \n"
+                           "}\n"
+                           "}\n";
+    EXPECT_EQ(parse("class A { init(x) { this.x = x; } get() { return this.x; } }"), expected);
+}
+
+TEST(ParserTest, EmptySubclass) {
+    EXPECT_EQ(parse("class B < A {}"), "CLASS_DECL B < A {\n}\n");
+}
+
+TEST(ParserTest, GetChain) {
+    EXPECT_EQ(
+        parse("print a.b(1).c;"), "PRINT ( GET_EXPR ( CALL_EXPR ( GET_EXPR ( a . b ) ( 1 ) )  . c )  ) \n"
+    );
+}
+
+TEST(ParserTest, SetOnGet) {
+    EXPECT_EQ(parse("a.b.c = d;"), "EXPR_STMT ( SET_EXPR ( GET_EXPR ( a . b )  . c = d )  ) \n");
+}
+
+TEST(ParserTest, SetOnCall) {
+    EXPECT_EQ(parse("a.b().c = 1;"), "EXPR_STMT ( SET_EXPR ( CALL_EXPR ( GET_EXPR ( a . b ) (  ) )  . c = 1 )  ) \n");
+}
+
+TEST(ParserTest, CallIsNoAssignmentTarget) {
+    std::string printed = parse("a.b() = 3;");
+    EXPECT_EQ(printed.find("SET_EXPR"), std::string::npos) << printed;
+}
+
+TEST(ParserTest, This) {
+    EXPECT_EQ(parse("this.x;"), "EXPR_STMT ( GET_EXPR ( this . x )  ) \n");
+}
+
+TEST(ParserTest, Super) {
+    std::string expected = "CLASS_DECL B < A {\n"
+                           "FUN_DECL f (  ) {\n"
+                           "RETURN ( + (CALL_EXPR ( super.f( 1 ) ) ) (2) ) \n"
+                           "}\n"
+                           "}\n";
+    EXPECT_EQ(parse("class B < A { f() { return super.f(1) + 2; } }"), expected);
+}
+
+TEST(ParserTest, SuperNeedsMethod) {
+    EXPECT_EQ(parse("print super;").find("super"), std::string::npos);
+}
+
+// functions are at the line of their `fun` keyword, which the parameters and the body may not share
+TEST(ParserTest, FunctionLines) {
+    Program program("var a = 1;\n"
+                    "fun f(x) { return x; }\n"
+                    "\n"
+                    "fun\n"
+                    "g(\n"
+                    "  y) {\n"
+                    "}\n");
+    EXPECT_EQ(program.function("f")->line, 2);
+    EXPECT_EQ(program.function("g")->line, 4);
+}
@@ -0,0 +1,62 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <string_view>
+
+import utils.scan;
+
+using namespace utils;
+
+// every scanner of every level the CPU supports finds the same ends as the scalar ones
+static void expectSameEnds(std::string_view text) {
+    char_scanners scalar = char_scanners_for(simd_level::scalar);
+    const char* begin = text.data();
+    const char* end = text.data() + text.size();
+
+    for (simd_level level : {simd_level::sse2, simd_level::avx2}) {
+        if (!supports(level))
+            continue;
+
+        char_scanners scanners = char_scanners_for(level);
+        for (const char* p = begin; p <= end; p++) {
+            EXPECT_EQ(scanners.identifier(p, end), scalar.identifier(p, end)) << text << " at " << p - begin;
+            EXPECT_EQ(scanners.blanks(p, end), scalar.blanks(p, end)) << text << " at " << p - begin;
+            EXPECT_EQ(scanners.line(p, end), scalar.line(p, end)) << text << " at " << p - begin;
+            EXPECT_EQ(scanners.string_body(p, end), scalar.string_body(p, end)) << text << " at " << p - begin;
+        }
+    }
+}
+
+TEST(Scan, Scalar) {
+    char_scanners scalar = char_scanners_for(simd_level::scalar);
+    std::string_view text = "Some_identifier9 \t rest\"of \\ the\nline";
+    const char* begin = text.data();
+    const char* end = text.data() + text.size();
+
+    EXPECT_EQ(scalar.identifier(begin, end) - begin, 16);
+    EXPECT_EQ(scalar.blanks(begin + 16, end) - begin, 19);
+    EXPECT_EQ(scalar.string_body(begin, end) - begin, 23);
+    EXPECT_EQ(scalar.string_body(begin + 24, end) - begin, 27);
+    EXPECT_EQ(scalar.line(begin, end) - begin, 32);
+    EXPECT_EQ(scalar.line(end, end), end);
+}
+
+TEST(Scan, LongRuns) {
+    std::string identifier(100, 'a');
+    for (size_t i = 0; i < identifier.size(); i++)
+        identifier[i] = "azAZ09_"[i % 7];
+    expectSameEnds(identifier + ";");
+    expectSameEnds(std::string(70, ' ') + "\t\t" + std::string(30, ' ') + "x");
+    expectSameEnds(std::string(90, '/') + "\n" + std::string(40, '/'));
+    expectSameEnds(std::string(50, 'x') + "\\" + std::string(50, 'y') + "\"");
+}
+
+TEST(Scan, EveryByte) {
+    for (int c = 0; c < 256; c++) {
+        std::string text(40, 'a');
+        text[33] = static_cast<char>(c);
+        expectSameEnds(text);
+        text.assign(40, ' ');
+        text[33] = static_cast<char>(c);
+        expectSameEnds(text);
+    }
+}
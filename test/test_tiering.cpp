@@ -0,0 +1,185 @@
+#include <chrono>
+#include <gtest/gtest.h>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+import ast;
+import ast.interpreter;
+import ast.profiler;
+import ast.resolver;
+import ast.tiering;
+import test.pipeline;
+import utils.variant;
+
+using namespace loxxy;
+
+using Jit = TieredJit<SlotPayload, UniquePtrIndirection, true>;
+
+// calls check with the function declared last as `name` in the source, once the program is folded and resolved
+template <typename Check>
+void withFunction(std::string_view source, std::string_view name, Check check) {
+    Program<SlotPayload> program(source);
+    const auto* function = program.function(name);
+    ASSERT_NE(function, nullptr);
+
+    FunctionDescriptor descriptor{function->identifier, function->args, &function->body, function->payload.frame_size};
+    check(descriptor, function->body);
+}
+
+auto accepts(std::string_view source, std::string_view name = "f") -> bool {
+    bool accepted = false;
+    withFunction(source, name, [&](const FunctionDescriptor& descriptor, const auto& body) {
+        accepted = NumericSubset<SlotPayload, UniquePtrIndirection, true>{descriptor}.accepts(body);
+    });
+    return accepted;
+}
+
+// calls the function until it is hot, leaving every call to the interpreter
+void heatUp(Jit& jit, const FunctionDescriptor& descriptor, std::span<const Value> args) {
+    for (uint32_t i = 0; i < Jit::hot_threshold; i++) {
+        ASSERT_FALSE(jit.call(&descriptor, args, false).has_value());
+        jit.leave();
+    }
+}
+
+// makes the function hot with numeric calls, and waits for the compiler thread to have its native code ready
+auto promote(Jit& jit, const FunctionDescriptor& descriptor, std::span<const Value> args) -> std::optional<Value> {
+    heatUp(jit, descriptor, args);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    while (std::chrono::steady_clock::now() < deadline) {
+        if (std::optional<Value> result = jit.call(&descriptor, args, false); result.has_value())
+            return result;
+        jit.leave();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return std::nullopt;
+}
+
+TEST(NumericSubsetTest, Accepts) {
+    EXPECT_TRUE(accepts("fun f(n) { return n * n + 1; }"));
+    EXPECT_TRUE(accepts("fun f(n) { var a = 0; while (a < n) { a = a + 1; } print a; return a; }"));
+    EXPECT_TRUE(accepts("fun f(n) { if (n < 2) return n; return f(n - 1) + f(n - 2); }"));
+    EXPECT_TRUE(accepts("fun f(a, b) { if (a == b) return nil; return a < b and !(b > 10); }"));
+}
+
+TEST(NumericSubsetTest, RejectsStrings) {
+    EXPECT_FALSE(accepts("fun f(n) { print \"n\"; return n; }"));
+    EXPECT_FALSE(accepts("fun f(n) { var s = \"s\"; return n; }"));
+}
+
+TEST(NumericSubsetTest, RejectsGlobals) {
+    EXPECT_FALSE(accepts("var g = 1; fun f(n) { return n + g; }"));
+    EXPECT_FALSE(accepts("var g = 1; fun f(n) { g = n; return n; }"));
+}
+
+TEST(NumericSubsetTest, RejectsOtherCalls) {
+    EXPECT_FALSE(accepts("fun h(n) { return n; } fun f(n) { return h(n); }"));
+    EXPECT_FALSE(accepts("fun f(n) { return clock(); }"));
+    EXPECT_FALSE(accepts("fun f(n) { if (n < 1) return 0; return f(n - 1, n); }"));
+}
+
+TEST(NumericSubsetTest, RejectsClosuresAndClasses) {
+    EXPECT_FALSE(accepts("fun f(n) { fun g() { return n; } return n; }"));
+    EXPECT_FALSE(accepts("fun f(n) { class A {} return n; }"));
+}
+
+TEST(TieredJitTest, NativeResult) {
+    withFunction("fun f(n) { return n * n + 1; }", "f", [](const FunctionDescriptor& descriptor, const auto&) {
+        Jit jit;
+        std::vector<Value> args{Value{3.0}};
+        std::optional<Value> result = promote(jit, descriptor, args);
+        ASSERT_TRUE(result.has_value());
+        EXPECT_EQ(utils::get<double>(result.value()), 10.0);
+
+        args[0] = Value{-0.5};
+        result = jit.call(&descriptor, args, false);
+        ASSERT_TRUE(result.has_value());
+        EXPECT_EQ(utils::get<double>(result.value()), 1.25);
+    });
+}
+
+// arguments that are not numbers go to the interpreter, until there were too many of them
+TEST(TieredJitTest, NumericGuard) {
+    withFunction("fun f(a, b) { return a == b; }", "f", [](const FunctionDescriptor& descriptor, const auto&) {
+        Jit jit;
+        std::vector<Value> numbers{Value{1.0}, Value{1.0}};
+        std::vector<Value> mixed{Value{1.0}, Value{nullptr}};
+        ASSERT_TRUE(promote(jit, descriptor, numbers).has_value());
+
+        for (uint32_t i = 0; i + 1 < Jit::max_guard_failures; i++) {
+            ASSERT_FALSE(jit.call(&descriptor, mixed, false).has_value());
+            jit.leave();
+            ASSERT_TRUE(jit.call(&descriptor, numbers, false).has_value());
+        }
+        EXPECT_FALSE(jit.call(&descriptor, numbers, true).has_value());
+        jit.leave();
+
+        EXPECT_FALSE(jit.call(&descriptor, numbers, false).has_value());
+        jit.leave();
+    });
+}
+
+// a function that saw anything but numbers while warming up is never compiled
+TEST(TieredJitTest, NotNumericWhileCounting) {
+    withFunction("fun f(n) { return n; }", "f", [](const FunctionDescriptor& descriptor, const auto&) {
+        Jit jit;
+        std::vector<Value> boolean{Value{true}};
+        ASSERT_FALSE(jit.call(&descriptor, boolean, false).has_value());
+        jit.leave();
+
+        std::vector<Value> number{Value{1.0}};
+        heatUp(jit, descriptor, number);
+        for (uint32_t i = 0; i < Jit::hot_threshold; i++) {
+            ASSERT_FALSE(jit.call(&descriptor, number, false).has_value());
+            jit.leave();
+        }
+    });
+}
+
+// what the program prints, run by an interpreter with the Tier policy
+template <typename Tier>
+auto interpret(std::string_view source) -> std::string {
+    Program<SlotPayload> program(source);
+    CapturedOutput output;
+    Interpreter<SlotPayload, UniquePtrIndirection, true, void, NoProfiler, Tier> interpreter{program.clock};
+    for (const auto& stmt : program.statements)
+        utils::visit(interpreter, stmt);
+    return output.str();
+}
+
+// runs long enough past hot_threshold for the functions to be promoted, then calls them with other types
+constexpr std::string_view hot_program = R"(
+fun square(n) { return n * n; }
+fun same(a, b) { return a == b; }
+fun fib(n) { if (n < 2) return n; return fib(n - 1) + fib(n - 2); }
+
+var squares = 0;
+var sames = 0;
+for (var round = 0; round < 20; round = round + 1) {
+    for (var i = 0; i < 1000; i = i + 1) {
+        if (square(i) == i * i) squares = squares + 1;
+        if (same(i, i) and !same(i, i + 1)) sames = sames + 1;
+    }
+}
+print squares;
+print sames;
+print fib(20);
+
+var strings = 0;
+for (var i = 0; i < 300; i = i + 1) {
+    if (same("a", "a") and !same(nil, false)) strings = strings + 1;
+    if (same(i, i)) strings = strings + 1;
+}
+print strings;
+print square(-1.5);
+)";
+
+TEST(TieredJitTest, SameOutputAsInterpreter) {
+    std::string expected = interpret<NoTier>(hot_program);
+    EXPECT_EQ(expected, "20000\n20000\n6765\n600\n2.25\n");
+    EXPECT_EQ(interpret<Jit>(hot_program), expected);
+}
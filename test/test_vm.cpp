@@ -0,0 +1,166 @@
+#include <gtest/gtest.h>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+import ast;
+import ast.compiler;
+import ast.interpreter;
+import ast.resolver;
+import test.pipeline;
+import utils.string_store;
+import utils.variant;
+import vm;
+
+using namespace loxxy;
+
+// what a program printed, and the runtime error it stopped with
+struct Outcome {
+    std::string output;
+    std::string error{};
+
+    auto operator==(const Outcome&) const -> bool = default;
+};
+
+auto operator<<(std::ostream& os, const Outcome& outcome) -> std::ostream& {
+    os << '"' << outcome.output << '"';
+    if (!outcome.error.empty())
+        os << " then " << outcome.error;
+    return os;
+}
+
+// runs the program the way lox runs it, and stops at the runtime errors both backends raise
+template <typename Run>
+auto outcomeOf(std::string_view source, Run run) -> Outcome {
+    Program<SlotPayload> program(source);
+    Outcome outcome;
+    CapturedOutput output;
+    try {
+        run(program.clock, program.statements);
+    } catch (const TypeError&) {
+        outcome.error = "TypeError";
+    } catch (const UndefinedVariable&) {
+        outcome.error = "UndefinedVariable";
+    } catch (const NotCallable&) {
+        outcome.error = "NotCallable";
+    } catch (const WrongNumberOfArguments&) {
+        outcome.error = "WrongNumberOfArguments";
+    }
+    outcome.output = output.str();
+    return outcome;
+}
+
+auto interpret(std::string_view source) -> Outcome {
+    return outcomeOf(source, [](const persistent_string<>* clock_id, const auto& statements) {
+        Interpreter<SlotPayload, UniquePtrIndirection, true> interpreter{clock_id};
+        for (const auto& stmt : statements)
+            utils::visit(interpreter, stmt);
+    });
+}
+
+auto runVM(std::string_view source) -> Outcome {
+    return outcomeOf(source, [](const persistent_string<>* clock_id, const auto& statements) {
+        Compiler<SlotPayload, UniquePtrIndirection, true> compiler;
+        VM vm{clock_id};
+        vm.run(compiler.compile(statements));
+    });
+}
+
+void expectOutcome(std::string_view source, const Outcome& expected) {
+    EXPECT_EQ(interpret(source), expected) << "tree walking interpreter";
+    EXPECT_EQ(runVM(source), expected) << "bytecode VM";
+}
+
+TEST(BackendsTest, Arithmetic) {
+    expectOutcome(
+        "var a = 6; var b = 4;"
+        "print a + b * 2; print (a - b) / 4; print -a; print a > b; print a <= b == !true;"
+        "print \"x\" + \"y\"; print a == \"6\"; print nil == nil;",
+        {"14\n0.5\n-6\ntrue\ntrue\nxy\nfalse\ntrue\n"}
+    );
+}
+
+TEST(BackendsTest, Logic) {
+    expectOutcome(
+        "var t = true; var n = nil;"
+        "print t and n; print n or t; print n and undefined; print t or undefined;",
+        {"false\ntrue\nfalse\ntrue\n"}
+    );
+}
+
+TEST(BackendsTest, Globals) {
+    expectOutcome(
+        "var a = 1; fun get() { return a; } print get(); a = 2; print get();"
+        "fun set() { b = 3; } var b; set(); print b; var a = \"redefined\"; print get();",
+        {"1\n2\n3\nredefined\n"}
+    );
+}
+
+TEST(BackendsTest, Locals) {
+    expectOutcome(
+        "var a = \"global\"; { var a = \"outer\"; { var a = \"inner\"; print a; } print a; } print a;",
+        {"inner\nouter\nglobal\n"}
+    );
+}
+
+TEST(BackendsTest, Loops) {
+    expectOutcome(
+        "var sum = 0; for (var i = 0; i < 10; i = i + 1) { var j = 0; while (j < i) { sum = sum + j; j = j + 1; } }"
+        "print sum; var k = 0; while (k < 3) k = k + 1; print k;",
+        {"120\n3\n"}
+    );
+}
+
+TEST(BackendsTest, Recursion) {
+    expectOutcome(
+        "fun fib(n) { if (n < 2) return n; return fib(n - 1) + fib(n - 2); } print fib(15);"
+        "fun count(n) { if (n == 0) return \"done\"; return count(n - 1); } print count(100);",
+        {"610\ndone\n"}
+    );
+}
+
+TEST(BackendsTest, Closures) {
+    expectOutcome(
+        "fun outer(x) {"
+        "    fun add(y) { x = x + y; return x; }"
+        "    fun twice(f, y) { f(y); return f(y); }"
+        "    return twice(add, 2) + x;"
+        "}"
+        "print outer(1);"
+        "fun nested() { var a = 1; fun b() { fun c() { return a + 1; } return c(); } return b(); } print nested();",
+        {"10\n2\n"}
+    );
+}
+
+TEST(BackendsTest, ClosureOutlivingItsFunction) {
+    expectOutcome(
+        "fun make() { var i = 0; fun count() { i = i + 1; return i; } return count; }"
+        "var counter = make(); print \"made\"; print counter();",
+        {"made\n", "UndefinedVariable"}
+    );
+}
+
+TEST(BackendsTest, Functions) {
+    expectOutcome(
+        "fun none() {} print none(); fun f(a, b, c) { return a + b * c; } print f(1, 2, 3); print f;",
+        {"nil\n7\n<function>\n"}
+    );
+}
+
+TEST(BackendsTest, TypeErrors) {
+    expectOutcome("print 1; print 1 + nil; print 2;", {"1\n", "TypeError"});
+    expectOutcome("var s = \"a\"; print -s;", {"", "TypeError"});
+    expectOutcome("var a = 1; var b = true; print a < b;", {"", "TypeError"});
+}
+
+TEST(BackendsTest, UndefinedVariables) {
+    expectOutcome("print 1; print x;", {"1\n", "UndefinedVariable"});
+    expectOutcome("fun f() { return y; } f();", {"", "UndefinedVariable"});
+    expectOutcome("z = 1;", {"", "UndefinedVariable"});
+}
+
+TEST(BackendsTest, BadCalls) {
+    expectOutcome("var a = nil; a();", {"", "NotCallable"});
+    expectOutcome("fun f(a) { return a; } print f(1); f(1, 2);", {"1\n", "WrongNumberOfArguments"});
+    expectOutcome("print clock(1);", {"", "WrongNumberOfArguments"});
+}